@@ -1,17 +1,30 @@
 #include "app.hpp"
 
+#include "kat/graphics/pipeline_compiler.hpp"
+#include "kat/util/asset_store.hpp"
+#include "kat/util/profiler.hpp"
+
+#include <chrono>
+
 #include <imgui_impl_glfw.h>
 #include <imgui_impl_vulkan.h>
 
 namespace kat {
-    App::App(const WindowSettings &window_settings, const ContextSettings &context_settings, const std::filesystem::path& resources_dir) : m_resources_dir(resources_dir) {
-        glfwInit();
-        m_window = std::make_unique<Window>(window_settings);
+    App::App(const WindowSettings &window_settings, const ContextSettings &context_settings, const std::filesystem::path& resources_dir)
+        : m_start_time(std::chrono::steady_clock::now()), m_resources_dir(resources_dir) {
+        // headless apps never touch glfw, it fails to initialize without a display on some platforms.
+        if (!context_settings.headless) {
+            glfwInit();
+            m_window = std::make_unique<Window>(window_settings);
+        }
 
         m_context = kat::Context::init(m_window, context_settings);
 
-        m_this_frame   = static_cast<float>(glfwGetTime());
-        m_this_update  = static_cast<float>(glfwGetTime());
+        // packs built from the resources directory (see tools/kpak) shadow the loose files in it.
+        m_context->asset_store()->mount_directory(m_resources_dir);
+
+        m_this_frame   = time();
+        m_this_update  = time();
         m_render_delta = 1.0 / 60.0;
         m_update_delta = 1.0 / 60.0;
         m_last_frame   = m_this_frame - m_render_delta;
@@ -20,26 +33,48 @@ namespace kat {
 
     void App::launch() {
         m_render_thread = std::jthread([this]() {
+            KAT_PROFILE_THREAD("render");
+
             while (m_is_running) {
+                KAT_PROFILE_ZONE("frame");
+
                 auto frame_info = m_context->acquire_next_frame();
+                if (!frame_info) {
+                    // nothing to render to right now (minimized).
+                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                    continue;
+                }
 
-                render(frame_info, m_render_delta);
+                {
+                    KAT_PROFILE_ZONE("render");
+                    render(*frame_info, m_render_delta);
+                }
 
                 m_context->present();
 
                 m_last_frame   = m_this_frame;
-                m_this_frame   = static_cast<float>(glfwGetTime());
+                m_this_frame   = time();
                 m_render_delta = m_this_frame - m_last_frame;
             }
         });
 
-        while (m_window->is_open()) {
-            kat::Window::poll();
+        KAT_PROFILE_THREAD("main");
 
-            update(m_update_delta);
+        while (!m_exit_requested && (!m_window || m_window->is_open())) {
+            KAT_PROFILE_ZONE("tick");
+
+            if (m_window) {
+                KAT_PROFILE_ZONE("poll");
+                kat::Window::poll();
+            }
+
+            {
+                KAT_PROFILE_ZONE("update");
+                update(m_update_delta);
+            }
 
             m_last_update  = m_this_update;
-            m_this_update  = static_cast<float>(glfwGetTime());
+            m_this_update  = time();
             m_update_delta = m_this_update - m_last_update;
         }
 
@@ -47,6 +82,14 @@ namespace kat {
         m_render_thread.join();
 
         m_context->device().waitIdle();
+        m_context->flush_deferred();
+
+        m_context->pipeline_compiler()->shutdown();
+        m_context->save_pipeline_cache();
+    }
+
+    float App::time() const {
+        return std::chrono::duration<float>(std::chrono::steady_clock::now() - m_start_time).count();
     }
 
     ImGuiResources::ImGuiResources(const std::unique_ptr<Window> &window, const std::shared_ptr<Context> &context, vk::RenderPass render_pass) {
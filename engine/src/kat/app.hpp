@@ -7,6 +7,7 @@
 #include <imgui.h>
 
 #include <atomic>
+#include <chrono>
 #include <thread>
 #include <filesystem>
 
@@ -14,6 +15,7 @@ namespace kat {
 
     class App {
       public:
+        // no window is created if context_settings.headless is set, window() is null in that case.
         App(const WindowSettings &window_settings, const ContextSettings &context_settings, const std::filesystem::path& resources_dir);
         virtual ~App() = default;
 
@@ -22,6 +24,9 @@ namespace kat {
 
         void launch();
 
+        // Makes launch() return after the current update. This is the only way to stop a headless app.
+        inline void request_exit() { m_exit_requested = true; };
+
         [[nodiscard]] inline const std::unique_ptr<Window> &window() const { return m_window; }
 
         [[nodiscard]] inline const std::shared_ptr<Context> &context() const { return m_context; }
@@ -46,9 +51,16 @@ namespace kat {
 
 
       private:
+        // seconds since the app was created.
+        [[nodiscard]] float time() const;
+
         std::jthread m_render_thread;
         bool         m_is_running = true; // actually doesn't need to be atomic since it's only going to be changed by 1 thread, read by 1 (different) thread.
 
+        std::atomic_bool m_exit_requested = false;
+
+        std::chrono::steady_clock::time_point m_start_time;
+
         float m_this_frame, m_last_frame, m_render_delta;
         float m_this_update, m_last_update, m_update_delta;
 
@@ -0,0 +1,246 @@
+#include "kat/debug_ui.hpp"
+
+#include "kat/graphics/context.hpp"
+#include "kat/graphics/gpu_profiler.hpp"
+#include "kat/util/profiler.hpp"
+
+#include <imgui.h>
+
+#include <algorithm>
+#include <cstdio>
+
+namespace kat::debug_ui {
+    void gpu_profiler_window(const GpuProfiler &profiler, bool *open) {
+        if (!ImGui::Begin("GPU Profiler", open)) {
+            ImGui::End();
+            return;
+        }
+
+        if (!profiler.is_supported()) {
+            ImGui::TextUnformatted("Timestamp queries aren't supported on this device.");
+            ImGui::End();
+            return;
+        }
+
+        constexpr ImGuiTableFlags flags = ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingStretchProp;
+        if (ImGui::BeginTable("scopes", 5, flags)) {
+            ImGui::TableSetupColumn("Scope");
+            ImGui::TableSetupColumn("Last (ms)");
+            ImGui::TableSetupColumn("Min (ms)");
+            ImGui::TableSetupColumn("Avg (ms)");
+            ImGui::TableSetupColumn("Max (ms)");
+            ImGui::TableHeadersRow();
+
+            for (const auto &scope : profiler.stats()) {
+                ImGui::TableNextRow();
+
+                ImGui::TableNextColumn();
+                ImGui::Indent(static_cast<float>(scope.depth) * ImGui::GetStyle().IndentSpacing);
+                ImGui::TextUnformatted(scope.name.c_str());
+                ImGui::Unindent(static_cast<float>(scope.depth) * ImGui::GetStyle().IndentSpacing);
+
+                ImGui::TableNextColumn();
+                ImGui::Text("%.3f", scope.last);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.3f", scope.min);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.3f", scope.avg);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.3f", scope.max);
+            }
+
+            ImGui::EndTable();
+        }
+
+        ImGui::End();
+    }
+
+    void cpu_profiler_window(bool *open) {
+        // the window keeps its own copy of the zones so it can be paused and inspected.
+        static std::vector<profiler::ThreadCapture> threads;
+        static bool                                 paused    = false;
+        static float                                window_ms = 33.0f;
+
+        if (!ImGui::Begin("CPU Profiler", open)) {
+            ImGui::End();
+            return;
+        }
+
+#ifndef KAT_ENABLE_PROFILER
+        ImGui::TextUnformatted("The engine was built without KAT_ENABLE_PROFILER.");
+#endif
+
+        ImGui::Checkbox("Paused", &paused);
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(200.0f);
+        ImGui::SliderFloat("Range (ms)", &window_ms, 1.0f, 200.0f, "%.1f");
+        ImGui::SameLine();
+        if (ImGui::Button("Export trace"))
+            profiler::write_chrome_trace("trace.json");
+
+        if (!paused)
+            threads = profiler::capture();
+
+        uint64_t latest = 0;
+        for (const auto &thread : threads) {
+            if (!thread.events.empty())
+                latest = std::max(latest, thread.events.back().end_ns);
+        }
+
+        const auto     range_ns = static_cast<uint64_t>(window_ms * 1'000'000.0f);
+        const uint64_t earliest = latest > range_ns ? latest - range_ns : 0;
+
+        constexpr float LABEL_WIDTH = 100.0f;
+        const float     row_height  = ImGui::GetTextLineHeight() + 2.0f;
+
+        ImDrawList  *draw_list = ImGui::GetWindowDrawList();
+        const float  width     = std::max(ImGui::GetContentRegionAvail().x - LABEL_WIDTH, 1.0f);
+        const ImVec2 mouse     = ImGui::GetMousePos();
+
+        for (const auto &thread : threads) {
+            uint32_t max_depth = 0;
+            for (const auto &event : thread.events) {
+                max_depth = std::max(max_depth, event.depth);
+            }
+
+            const ImVec2 origin = ImGui::GetCursorScreenPos();
+            ImGui::TextUnformatted(thread.thread_name.c_str());
+
+            for (const auto &event : thread.events) {
+                if (event.end_ns < earliest)
+                    continue;
+
+                const float x0 = origin.x + LABEL_WIDTH + static_cast<float>(std::max(event.start_ns, earliest) - earliest) / static_cast<float>(range_ns) * width;
+                const float x1 = origin.x + LABEL_WIDTH + static_cast<float>(event.end_ns - earliest) / static_cast<float>(range_ns) * width;
+                const float y0 = origin.y + static_cast<float>(event.depth) * row_height;
+                const float y1 = y0 + row_height - 1.0f;
+
+                // cycle through a few hues by depth so nested zones stand out from their parents.
+                const ImU32 color = ImColor::HSV(static_cast<float>(event.depth % 6) / 6.0f, 0.5f, 0.7f);
+                draw_list->AddRectFilled(ImVec2(x0, y0), ImVec2(std::max(x1, x0 + 1.0f), y1), color);
+
+                if (x1 - x0 > 20.0f) {
+                    const ImVec4 clip(x0, y0, x1, y1);
+                    draw_list->AddText(nullptr, 0.0f, ImVec2(x0 + 2.0f, y0 + 1.0f), IM_COL32_WHITE, event.name, nullptr, 0.0f, &clip);
+                }
+
+                if (mouse.x >= x0 && mouse.x <= x1 && mouse.y >= y0 && mouse.y <= y1 && ImGui::IsWindowHovered())
+                    ImGui::SetTooltip("%s: %.3f ms", event.name, static_cast<double>(event.end_ns - event.start_ns) / 1'000'000.0);
+            }
+
+            ImGui::SetCursorScreenPos(ImVec2(origin.x, origin.y + static_cast<float>(max_depth + 1) * row_height + 4.0f));
+        }
+
+        // SetCursorScreenPos alone doesn't extend the window.
+        ImGui::Dummy(ImVec2(0.0f, 0.0f));
+        ImGui::End();
+    }
+
+    void memory_window(GpuAllocator &allocator, bool *open) {
+        constexpr double MIB = 1024.0 * 1024.0;
+
+        if (!ImGui::Begin("GPU Memory", open)) {
+            ImGui::End();
+            return;
+        }
+
+        if (ImGui::Button("Export stats"))
+            allocator.write_stats_json("memory_stats.json");
+
+        ImGui::SameLine();
+        ImGui::BeginDisabled(allocator.is_defragmenting());
+        if (ImGui::Button("Defragment"))
+            allocator.begin_defragmentation();
+        ImGui::EndDisabled();
+
+        if (const auto last = allocator.last_defragmentation()) {
+            ImGui::SameLine();
+            ImGui::Text("last: moved %u (%.1f MiB), freed %u blocks", last->allocations_moved, static_cast<double>(last->bytes_moved) / MIB, last->blocks_freed);
+        }
+
+        const auto stats = allocator.stats();
+
+        constexpr ImGuiTableFlags flags = ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingStretchProp;
+        if (ImGui::BeginTable("heaps", 5, flags)) {
+            ImGui::TableSetupColumn("Heap");
+            ImGui::TableSetupColumn("Usage / Budget");
+            ImGui::TableSetupColumn("Peak (MiB)");
+            ImGui::TableSetupColumn("Blocks (MiB)");
+            ImGui::TableSetupColumn("Allocations");
+            ImGui::TableHeadersRow();
+
+            for (const auto &heap : stats.heaps) {
+                ImGui::TableNextRow();
+
+                ImGui::TableNextColumn();
+                ImGui::Text("%u%s", heap.index, heap.device_local ? " (device)" : "");
+
+                ImGui::TableNextColumn();
+                char overlay[64];
+                std::snprintf(overlay, sizeof(overlay), "%.1f / %.1f MiB", static_cast<double>(heap.usage) / MIB, static_cast<double>(heap.budget) / MIB);
+                ImGui::ProgressBar(heap.budget > 0 ? static_cast<float>(static_cast<double>(heap.usage) / static_cast<double>(heap.budget)) : 0.0f, ImVec2(-1.0f, 0.0f),
+                                   overlay);
+
+                ImGui::TableNextColumn();
+                ImGui::Text("%.1f", static_cast<double>(heap.peak_usage) / MIB);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.1f", static_cast<double>(heap.block_bytes) / MIB);
+                ImGui::TableNextColumn();
+                ImGui::Text("%u", heap.allocation_count);
+            }
+
+            ImGui::EndTable();
+        }
+
+        if (ImGui::BeginTable("categories", 5, flags)) {
+            ImGui::TableSetupColumn("Category");
+            ImGui::TableSetupColumn("Current (MiB)");
+            ImGui::TableSetupColumn("Peak (MiB)");
+            ImGui::TableSetupColumn("Live");
+            ImGui::TableSetupColumn("Total");
+            ImGui::TableHeadersRow();
+
+            for (size_t i = 0; i < stats.categories.size(); i++) {
+                const auto &category = stats.categories[i];
+
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::TextUnformatted(to_string(static_cast<MemoryCategory>(i)));
+                ImGui::TableNextColumn();
+                ImGui::Text("%.2f", static_cast<double>(category.bytes) / MIB);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.2f", static_cast<double>(category.peak_bytes) / MIB);
+                ImGui::TableNextColumn();
+                ImGui::Text("%llu", static_cast<unsigned long long>(category.count));
+                ImGui::TableNextColumn();
+                ImGui::Text("%llu", static_cast<unsigned long long>(category.total_allocations));
+            }
+
+            ImGui::EndTable();
+        }
+
+        if (!stats.pools.empty() && ImGui::BeginTable("pools", 4, flags)) {
+            ImGui::TableSetupColumn("Pool");
+            ImGui::TableSetupColumn("Used / Blocks (MiB)");
+            ImGui::TableSetupColumn("Blocks");
+            ImGui::TableSetupColumn("Allocations");
+            ImGui::TableHeadersRow();
+
+            for (const auto &pool : stats.pools) {
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::Text("%s (%s)", pool.name.c_str(), pool.algorithm == PoolAlgorithm::LINEAR ? "linear" : "tlsf");
+                ImGui::TableNextColumn();
+                ImGui::Text("%.2f / %.2f", static_cast<double>(pool.allocation_bytes) / MIB, static_cast<double>(pool.block_bytes) / MIB);
+                ImGui::TableNextColumn();
+                ImGui::Text("%u", pool.block_count);
+                ImGui::TableNextColumn();
+                ImGui::Text("%u", pool.allocation_count);
+            }
+
+            ImGui::EndTable();
+        }
+
+        ImGui::End();
+    }
+} // namespace kat::debug_ui
@@ -0,0 +1,19 @@
+#pragma once
+
+namespace kat {
+    class GpuAllocator;
+    class GpuProfiler;
+}
+
+namespace kat::debug_ui {
+
+    // Table of the profiler's scopes (nested scopes are indented) with their last/min/avg/max times. Has to be called between ImGui::NewFrame() and ImGui::Render().
+    void gpu_profiler_window(const GpuProfiler &profiler, bool *open = nullptr);
+
+    // Timeline of the most recent cpu zones (see kat/util/profiler.hpp), one lane per thread. Empty unless the engine is built with KAT_ENABLE_PROFILER.
+    void cpu_profiler_window(bool *open = nullptr);
+
+    // Per-heap usage against the budget and per-category allocation totals, with their high-water marks. Can also start a defragmentation.
+    void memory_window(GpuAllocator &allocator, bool *open = nullptr);
+
+} // namespace kat::debug_ui
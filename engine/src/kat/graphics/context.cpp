@@ -6,24 +6,77 @@
 #include <GLFW/glfw3.h>
 #include <set>
 
+#include <cstring>
+#include <fstream>
 #include <iostream>
 
 #include <algorithm>
+#include <chrono>
 #include <ranges>
+#include <thread>
 
 #include "context.hpp"
+#include "kat/graphics/frame_allocator.hpp"
+#include "kat/graphics/gpu_profiler.hpp"
+#include "kat/graphics/layout_cache.hpp"
+#include "kat/graphics/ktx2.hpp"
+#include "kat/graphics/mipmaps.hpp"
+#include "kat/graphics/pipeline_compiler.hpp"
+#include "kat/graphics/pipeline_registry.hpp"
 #include "kat/graphics/shader_cache.hpp"
+#include "kat/graphics/shader_watcher.hpp"
+#include "kat/graphics/texture_loader.hpp"
+#include "kat/graphics/upload_queue.hpp"
+#include "kat/util/hash.hpp"
+#include "kat/util/asset_store.hpp"
+#include "kat/util/profiler.hpp"
 
 namespace kat {
+    // how often (in frames) automatic defragmentation checks for wasted memory, and how much has to be wasted before it starts.
+    constexpr uint64_t AUTO_DEFRAGMENTATION_INTERVAL  = 600;
+    constexpr uint64_t AUTO_DEFRAGMENTATION_MIN_WASTE = 32 * 1024 * 1024;
 
     uint32_t vkapiver(const Version &ver) {
         return VK_MAKE_API_VERSION(0, ver.major, ver.minor, ver.patch);
     }
 
-    Context::Context(const std::unique_ptr<Window> &window, const ContextSettings &settings) {
+    // The driver already embeds a header in the cache data, but it's only checked by the driver after it has parsed the blob (and some drivers are less than careful
+    // about it). We wrap the data in our own header so that a stale or corrupted file is rejected before it ever reaches the driver.
+    struct PipelineCacheFileHeader {
+        static constexpr uint32_t MAGIC   = 0x4843504b; // "KPCH"
+        static constexpr uint32_t VERSION = 1;
+
+        uint32_t magic;
+        uint32_t version;
+        uint32_t vendor_id;
+        uint32_t device_id;
+        uint32_t driver_version;
+        uint8_t  pipeline_cache_uuid[VK_UUID_SIZE];
+        uint64_t data_size;
+        uint64_t data_hash;
+    };
+
+    PipelineCacheFileHeader make_pipeline_cache_header(const vk::PhysicalDeviceProperties &props) {
+        PipelineCacheFileHeader header{};
+        header.magic          = PipelineCacheFileHeader::MAGIC;
+        header.version        = PipelineCacheFileHeader::VERSION;
+        header.vendor_id      = props.vendorID;
+        header.device_id      = props.deviceID;
+        header.driver_version = props.driverVersion;
+        std::memcpy(header.pipeline_cache_uuid, props.pipelineCacheUUID.data(), VK_UUID_SIZE);
+        return header;
+    }
+
+    Context::Context(const std::unique_ptr<Window> &window, const ContextSettings &settings) : m_headless(settings.headless) {
+        if (!m_headless && !window) {
+            std::cerr << "Error: A window is required unless the context is headless." << std::endl;
+            throw fatal_exc{};
+        }
+
         vkb::InstanceBuilder instance_builder;
 
         auto inst_ret = instance_builder.require_api_version(VK_API_VERSION_1_3)
+                            .set_headless(m_headless)
                             .set_app_name(settings.app_name.c_str())
                             .set_engine_name("KatEngine")
                             .set_app_version(vkapiver(settings.app_version))
@@ -40,10 +93,15 @@ namespace kat {
         m_inst     = inst_ret.value();
         m_instance = m_inst.instance;
 
-        m_surface = window->create_surface(m_instance);
-
         vkb::PhysicalDeviceSelector selector{m_inst};
 
+        if (m_headless) {
+            selector.require_present(false);
+        } else {
+            m_surface = window->create_surface(m_instance);
+            selector.set_surface(m_surface).require_present();
+        }
+
         vk::PhysicalDeviceFeatures         features{};
         vk::PhysicalDeviceVulkan11Features features11{};
         vk::PhysicalDeviceVulkan12Features features12{};
@@ -59,13 +117,15 @@ namespace kat {
         features11.variablePointers              = true;
         features11.variablePointersStorageBuffer = true;
         features12.timelineSemaphore             = true;
+        features12.hostQueryReset                = true;
         features12.uniformBufferStandardLayout   = true;
         features13.dynamicRendering              = true;
 
 
-        auto phys_ret = selector.set_surface(m_surface)
-                            .require_present()
-                            .set_minimum_version(1, 3)
+        // lets vma report real per-heap budgets instead of estimating them.
+        selector.add_desired_extension(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
+        auto phys_ret = selector.set_minimum_version(1, 3)
                             .set_required_features(features)
                             .set_required_features_11(features11)
                             .set_required_features_12(features12)
@@ -81,6 +141,11 @@ namespace kat {
 
         m_phys            = phys_ret.value();
         m_physical_device = m_phys.physical_device;
+        m_memory_budget   = m_phys.is_extension_present(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
+        // optional, only compressed textures need it.
+        m_bc_compression                     = m_physical_device.getFeatures().textureCompressionBC;
+        m_phys.features.textureCompressionBC = m_bc_compression;
 
         vkb::DeviceBuilder device_builder{m_phys};
 
@@ -94,55 +159,192 @@ namespace kat {
         m_dev    = dev_ret.value();
         m_device = m_dev.device;
 
+        m_deletion_queue = std::make_unique<DeletionQueue>(m_device);
+
         auto gqr = m_dev.get_queue(vkb::QueueType::graphics);
         if (!gqr) {
             std::cerr << "Failed to get graphics queue. Error: " << gqr.error().message();
             throw fatal_exc{};
         }
-        m_graphics_queue = gqr.value();
+        m_graphics_queue  = gqr.value();
+        m_graphics_family = m_dev.get_queue_index(vkb::QueueType::graphics).value();
 
-        auto pqr = m_dev.get_queue(vkb::QueueType::present);
-        if (!pqr) {
-            std::cerr << "Failed to get present queue. Error: " << pqr.error().message();
-            throw fatal_exc{};
+        if (m_headless) {
+            // nothing is ever presented, the present queue is only kept around so that code using it doesn't have to care.
+            m_present_queue  = m_graphics_queue;
+            m_present_family = m_graphics_family;
+        } else {
+            auto pqr = m_dev.get_queue(vkb::QueueType::present);
+            if (!pqr) {
+                std::cerr << "Failed to get present queue. Error: " << pqr.error().message();
+                throw fatal_exc{};
+            }
+            m_present_queue  = pqr.value();
+            m_present_family = m_dev.get_queue_index(vkb::QueueType::present).value();
         }
-        m_present_queue = pqr.value();
 
-        auto tqr = m_dev.get_queue(vkb::QueueType::transfer);
-        if (!tqr) {
-            std::cerr << "Failed to get transfer queue. Error: " << tqr.error().message();
-            throw fatal_exc{};
+        // software implementations (lavapipe, swiftshader) usually expose a single queue family, so the transfer and compute queues fall back to the graphics queue.
+        if (auto tqr = m_dev.get_queue(vkb::QueueType::transfer)) {
+            m_transfer_queue  = tqr.value();
+            m_transfer_family = m_dev.get_queue_index(vkb::QueueType::transfer).value();
+        } else {
+            std::cout << "No separate transfer queue (" << tqr.error().message() << "), using the graphics queue for transfers." << std::endl;
+            m_transfer_queue  = m_graphics_queue;
+            m_transfer_family = m_graphics_family;
         }
-        m_transfer_queue = tqr.value();
 
-        auto cqr = m_dev.get_queue(vkb::QueueType::compute);
-        if (!cqr) {
-            std::cerr << "Failed to get compute queue. Error: " << cqr.error().message();
-            throw fatal_exc{};
+        if (auto cqr = m_dev.get_queue(vkb::QueueType::compute)) {
+            m_compute_queue  = cqr.value();
+            m_compute_family = m_dev.get_queue_index(vkb::QueueType::compute).value();
+        } else {
+            std::cout << "No separate compute queue (" << cqr.error().message() << "), using the graphics queue for compute." << std::endl;
+            m_compute_queue  = m_graphics_queue;
+            m_compute_family = m_graphics_family;
         }
-        m_compute_queue = cqr.value();
 
-        m_graphics_family = m_dev.get_queue_index(vkb::QueueType::graphics).value();
-        m_present_family  = m_dev.get_queue_index(vkb::QueueType::present).value();
-        m_transfer_family = m_dev.get_queue_index(vkb::QueueType::transfer).value();
-        m_compute_family  = m_dev.get_queue_index(vkb::QueueType::compute).value();
+        for (const auto &q : {m_graphics_queue, m_present_queue, m_transfer_queue, m_compute_queue}) {
+            if (!m_queue_mutexes.contains(static_cast<VkQueue>(q)))
+                m_queue_mutexes.emplace(static_cast<VkQueue>(q), std::make_unique<std::mutex>());
+        }
 
-        create_swapchain();
+        m_frames_in_flight  = std::max(1u, settings.frames_in_flight);
+
+        // headless contexts create their images in init(), they need the allocator.
+        if (m_headless) {
+            m_swapchain_extent = settings.headless_extent;
+            m_swapchain_format = settings.headless_format;
+        } else {
+            create_swapchain();
+        }
+
+        m_staging_ring_size = settings.staging_ring_size;
 
-        m_image_available_semaphores = create_semaphores<MAX_FRAMES_IN_FLIGHT>();
-        m_render_finished_semaphores = create_semaphores<MAX_FRAMES_IN_FLIGHT>();
-        m_in_flight_fences           = create_fences_signaled<MAX_FRAMES_IN_FLIGHT>();
+        m_frame_allocator_size = settings.frame_allocator_size;
+
+        // there is nothing to acquire from or present to without a swapchain, so headless frames only use the timeline.
+        if (!m_headless) {
+            m_image_available_semaphores = create_semaphores(m_frames_in_flight);
+            m_render_finished_semaphores = create_semaphores(m_frames_in_flight);
+        }
+        m_frame_timeline = create_timeline_semaphore(0);
 
         m_single_time_gt_pool = create_command_pool_raw(m_graphics_family, true);
+
+        m_pipeline_cache_path       = settings.pipeline_cache_path;
+        m_pipeline_compiler_threads = settings.pipeline_compiler_threads;
+        m_texture_loader_threads    = settings.texture_loader_threads;
+        m_shader_cache_capacity     = settings.shader_cache_capacity;
+        m_shader_hot_reload         = settings.shader_hot_reload;
+        load_pipeline_cache();
+
+        m_asset_store = std::make_unique<AssetStore>();
     }
 
     // init things that need shared_from_this()
     void Context::init() {
-        m_shader_cache  = std::make_unique<ShaderCache>(shared_from_this());
+        m_shader_cache  = std::make_unique<ShaderCache>(shared_from_this(), m_shader_cache_capacity);
+        if (m_shader_hot_reload)
+            m_shader_watcher = std::make_unique<ShaderWatcher>(shared_from_this());
         m_gpu_allocator = std::make_unique<GpuAllocator>(shared_from_this());
+        m_deletion_queue->set_allocator(m_gpu_allocator->handle());
+        m_upload_queue  = std::make_unique<UploadQueue>(shared_from_this());
+
+        m_frame_allocator = std::make_unique<FrameAllocator>(shared_from_this(), m_frame_allocator_size);
+        m_gpu_profiler    = std::make_unique<GpuProfiler>(shared_from_this());
+
+        if (m_headless)
+            create_offscreen_images();
+
+        m_pipeline_compiler = std::make_unique<PipelineCompiler>(shared_from_this(), m_pipeline_compiler_threads);
+        m_pipeline_registry = std::make_unique<PipelineRegistry>(shared_from_this());
+        m_layout_cache      = std::make_unique<LayoutCache>(shared_from_this());
+        m_texture_loader    = std::make_unique<TextureLoader>(shared_from_this(), m_texture_loader_threads);
     }
 
-    Context::~Context() {}
+    Context::~Context() {
+        // the compiler's workers build into our pipeline cache, so they have to be stopped before it's saved and destroyed.
+        if (m_pipeline_compiler)
+            m_pipeline_compiler->shutdown();
+        if (m_texture_loader)
+            m_texture_loader->shutdown();
+
+        save_pipeline_cache();
+        m_device.destroy(m_pipeline_cache);
+    }
+
+    void Context::load_pipeline_cache() {
+        std::vector<char> data;
+
+        if (!m_pipeline_cache_path.empty() && std::filesystem::exists(m_pipeline_cache_path)) {
+            std::ifstream f(m_pipeline_cache_path, std::ios::in | std::ios::binary);
+
+            std::error_code ec;
+            const uintmax_t file_size = std::filesystem::file_size(m_pipeline_cache_path, ec);
+
+            PipelineCacheFileHeader header{};
+            f.read(reinterpret_cast<char *>(&header), sizeof(PipelineCacheFileHeader));
+
+            const PipelineCacheFileHeader expected = make_pipeline_cache_header(m_physical_device.getProperties());
+
+            if (!f.good() || header.magic != expected.magic || header.version != expected.version) {
+                std::cerr << "Warning: Ignoring invalid pipeline cache file " << m_pipeline_cache_path << std::endl;
+            } else if (header.vendor_id != expected.vendor_id || header.device_id != expected.device_id || header.driver_version != expected.driver_version ||
+                       std::memcmp(header.pipeline_cache_uuid, expected.pipeline_cache_uuid, VK_UUID_SIZE) != 0) {
+                // Not an error, this just happens whenever the driver gets updated or the game runs on a different gpu.
+                std::cout << "Pipeline cache was created by a different device or driver, starting with an empty cache." << std::endl;
+            } else if (ec || file_size - sizeof(PipelineCacheFileHeader) != header.data_size) {
+                // checked before allocating anything, a corrupted size could otherwise ask for any amount of memory.
+                std::cerr << "Warning: Pipeline cache file " << m_pipeline_cache_path << " is corrupted, starting with an empty cache." << std::endl;
+            } else {
+                data.resize(header.data_size);
+                f.read(data.data(), static_cast<std::streamsize>(data.size()));
+
+                if (!f.good() || hash_bytes(data.data(), data.size()) != header.data_hash) {
+                    std::cerr << "Warning: Pipeline cache file " << m_pipeline_cache_path << " is corrupted, starting with an empty cache." << std::endl;
+                    data.clear();
+                }
+            }
+        }
+
+        vk::PipelineCacheCreateInfo ci{};
+        ci.initialDataSize = data.size();
+        ci.pInitialData    = data.data();
+
+        m_pipeline_cache = m_device.createPipelineCache(ci);
+    }
+
+    void Context::save_pipeline_cache() {
+        if (m_pipeline_cache_path.empty() || !m_pipeline_cache)
+            return;
+
+        // reading the cache is internally synchronized, so this is fine while the pipeline compiler's workers are using it.
+        const std::vector<uint8_t> data = m_device.getPipelineCacheData(m_pipeline_cache);
+
+        PipelineCacheFileHeader header = make_pipeline_cache_header(m_physical_device.getProperties());
+        header.data_size               = data.size();
+        header.data_hash               = hash_bytes(data.data(), data.size());
+
+        // write to a temporary file first so that a crash mid-write can't leave a truncated cache behind.
+        std::filesystem::path tmp_path = m_pipeline_cache_path;
+        tmp_path += ".tmp";
+
+        {
+            std::ofstream f(tmp_path, std::ios::out | std::ios::binary | std::ios::trunc);
+            f.write(reinterpret_cast<const char *>(&header), sizeof(PipelineCacheFileHeader));
+            f.write(reinterpret_cast<const char *>(data.data()), static_cast<std::streamsize>(data.size()));
+
+            if (!f.good()) {
+                std::cerr << "Warning: Failed to write pipeline cache to " << tmp_path << std::endl;
+                return;
+            }
+        }
+
+        std::error_code ec;
+        std::filesystem::rename(tmp_path, m_pipeline_cache_path, ec);
+        if (ec) {
+            std::cerr << "Warning: Failed to write pipeline cache to " << m_pipeline_cache_path << ": " << ec.message() << std::endl;
+        }
+    }
 
     void Context::create_swapchain() {
         vkb::SwapchainBuilder swb{m_dev};
@@ -163,11 +365,14 @@ namespace kat {
         }
 
 
-        if (m_swc.swapchain != VK_NULL_HANDLE)
-            vkb::destroy_swapchain(m_swc);
+        // the old swapchain (if any) is not destroyed here, see recreate_swapchain().
+        m_swc              = swc_ret.value();
+        m_swapchain        = m_swc.swapchain;
+        m_swapchain_extent = m_swc.extent;
+        m_swapchain_format = static_cast<vk::Format>(m_swc.image_format);
 
-        m_swc       = swc_ret.value();
-        m_swapchain = m_swc.swapchain;
+        m_swc_images.clear();
+        m_swc_image_views.clear();
 
         auto swci = m_swc.get_images().value();
         m_swc_images.reserve(swci.size());
@@ -182,32 +387,219 @@ namespace kat {
         }
     }
 
-    FrameInfo Context::acquire_next_frame() {
-        auto fence = m_in_flight_fences[m_current_frame];
+    void Context::create_offscreen_images() {
+        m_offscreen_images.clear();
+        m_swc_images.clear();
+        m_swc_image_views.clear();
+
+        // one image per frame in flight, so a frame never renders to an image which an earlier frame might still be using.
+        for (uint32_t i = 0; i < m_frames_in_flight; i++) {
+            auto image = m_gpu_allocator->create_image(
+                vk::ImageCreateInfo({}, vk::ImageType::e2D, m_swapchain_format, vk::Extent3D(m_swapchain_extent, 1), 1, 1, vk::SampleCountFlagBits::e1,
+                                    vk::ImageTiling::eOptimal,
+                                    vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst,
+                                    vk::SharingMode::eExclusive, {}, vk::ImageLayout::eUndefined),
+                VMA_MEMORY_USAGE_GPU_ONLY);
+
+            m_swc_images.push_back(image->handle());
+            m_swc_image_views.push_back(m_device.createImageView(vk::ImageViewCreateInfo({}, image->handle(), vk::ImageViewType::e2D, m_swapchain_format,
+                                                                                         STANDARD_COMPONENT_MAPPING, SIMPLE_SUBRESOURCE_RANGE)));
+            m_offscreen_images.push_back(std::move(image));
+        }
+    }
+
+    void Context::recreate_swapchain() {
+        vkb::Swapchain             old_swc         = m_swc;
+        std::vector<vk::ImageView> old_image_views = m_swc_image_views;
+
+        create_swapchain();
+        m_swapchain_dirty = false;
+
+        // frames which are still in flight may be rendering to (or presenting) the old images.
+        defer([device = m_device, old_swc, old_image_views]() {
+            for (const auto &iv : old_image_views) {
+                device.destroy(iv);
+            }
+            vkb::destroy_swapchain(old_swc);
+        });
+
+        m_swapchain_recreated_callbacks();
+    }
+
+    Context::swapchain_recreated_handle Context::on_swapchain_recreated(const std::function<swapchain_recreated_signature> &f) {
+        return m_swapchain_recreated_callbacks.append(f);
+    }
+
+    void Context::remove_swapchain_recreated_callback(const swapchain_recreated_handle &handle) {
+        m_swapchain_recreated_callbacks.remove(handle);
+    }
+
+    void Context::defer(std::function<void()> f) {
+        m_deletion_queue->push(m_frame_number.load(std::memory_order_acquire), std::move(f));
+    }
+
+    void Context::defer_destroy(DeletionQueue::Resource resource) {
+        m_deletion_queue->push(m_frame_number.load(std::memory_order_acquire), std::move(resource));
+    }
+
+    void Context::collect_deferred() {
+        m_deletion_queue->collect(completed_frame());
+    }
+
+    void Context::flush_deferred() {
+        m_deletion_queue->flush();
+    }
+
+    std::optional<FrameInfo> Context::acquire_next_frame() {
+        KAT_PROFILE_FUNCTION();
+
+        // a zero sized surface (minimized window) can't have a swapchain, so there is nothing to do until it's restored.
+        if (!m_headless) {
+            if (const auto caps = m_physical_device.getSurfaceCapabilitiesKHR(m_surface); caps.currentExtent.width == 0 || caps.currentExtent.height == 0) {
+                return std::nullopt;
+            }
+        }
+
+        // only written here, on the render thread, but read by defer() from any thread.
+        const uint64_t frame = m_frame_number.load(std::memory_order_relaxed) + 1;
+        m_frame_number.store(frame, std::memory_order_release);
+        m_current_frame = static_cast<uint32_t>(frame % m_frames_in_flight);
+
+        // the last frame to use this slot was frame_number - frames_in_flight, once that has retired its resources are free to reuse.
+        if (frame > m_frames_in_flight) {
+            KAT_PROFILE_ZONE("wait_for_frame");
+            // ReSharper disable once CppExpressionWithoutSideEffects
+            wait_for_frame(frame - m_frames_in_flight);
+        }
+
+        collect_deferred();
+        m_upload_queue->collect();
+        m_texture_loader->update();
+        if (m_shader_watcher)
+            m_shader_watcher->update();
+        m_gpu_allocator->begin_frame(frame);
+
+        if (m_gpu_allocator->is_defragmenting()) {
+            // moved resources get new handles, and the descriptors pointing at them are rewritten, so nothing may be using them while a pass runs.
+            wait_for_frame(frame - 1);
+            m_upload_queue->wait_idle();
+            m_gpu_allocator->defragmentation_step();
+        }
+        m_frame_allocator->begin_frame(m_current_frame);
+        m_gpu_profiler->begin_frame(m_current_frame);
+
+        if (m_headless) {
+            m_current_image_index = m_current_frame;
+
+            return FrameInfo{
+                nullptr, nullptr, m_swc_images.at(m_current_image_index), m_swc_image_views.at(m_current_image_index), m_frame_timeline, frame, m_current_image_index,
+                m_current_frame,
+            };
+        }
 
-        // ReSharper disable once CppExpressionWithoutSideEffects
-        wait_for_fences({fence});
+        while (true) {
+            if (m_swapchain_dirty)
+                recreate_swapchain();
 
-        const auto next_image_index_res = m_device.acquireNextImageKHR(m_swapchain, UINT64_MAX, m_image_available_semaphores[m_current_frame]);
+            try {
+                KAT_PROFILE_ZONE("acquireNextImageKHR");
+                const auto next_image_index_res = m_device.acquireNextImageKHR(m_swapchain, UINT64_MAX, m_image_available_semaphores[m_current_frame]);
 
-        m_current_image_index = next_image_index_res.value;
+                // a suboptimal swapchain can still be rendered to (and the semaphore has been signaled), so use it for this frame and replace it afterwards.
+                if (next_image_index_res.result == vk::Result::eSuboptimalKHR)
+                    m_swapchain_dirty = true;
 
-        reset_fences({fence});
+                m_current_image_index = next_image_index_res.value;
+                break;
+            } catch (const vk::OutOfDateKHRError &) {
+                // the semaphore isn't signaled when acquisition fails, so it can be reused for the next attempt.
+                m_swapchain_dirty = true;
+            }
+        }
 
-        return {
+        return FrameInfo{
             m_image_available_semaphores[m_current_frame],
             m_render_finished_semaphores[m_current_frame],
             m_swc_images.at(m_current_image_index),
             m_swc_image_views.at(m_current_image_index),
-            fence,
+            m_frame_timeline,
+            frame,
             m_current_image_index,
+            m_current_frame,
         };
     }
 
+    void Context::submit_frame(const FrameInfo &frame_info, const std::vector<vk::CommandBuffer> &command_buffers, vk::PipelineStageFlags wait_stage) const {
+        KAT_PROFILE_FUNCTION();
+
+        m_frame_allocator->flush();
+
+        if (!frame_info.image_available_semaphore) {
+            // headless frames don't wait on an acquire or signal a present, only the timeline.
+            vk::TimelineSemaphoreSubmitInfo tsi{};
+            tsi.setSignalSemaphoreValues(frame_info.frame_number);
+
+            vk::SubmitInfo si{};
+            si.setCommandBuffers(command_buffers);
+            si.setSignalSemaphores(frame_info.frame_timeline_semaphore);
+            si.pNext = &tsi;
+
+            submit(QueueType::GRAPHICS, si);
+            return;
+        }
+
+        // the value for the binary semaphore is ignored, but the arrays have to line up with the semaphore arrays.
+        const std::array<uint64_t, 1> wait_values   = {0};
+        const std::array<uint64_t, 2> signal_values = {0, frame_info.frame_number};
+
+        const std::array<vk::Semaphore, 2> signal_semaphores = {frame_info.render_finished_semaphore, frame_info.frame_timeline_semaphore};
+
+        vk::TimelineSemaphoreSubmitInfo tsi{};
+        tsi.setWaitSemaphoreValues(wait_values);
+        tsi.setSignalSemaphoreValues(signal_values);
+
+        vk::SubmitInfo si{};
+        si.setCommandBuffers(command_buffers);
+        si.setWaitSemaphores(frame_info.image_available_semaphore);
+        si.setWaitDstStageMask(wait_stage);
+        si.setSignalSemaphores(signal_semaphores);
+        si.pNext = &tsi;
+
+        submit(QueueType::GRAPHICS, si);
+    }
+
+    uint64_t Context::completed_frame() const {
+        return m_device.getSemaphoreCounterValue(m_frame_timeline);
+    }
+
+    bool Context::wait_for_frame(uint64_t frame_number, uint64_t timeout) const {
+        return wait_for_semaphore(m_frame_timeline, frame_number, timeout);
+    }
+
     vk::Semaphore Context::create_semaphore() const {
         return m_device.createSemaphore(vk::SemaphoreCreateInfo());
     }
 
+    vk::Semaphore Context::create_timeline_semaphore(uint64_t initial_value) const {
+        vk::SemaphoreTypeCreateInfo stci(vk::SemaphoreType::eTimeline, initial_value);
+        return m_device.createSemaphore(vk::SemaphoreCreateInfo({}, &stci));
+    }
+
+    std::vector<vk::Semaphore> Context::create_semaphores(uint32_t count) const {
+        std::vector<vk::Semaphore> semaphores;
+        semaphores.reserve(count);
+        for (uint32_t i = 0; i < count; i++)
+            semaphores.push_back(create_semaphore());
+        return semaphores;
+    }
+
+    bool Context::wait_for_semaphore(vk::Semaphore semaphore, uint64_t value, uint64_t timeout) const {
+        if (value == 0)
+            return true;
+
+        return m_device.waitSemaphores(vk::SemaphoreWaitInfo({}, semaphore, value), timeout) == vk::Result::eSuccess;
+    }
+
     vk::Fence Context::create_fence(bool signaled) const {
         if (signaled)
             return create_fence_signaled();
@@ -260,22 +652,43 @@ namespace kat {
         throw std::runtime_error("Bad value for kat::QueueType");
     }
 
+    void Context::submit(const QueueType &queue_type, const vk::SubmitInfo &submit_info, vk::Fence fence) const {
+        const vk::Queue queue = get_queue(queue_type);
+
+        std::lock_guard lock(queue_mutex(queue));
+        queue.submit(submit_info, fence);
+    }
+
+    std::mutex &Context::queue_mutex(vk::Queue queue) const {
+        return *m_queue_mutexes.at(static_cast<VkQueue>(queue));
+    }
+
     vk::CommandPool Context::create_command_pool_raw(uint32_t family, bool allow_individual_reset) const {
         return m_device.createCommandPool(vk::CommandPoolCreateInfo(
             allow_individual_reset ? vk::CommandPoolCreateFlags(vk::CommandPoolCreateFlagBits::eResetCommandBuffer) : vk::CommandPoolCreateFlags(0), family));
     }
 
     void Context::present() {
+        KAT_PROFILE_FUNCTION();
+
+        if (m_headless)
+            return;
+
         vk::PresentInfoKHR pi{};
         pi.setSwapchains(m_swapchain);
         pi.setImageIndices(m_current_image_index);
         pi.setWaitSemaphores(m_render_finished_semaphores[m_current_frame]);
 
-        if (const auto res = m_present_queue.presentKHR(pi); res != vk::Result::eSuccess) {
-            std::cerr << "Warning: Present returned result " << vk::to_string(res) << std::endl;
+        try {
+            std::lock_guard lock(queue_mutex(m_present_queue));
+            if (const auto res = m_present_queue.presentKHR(pi); res == vk::Result::eSuboptimalKHR) {
+                m_swapchain_dirty = true;
+            } else if (res != vk::Result::eSuccess) {
+                std::cerr << "Warning: Present returned result " << vk::to_string(res) << std::endl;
+            }
+        } catch (const vk::OutOfDateKHRError &) {
+            m_swapchain_dirty = true;
         }
-
-        m_current_frame = (m_current_frame + 1) % MAX_FRAMES_IN_FLIGHT;
     }
 
     vk::CommandBuffer Context::begin_single_time_commands() const {
@@ -293,7 +706,7 @@ namespace kat {
         vk::SubmitInfo si{};
         si.setCommandBuffers(cmd);
 
-        m_graphics_queue.submit(si, fence);
+        submit(QueueType::GRAPHICS, si, fence);
 
         wait_for_fences({fence}); // better than a queue wait idle since this actually lets other things happen (later we can offload the cleanup to a different thread).
 
@@ -307,20 +720,60 @@ namespace kat {
         end_single_time_commands(cmd);
     }
 
-    Buffer::Buffer(const std::shared_ptr<Context> &context, vk::Buffer buffer, VmaAllocation allocation, VmaAllocationInfo allocation_info)
-        : m_buffer(buffer), m_allocation(allocation), m_allocation_info(allocation_info), m_context(context) {}
+    const char *to_string(MemoryCategory category) {
+        switch (category) {
+        case MemoryCategory::BUFFER:
+            return "buffer";
+        case MemoryCategory::IMAGE:
+            return "image";
+        case MemoryCategory::STAGING:
+            return "staging";
+        case MemoryCategory::UNIFORM:
+            return "uniform";
+        }
+
+        return "unknown";
+    }
+
+    Buffer::Buffer(const std::shared_ptr<Context> &context, vk::Buffer buffer, VmaAllocation allocation, VmaAllocationInfo allocation_info, MemoryCategory category,
+                   std::optional<vk::BufferCreateInfo> create_info)
+        : m_buffer(buffer), m_allocation(allocation), m_allocation_info(allocation_info), m_category(category), m_create_info(create_info), m_context(context) {
+        m_context->gpu_allocator()->track_allocation(m_category, m_allocation_info.size);
+        if (m_create_info)
+            m_context->gpu_allocator()->track_movable(m_allocation, this);
+    }
 
     Buffer::~Buffer() {
-        m_context->gpu_allocator()->free_buffer(m_buffer, m_allocation);
+        // counted as freed once released, even though the memory is only returned once the gpu is done with it.
+        m_context->gpu_allocator()->track_free(m_category, m_allocation_info.size);
+        if (m_create_info)
+            m_context->gpu_allocator()->untrack_movable(m_allocation);
+        m_context->defer_destroy(AllocatedBuffer{m_buffer, m_allocation});
     }
 
     void Buffer::map_and_write(const void *data, const vk::DeviceSize &size, const vk::DeviceSize &offset) const {
+        // persistently mapped buffers skip the map/unmap round trip.
+        if (is_mapped()) {
+            std::memcpy(static_cast<char *>(mapped_ptr()) + offset, data, size);
+            flush(offset, size);
+            return;
+        }
+
         void *map = m_context->gpu_allocator()->map(m_allocation);
         // static cast allows for easy byte offsets.
         std::memcpy(static_cast<char *>(map) + offset, data, size);
+        flush(offset, size);
         m_context->gpu_allocator()->unmap(m_allocation);
     }
 
+    void Buffer::flush(const vk::DeviceSize &offset, const vk::DeviceSize &size) const {
+        m_context->gpu_allocator()->flush(m_allocation, offset, size);
+    }
+
+    void Buffer::invalidate(const vk::DeviceSize &offset, const vk::DeviceSize &size) const {
+        m_context->gpu_allocator()->invalidate(m_allocation, offset, size);
+    }
+
     void Buffer::copy_from(const std::shared_ptr<Buffer> &other, const vk::DeviceSize &size, const vk::DeviceSize &src_offset, const vk::DeviceSize &dst_offset) const {
         const auto     cmd = m_context->begin_single_time_commands();
         vk::BufferCopy region{};
@@ -332,11 +785,42 @@ namespace kat {
         m_context->end_single_time_commands(cmd);
     }
 
-    Image::Image(const std::shared_ptr<Context> &context, vk::Image image, VmaAllocation allocation, VmaAllocationInfo allocation_info)
-        : m_image(image), m_allocation(allocation), m_allocation_info(allocation_info), m_context(context) {}
+    Image::Image(const std::shared_ptr<Context> &context, vk::Image image, VmaAllocation allocation, VmaAllocationInfo allocation_info, MemoryCategory category,
+                 std::optional<vk::ImageCreateInfo> create_info)
+        : m_image(image), m_allocation(allocation), m_allocation_info(allocation_info), m_category(category), m_create_info(create_info), m_context(context) {
+        m_context->gpu_allocator()->track_allocation(m_category, m_allocation_info.size);
+        if (m_create_info)
+            m_context->gpu_allocator()->track_movable(m_allocation, this);
+    }
 
     Image::~Image() {
-        m_context->gpu_allocator()->free_image(m_image, m_allocation);
+        m_context->gpu_allocator()->track_free(m_category, m_allocation_info.size);
+        if (m_create_info)
+            m_context->gpu_allocator()->untrack_movable(m_allocation);
+        m_context->defer_destroy(AllocatedImage{m_image, m_allocation});
+    }
+
+    void Image::set_resting_layout(vk::ImageLayout layout) {
+        std::lock_guard lock(m_context->gpu_allocator()->m_movable_mutex);
+        m_resting_layout = layout;
+    }
+
+    std::optional<vk::ImageLayout> Image::resting_layout() const {
+        std::lock_guard lock(m_context->gpu_allocator()->m_movable_mutex);
+        return m_resting_layout;
+    }
+
+    bool Image::is_movable() const {
+        std::lock_guard lock(m_context->gpu_allocator()->m_movable_mutex);
+        return m_create_info.has_value() && m_resting_layout.has_value();
+    }
+
+    Image::relocated_handle Image::on_relocated(const std::function<relocated_signature> &f) {
+        return m_relocated_callbacks.append(f);
+    }
+
+    void Image::remove_relocated_callback(const relocated_handle &handle) {
+        m_relocated_callbacks.remove(handle);
     }
 
     GpuAllocator::GpuAllocator(const std::shared_ptr<Context> &context) : m_context(context) {
@@ -346,21 +830,106 @@ namespace kat {
         ci.physicalDevice   = context->physical_device();
         ci.vulkanApiVersion = VK_API_VERSION_1_3;
 
+        if (context->has_memory_budget())
+            ci.flags |= VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT;
+
         if (const auto res = static_cast<vk::Result>(vmaCreateAllocator(&ci, &m_allocator)); res != vk::Result::eSuccess) {
             std::cerr << "Error: Failed to create gpu allocator. Result: " << vk::to_string(res) << std::endl;
             throw fatal_exc{};
         }
+
+        // upload batches allocate and release their staging chunks constantly, keeping them in their own blocks stops them from fragmenting the default pools.
+        create_pool(std::string(STAGING_POOL), PoolDescription{
+                                                   .example    = vk::BufferCreateInfo({}, 1, vk::BufferUsageFlagBits::eTransferSrc, vk::SharingMode::eExclusive),
+                                                   .allocation = HOST_WRITE_MAPPED.with_category(MemoryCategory::STAGING),
+                                                   .block_size = 32 * 1024 * 1024,
+                                               });
     }
 
     GpuAllocator::~GpuAllocator() {
+        for (const auto &[_, pool] : m_pools) {
+            vmaDestroyPool(m_allocator, pool.handle);
+        }
+
         vmaDestroyAllocator(m_allocator);
     }
 
-    std::shared_ptr<Buffer> GpuAllocator::create_buffer(const vk::BufferCreateInfo &create_info, const VmaMemoryUsage &vma_memory_usage) const {
-        const VkBufferCreateInfo ci = create_info;
+    void GpuAllocator::create_pool(const std::string &name, const PoolDescription &description) {
+        VmaAllocationCreateInfo ai{};
+        ai.usage = description.allocation.usage;
+        ai.flags = description.allocation.flags;
+
+        uint32_t memory_type_index;
+        VkResult find_res;
+        if (const auto *buffer_info = std::get_if<vk::BufferCreateInfo>(&description.example)) {
+            const VkBufferCreateInfo ci = *buffer_info;
+            find_res                    = vmaFindMemoryTypeIndexForBufferInfo(m_allocator, &ci, &ai, &memory_type_index);
+        } else {
+            const VkImageCreateInfo ci = std::get<vk::ImageCreateInfo>(description.example);
+            find_res                   = vmaFindMemoryTypeIndexForImageInfo(m_allocator, &ci, &ai, &memory_type_index);
+        }
+
+        if (const auto res = static_cast<vk::Result>(find_res); res != vk::Result::eSuccess) {
+            std::cerr << "Error: No memory type for pool '" << name << "'. Result: " << vk::to_string(res) << std::endl;
+            throw fatal_exc{};
+        }
+
+        VmaPoolCreateInfo pci{};
+        pci.memoryTypeIndex = memory_type_index;
+        pci.blockSize       = description.block_size;
+        pci.minBlockCount   = description.min_block_count;
+        pci.maxBlockCount   = description.max_block_count;
+        if (description.algorithm == PoolAlgorithm::LINEAR)
+            pci.flags |= VMA_POOL_CREATE_LINEAR_ALGORITHM_BIT;
+
+        VmaPool pool;
+        if (const auto res = static_cast<vk::Result>(vmaCreatePool(m_allocator, &pci, &pool)); res != vk::Result::eSuccess) {
+            std::cerr << "Error: Failed to create pool '" << name << "'. Result: " << vk::to_string(res) << std::endl;
+            throw fatal_exc{};
+        }
+
+        // shows up in vma's json stats.
+        vmaSetPoolName(m_allocator, pool, name.c_str());
+
+        AllocationDescription allocation = description.allocation;
+        allocation.pool                  = pool;
+
+        std::lock_guard lock(m_pools_mutex);
+        if (!m_pools.try_emplace(name, Pool{pool, allocation, description.algorithm}).second) {
+            std::cerr << "Error: A pool named '" << name << "' already exists." << std::endl;
+            vmaDestroyPool(m_allocator, pool);
+            throw fatal_exc{};
+        }
+    }
+
+    AllocationDescription GpuAllocator::pool(std::string_view name) const {
+        std::lock_guard lock(m_pools_mutex);
+
+        const auto it = m_pools.find(std::string(name));
+        if (it == m_pools.end()) {
+            std::cerr << "Error: Unknown pool '" << name << "'." << std::endl;
+            throw fatal_exc{};
+        }
+
+        return it->second.allocation;
+    }
+
+    std::shared_ptr<Buffer> GpuAllocator::create_buffer(const vk::BufferCreateInfo &create_info, const AllocationDescription &allocation_description) const {
+        // defragmentation recreates buffers from their create info and copies the contents over, so buffers it can move get transfer usage. Mapped buffers stay
+        // put, their pointers are held onto all over the place.
+        const bool movable = !(allocation_description.flags & VMA_ALLOCATION_CREATE_MAPPED_BIT) && !create_info.pNext &&
+                             create_info.sharingMode == vk::SharingMode::eExclusive;
+
+        vk::BufferCreateInfo info = create_info;
+        if (movable)
+            info.usage |= vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst;
+
+        const VkBufferCreateInfo ci = info;
 
         VmaAllocationCreateInfo ai{};
-        ai.usage = vma_memory_usage;
+        ai.usage = allocation_description.usage;
+        ai.flags = allocation_description.flags;
+        ai.pool  = allocation_description.pool;
 
         VkBuffer          buf;
         VmaAllocation     alloc;
@@ -370,14 +939,26 @@ namespace kat {
             throw fatal_exc{};
         }
 
-        return std::make_shared<Buffer>(m_context, buf, alloc, alloci);
+        return std::make_shared<Buffer>(m_context, buf, alloc, alloci, allocation_description.category.value_or(MemoryCategory::BUFFER),
+                                        movable ? std::optional(info) : std::nullopt);
     }
 
-    std::shared_ptr<Image> GpuAllocator::create_image(const vk::ImageCreateInfo &create_info, const VmaMemoryUsage &vma_memory_usage) const {
-        const VkImageCreateInfo ci = create_info;
+    std::shared_ptr<Image> GpuAllocator::create_image(const vk::ImageCreateInfo &create_info, const AllocationDescription &allocation_description) const {
+        // only sampled images are moved by defragmentation, render targets are recreated with the swapchain anyway and transient attachments can't be copied.
+        const bool movable = !(allocation_description.flags & VMA_ALLOCATION_CREATE_MAPPED_BIT) && !create_info.pNext &&
+                             create_info.sharingMode == vk::SharingMode::eExclusive && create_info.tiling == vk::ImageTiling::eOptimal &&
+                             (create_info.usage & vk::ImageUsageFlagBits::eSampled) && !(create_info.usage & vk::ImageUsageFlagBits::eTransientAttachment);
+
+        vk::ImageCreateInfo info = create_info;
+        if (movable)
+            info.usage |= vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst;
+
+        const VkImageCreateInfo ci = info;
 
         VmaAllocationCreateInfo ai{};
-        ai.usage = vma_memory_usage;
+        ai.usage = allocation_description.usage;
+        ai.flags = allocation_description.flags;
+        ai.pool  = allocation_description.pool;
 
         VkImage           img;
         VmaAllocation     alloc;
@@ -387,7 +968,354 @@ namespace kat {
             throw fatal_exc{};
         }
 
-        return std::make_shared<Image>(m_context, img, alloc, alloci);
+        return std::make_shared<Image>(m_context, img, alloc, alloci, allocation_description.category.value_or(MemoryCategory::IMAGE),
+                                       movable ? std::optional(info) : std::nullopt);
+    }
+
+    void GpuAllocator::begin_frame(uint64_t frame_number) {
+        // vma uses the frame index to decide when to refresh its cached budgets.
+        vmaSetCurrentFrameIndex(m_allocator, static_cast<uint32_t>(frame_number));
+
+        const VkPhysicalDeviceMemoryProperties *props;
+        vmaGetMemoryProperties(m_allocator, &props);
+
+        std::vector<VmaBudget> budgets(props->memoryHeapCount);
+        vmaGetHeapBudgets(m_allocator, budgets.data());
+
+        std::lock_guard lock(m_heap_mutex);
+        m_heap_peaks.resize(budgets.size(), 0);
+        m_heap_warned.resize(budgets.size(), false);
+
+        for (size_t i = 0; i < budgets.size(); i++) {
+            const auto &budget = budgets[i];
+            m_heap_peaks[i]    = std::max(m_heap_peaks[i], budget.usage);
+
+            // warn once when a heap goes past 90% of its budget, and again if it drops below and comes back.
+            const bool over = budget.budget > 0 && budget.usage * 10 > budget.budget * 9;
+            if (over && !m_heap_warned[i]) {
+                std::cerr << "Warning: Memory heap " << i << " is at " << budget.usage / (1024 * 1024) << " MiB of its " << budget.budget / (1024 * 1024)
+                          << " MiB budget." << std::endl;
+            }
+            m_heap_warned[i] = over;
+        }
+
+        if (frame_number % AUTO_DEFRAGMENTATION_INTERVAL != 0)
+            return;
+
+        std::optional<DefragmentationSettings> auto_settings;
+        {
+            std::lock_guard defrag_lock(m_defrag_mutex);
+            if (m_defrag_context || !m_auto_defrag)
+                return;
+            auto_settings = m_auto_defrag;
+        }
+
+        uint64_t block_bytes = 0, allocation_bytes = 0;
+        for (const auto &budget : budgets) {
+            block_bytes += budget.statistics.blockBytes;
+            allocation_bytes += budget.statistics.allocationBytes;
+        }
+
+        // only worth it when a good chunk of the allocated blocks is sitting empty.
+        const uint64_t wasted = block_bytes - allocation_bytes;
+        if (wasted >= AUTO_DEFRAGMENTATION_MIN_WASTE && wasted * 4 >= block_bytes)
+            begin_defragmentation(*auto_settings);
+    }
+
+    void GpuAllocator::begin_defragmentation(const DefragmentationSettings &settings) {
+        std::lock_guard lock(m_defrag_mutex);
+        if (m_defrag_context)
+            return;
+
+        VmaDefragmentationInfo info{};
+        info.flags                 = settings.full ? VMA_DEFRAGMENTATION_FLAG_ALGORITHM_FULL_BIT : VMA_DEFRAGMENTATION_FLAG_ALGORITHM_BALANCED_BIT;
+        info.pool                  = settings.pool;
+        info.maxBytesPerPass       = settings.max_bytes_per_pass;
+        info.maxAllocationsPerPass = settings.max_allocations_per_pass;
+
+        if (const auto res = static_cast<vk::Result>(vmaBeginDefragmentation(m_allocator, &info, &m_defrag_context)); res != vk::Result::eSuccess) {
+            std::cerr << "Warning: Failed to start defragmentation. Result: " << vk::to_string(res) << std::endl;
+            m_defrag_context = VK_NULL_HANDLE;
+        }
+    }
+
+    void GpuAllocator::cancel_defragmentation() {
+        std::lock_guard lock(m_defrag_mutex);
+        end_defragmentation();
+    }
+
+    bool GpuAllocator::is_defragmenting() const {
+        std::lock_guard lock(m_defrag_mutex);
+        return m_defrag_context != VK_NULL_HANDLE;
+    }
+
+    void GpuAllocator::set_auto_defragmentation(std::optional<DefragmentationSettings> settings) {
+        std::lock_guard lock(m_defrag_mutex);
+        m_auto_defrag = settings;
+    }
+
+    void GpuAllocator::defragmentation_step() {
+        KAT_PROFILE_FUNCTION();
+
+        std::lock_guard lock(m_defrag_mutex);
+        if (!m_defrag_context)
+            return;
+
+        VmaDefragmentationPassMoveInfo pass{};
+        if (const auto res = vmaBeginDefragmentationPass(m_allocator, m_defrag_context, &pass); res != VK_INCOMPLETE) {
+            // VK_SUCCESS means there is nothing left to move.
+            if (res != VK_SUCCESS)
+                std::cerr << "Warning: Defragmentation pass failed. Result: " << vk::to_string(static_cast<vk::Result>(res)) << std::endl;
+            end_defragmentation();
+            return;
+        }
+
+        struct BufferMove {
+            Buffer    *buffer;
+            vk::Buffer new_buffer;
+        };
+
+        struct ImageMove {
+            Image    *image;
+            vk::Image new_image;
+        };
+
+        std::vector<BufferMove> buffer_moves;
+        std::vector<ImageMove>  image_moves;
+
+        // held for the whole pass: ~Buffer and ~Image block in untrack_movable() until it's done, so the moved resources can't be freed (on a loader or
+        // compiler thread) while they're being copied and swapped. Resources already gone aren't in m_movable anymore and their moves are skipped.
+        std::unique_lock movable_lock(m_movable_mutex);
+        for (uint32_t i = 0; i < pass.moveCount; i++) {
+            auto &move = pass.pMoves[i];
+
+            const auto it = m_movable.find(move.srcAllocation);
+            if (it == m_movable.end() || (std::holds_alternative<Image *>(it->second) && !std::get<Image *>(it->second)->m_resting_layout)) {
+                move.operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+                continue;
+            }
+
+            // the new resource is bound to the temporary allocation, which becomes the resource's allocation once the pass ends.
+            if (auto *const *buffer = std::get_if<Buffer *>(&it->second)) {
+                const vk::Buffer new_buffer = m_context->device().createBuffer(*(*buffer)->m_create_info);
+                vmaBindBufferMemory(m_allocator, move.dstTmpAllocation, new_buffer);
+                buffer_moves.push_back(BufferMove{*buffer, new_buffer});
+            } else {
+                Image *const    image     = std::get<Image *>(it->second);
+                const vk::Image new_image = m_context->device().createImage(*image->m_create_info);
+                vmaBindImageMemory(m_allocator, move.dstTmpAllocation, new_image);
+                image_moves.push_back(ImageMove{image, new_image});
+            }
+        }
+
+        m_context->single_time_commands([&](const vk::CommandBuffer &cmd) {
+            for (const auto &move : buffer_moves) {
+                cmd.copyBuffer(move.buffer->m_buffer, move.new_buffer, vk::BufferCopy(0, 0, move.buffer->m_create_info->size));
+            }
+
+            if (image_moves.empty())
+                return;
+
+            std::vector<vk::ImageMemoryBarrier> to_transfer;
+            std::vector<vk::ImageMemoryBarrier> to_resting;
+            for (const auto &move : image_moves) {
+                const vk::ImageLayout resting = *move.image->m_resting_layout;
+
+                to_transfer.push_back(vk::ImageMemoryBarrier({}, vk::AccessFlagBits::eTransferRead, resting, vk::ImageLayout::eTransferSrcOptimal, VK_QUEUE_FAMILY_IGNORED,
+                                                             VK_QUEUE_FAMILY_IGNORED, move.image->m_image, FULL_SUBRESOURCE_RANGE));
+                to_transfer.push_back(vk::ImageMemoryBarrier({}, vk::AccessFlagBits::eTransferWrite, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal,
+                                                             VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, move.new_image, FULL_SUBRESOURCE_RANGE));
+                to_resting.push_back(vk::ImageMemoryBarrier(vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eMemoryRead, vk::ImageLayout::eTransferDstOptimal,
+                                                            resting, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, move.new_image, FULL_SUBRESOURCE_RANGE));
+            }
+
+            cmd.pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands, vk::PipelineStageFlagBits::eTransfer, {}, {}, {}, to_transfer);
+
+            for (const auto &move : image_moves) {
+                const auto &ci = *move.image->m_create_info;
+
+                std::vector<vk::ImageCopy> regions;
+                for (uint32_t mip = 0; mip < ci.mipLevels; mip++) {
+                    // only images with a resting layout move, which are uploaded color images.
+                    const vk::ImageSubresourceLayers layers(vk::ImageAspectFlagBits::eColor, mip, 0, ci.arrayLayers);
+                    const vk::Extent3D extent(std::max(1u, ci.extent.width >> mip), std::max(1u, ci.extent.height >> mip), std::max(1u, ci.extent.depth >> mip));
+                    regions.emplace_back(layers, vk::Offset3D{}, layers, vk::Offset3D{}, extent);
+                }
+
+                cmd.copyImage(move.image->m_image, vk::ImageLayout::eTransferSrcOptimal, move.new_image, vk::ImageLayout::eTransferDstOptimal, regions);
+            }
+
+            cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eAllCommands, {}, {}, {}, to_resting);
+        });
+
+        // the copies have finished and nothing else is in flight, so the old handles can go right away.
+        for (const auto &move : buffer_moves) {
+            m_context->device().destroy(move.buffer->m_buffer);
+            move.buffer->m_buffer = move.new_buffer;
+        }
+
+        for (const auto &move : image_moves) {
+            m_context->device().destroy(move.image->m_image);
+            move.image->m_image = move.new_image;
+        }
+
+        const VkResult end_res = vmaEndDefragmentationPass(m_allocator, m_defrag_context, &pass);
+
+        // the allocations now point at their new place.
+        for (const auto &move : buffer_moves) {
+            vmaGetAllocationInfo(m_allocator, move.buffer->m_allocation, &move.buffer->m_allocation_info);
+        }
+
+        for (const auto &move : image_moves) {
+            vmaGetAllocationInfo(m_allocator, move.image->m_allocation, &move.image->m_allocation_info);
+            move.image->m_relocated_callbacks();
+        }
+
+        // the moved resources aren't touched past this point, and the allocator-wide callbacks are free to release resources.
+        movable_lock.unlock();
+
+        if (!buffer_moves.empty() || !image_moves.empty())
+            m_relocated_callbacks();
+
+        if (end_res == VK_SUCCESS)
+            end_defragmentation();
+    }
+
+    GpuAllocator::relocated_handle GpuAllocator::on_relocated(const std::function<relocated_signature> &f) {
+        return m_relocated_callbacks.append(f);
+    }
+
+    void GpuAllocator::remove_relocated_callback(const relocated_handle &handle) {
+        m_relocated_callbacks.remove(handle);
+    }
+
+    std::optional<DefragmentationStats> GpuAllocator::last_defragmentation() const {
+        std::lock_guard lock(m_defrag_mutex);
+        return m_last_defrag;
+    }
+
+    void GpuAllocator::end_defragmentation() {
+        if (!m_defrag_context)
+            return;
+
+        VmaDefragmentationStats stats{};
+        vmaEndDefragmentation(m_allocator, m_defrag_context, &stats);
+        m_defrag_context = VK_NULL_HANDLE;
+
+        // reported through last_defragmentation() rather than printed, this runs in the middle of a frame.
+        m_last_defrag = DefragmentationStats{stats.bytesMoved, stats.bytesFreed, stats.allocationsMoved, stats.deviceMemoryBlocksFreed};
+    }
+
+    void GpuAllocator::track_movable(VmaAllocation allocation, std::variant<Buffer *, Image *> resource) const {
+        std::lock_guard lock(m_movable_mutex);
+        m_movable[allocation] = resource;
+    }
+
+    void GpuAllocator::untrack_movable(VmaAllocation allocation) const {
+        std::lock_guard lock(m_movable_mutex);
+        m_movable.erase(allocation);
+    }
+
+    MemoryStats GpuAllocator::stats() const {
+        MemoryStats stats{};
+
+        for (size_t i = 0; i < MEMORY_CATEGORY_COUNT; i++) {
+            const auto &c       = m_categories[i];
+            stats.categories[i] = MemoryCategoryStats{c.bytes.load(), c.count.load(), c.peak_bytes.load(), c.total_allocations.load()};
+        }
+
+        const VkPhysicalDeviceMemoryProperties *props;
+        vmaGetMemoryProperties(m_allocator, &props);
+
+        std::vector<VmaBudget> budgets(props->memoryHeapCount);
+        vmaGetHeapBudgets(m_allocator, budgets.data());
+
+        {
+            std::lock_guard lock(m_pools_mutex);
+            for (const auto &[name, pool] : m_pools) {
+                VmaStatistics pool_stats;
+                vmaGetPoolStatistics(m_allocator, pool.handle, &pool_stats);
+
+                stats.pools.push_back(MemoryPoolStats{name, pool.algorithm, pool_stats.blockBytes, pool_stats.allocationBytes, pool_stats.blockCount,
+                                                      pool_stats.allocationCount});
+            }
+        }
+
+        std::lock_guard lock(m_heap_mutex);
+        for (uint32_t i = 0; i < props->memoryHeapCount; i++) {
+            const auto &budget = budgets[i];
+
+            stats.heaps.push_back(MemoryHeapStats{
+                .index            = i,
+                .device_local     = (props->memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0,
+                .budget           = budget.budget,
+                .usage            = budget.usage,
+                .peak_usage       = std::max(i < m_heap_peaks.size() ? m_heap_peaks[i] : 0, budget.usage),
+                .block_bytes      = budget.statistics.blockBytes,
+                .allocation_bytes = budget.statistics.allocationBytes,
+                .block_count      = budget.statistics.blockCount,
+                .allocation_count = budget.statistics.allocationCount,
+            });
+        }
+
+        return stats;
+    }
+
+    bool GpuAllocator::write_stats_json(const std::filesystem::path &path) const {
+        std::ofstream out(path);
+        if (!out) {
+            std::cerr << "Warning: Failed to open " << path << " for writing, the memory stats weren't exported." << std::endl;
+            return false;
+        }
+
+        const auto stats = this->stats();
+
+        out << "{\n\"memory_budget_extension\": " << (m_context->has_memory_budget() ? "true" : "false") << ",\n\"heaps\": [";
+        for (size_t i = 0; i < stats.heaps.size(); i++) {
+            const auto &heap = stats.heaps[i];
+            out << (i ? "," : "") << "\n  {\"index\": " << heap.index << ", \"device_local\": " << (heap.device_local ? "true" : "false")
+                << ", \"budget\": " << heap.budget << ", \"usage\": " << heap.usage << ", \"peak_usage\": " << heap.peak_usage
+                << ", \"block_bytes\": " << heap.block_bytes << ", \"allocation_bytes\": " << heap.allocation_bytes << ", \"block_count\": " << heap.block_count
+                << ", \"allocation_count\": " << heap.allocation_count << "}";
+        }
+
+        out << "\n],\n\"categories\": {";
+        for (size_t i = 0; i < MEMORY_CATEGORY_COUNT; i++) {
+            const auto &category = stats.categories[i];
+            out << (i ? "," : "") << "\n  \"" << to_string(static_cast<MemoryCategory>(i)) << "\": {\"bytes\": " << category.bytes << ", \"count\": " << category.count
+                << ", \"peak_bytes\": " << category.peak_bytes << ", \"total_allocations\": " << category.total_allocations << "}";
+        }
+
+        // vma's own statistics are json already, including every block and allocation.
+        char *vma_stats = nullptr;
+        vmaBuildStatsString(m_allocator, &vma_stats, VK_TRUE);
+        out << "\n},\n\"vma\": " << vma_stats << "\n}\n";
+        vmaFreeStatsString(m_allocator, vma_stats);
+
+        if (!out) {
+            std::cerr << "Warning: Failed to write the memory stats to " << path << "." << std::endl;
+            return false;
+        }
+
+        return true;
+    }
+
+    void GpuAllocator::track_allocation(MemoryCategory category, vk::DeviceSize size) const {
+        auto &c = m_categories[static_cast<size_t>(category)];
+
+        const uint64_t bytes = c.bytes.fetch_add(size, std::memory_order_relaxed) + size;
+        c.count.fetch_add(1, std::memory_order_relaxed);
+        c.total_allocations.fetch_add(1, std::memory_order_relaxed);
+
+        uint64_t peak = c.peak_bytes.load(std::memory_order_relaxed);
+        while (bytes > peak && !c.peak_bytes.compare_exchange_weak(peak, bytes, std::memory_order_relaxed)) {}
+    }
+
+    void GpuAllocator::track_free(MemoryCategory category, vk::DeviceSize size) const {
+        auto &c = m_categories[static_cast<size_t>(category)];
+
+        c.bytes.fetch_sub(size, std::memory_order_relaxed);
+        c.count.fetch_sub(1, std::memory_order_relaxed);
     }
 
     void GpuAllocator::free_buffer(const vk::Buffer &buffer, const VmaAllocation &allocation) const {
@@ -400,11 +1328,18 @@ namespace kat {
 
     std::shared_ptr<Buffer> GpuAllocator::init_buffer(const void *data, const vk::DeviceSize &size, const vk::BufferUsageFlags usage,
                                                       const VmaMemoryUsage &vma_memory_usage) const {
-        const auto staging_buffer = create_buffer(size, vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_CPU_TO_GPU);
-        const auto final_buffer   = create_buffer(size, vk::BufferUsageFlagBits::eTransferDst | usage, vma_memory_usage);
+        auto batch        = m_context->upload_queue()->begin_batch();
+        auto final_buffer = init_buffer(batch, data, size, usage, vma_memory_usage);
 
-        staging_buffer->map_and_write(data, size, 0);
-        final_buffer->copy_from(staging_buffer, size, 0, 0);
+        m_context->upload_queue()->wait(m_context->upload_queue()->submit(std::move(batch)));
+
+        return final_buffer;
+    }
+
+    std::shared_ptr<Buffer> GpuAllocator::init_buffer(UploadBatch &batch, const void *data, const vk::DeviceSize &size, const vk::BufferUsageFlags usage,
+                                                      const VmaMemoryUsage &vma_memory_usage) const {
+        auto final_buffer = create_buffer(size, vk::BufferUsageFlagBits::eTransferDst | usage, vma_memory_usage);
+        batch.upload_buffer(final_buffer, data, size);
 
         return final_buffer;
     }
@@ -420,13 +1355,57 @@ namespace kat {
         vmaUnmapMemory(m_allocator, alloc);
     }
 
-    std::tuple<std::shared_ptr<Image>, vk::Format, vk::Extent2D> GpuAllocator::load_image(const std::filesystem::path &path) const {
-        std::string path_ = path.string();
+    void GpuAllocator::flush(const VmaAllocation &alloc, const vk::DeviceSize &offset, const vk::DeviceSize &size) const {
+        vmaFlushAllocation(m_allocator, alloc, offset, size);
+    }
+
+    void GpuAllocator::invalidate(const VmaAllocation &alloc, const vk::DeviceSize &offset, const vk::DeviceSize &size) const {
+        vmaInvalidateAllocation(m_allocator, alloc, offset, size);
+    }
+
+    std::tuple<std::shared_ptr<Image>, vk::Format, vk::Extent2D> GpuAllocator::load_image(const std::filesystem::path &path, bool generate_mips) const {
+        auto batch  = m_context->upload_queue()->begin_batch();
+        auto result = load_image(batch, path, generate_mips);
+
+        m_context->upload_queue()->wait(m_context->upload_queue()->submit(std::move(batch)));
+
+        return result;
+    }
+
+    std::tuple<std::shared_ptr<Image>, vk::Format, vk::Extent2D> GpuAllocator::load_image(UploadBatch &batch, const std::filesystem::path &path, bool generate_mips) const {
+        const auto asset = m_context->asset_store()->open(path);
+        if (!asset) {
+            std::cerr << "Error: Failed to open " << path << std::endl;
+            throw fatal_exc{};
+        }
+
+        try {
+            return load_image(batch, asset->bytes(), generate_mips);
+        } catch (const fatal_exc &) {
+            std::cerr << "Error: Failed to load " << path << std::endl;
+            throw;
+        }
+    }
+
+    std::tuple<std::shared_ptr<Image>, vk::Format, vk::Extent2D> GpuAllocator::load_image(UploadBatch &batch, std::span<const unsigned char> bytes,
+                                                                                          bool generate_mips) const {
+        if (is_ktx2(bytes)) {
+            // ktx2 files carry their own mip chain (if any), generate_mips doesn't apply to them. The levels are staged straight from bytes.
+            const auto texture = parse_ktx2(bytes);
+            if (!texture)
+                throw fatal_exc{};
+
+            return std::make_tuple(init_image(batch, *texture), texture->format, vk::Extent2D(texture->extent.width, texture->extent.height));
+        }
 
         int width, height;
         int components;
 
-        unsigned char *data = stbi_load(path_.c_str(), &width, &height, &components, 0);
+        unsigned char *data = stbi_load_from_memory(bytes.data(), static_cast<int>(bytes.size()), &width, &height, &components, 0);
+        if (!data) {
+            std::cerr << "Error: Failed to decode image: " << stbi_failure_reason() << std::endl;
+            throw fatal_exc{};
+        }
 
         vk::Format format = vk::Format::eR8G8B8A8Unorm;
 
@@ -445,46 +1424,90 @@ namespace kat {
             break;
         }
 
-        auto image = init_image(width, height, components, format, data, vk::ImageUsageFlagBits::eSampled, vk::ImageLayout::eShaderReadOnlyOptimal, true);
+        // the pixels are copied into staging memory right away, so the stb buffer can be freed before the batch is submitted.
+        auto image = init_image(batch, width, height, components, format, data, vk::ImageUsageFlagBits::eSampled, vk::ImageLayout::eShaderReadOnlyOptimal, true,
+                                generate_mips);
         stbi_image_free(data);
 
         return std::make_tuple(image, format, vk::Extent2D(width, height));
     }
 
     std::shared_ptr<Image> GpuAllocator::init_image(uint32_t width, uint32_t height, uint32_t pixel_size, vk::Format format, unsigned char *data,
-                                                    const vk::ImageUsageFlags &image_usage_flags, vk::ImageLayout il, bool gpu_only) const {
-        auto buffer = init_buffer(data, width * height * pixel_size, vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_CPU_TO_GPU);
+                                                    const vk::ImageUsageFlags &image_usage_flags, vk::ImageLayout il, bool gpu_only, bool generate_mips) const {
+        auto batch = m_context->upload_queue()->begin_batch();
+        auto image = init_image(batch, width, height, pixel_size, format, data, image_usage_flags, il, gpu_only, generate_mips);
 
-        auto image = create_image(vk::ImageCreateInfo({}, vk::ImageType::e2D, format, vk::Extent3D(width, height, 1), 1, 1, vk::SampleCountFlagBits::e1,
-                                                      gpu_only ? vk::ImageTiling::eOptimal : vk::ImageTiling::eLinear, vk::ImageUsageFlagBits::eTransferDst | image_usage_flags,
-                                                      vk::SharingMode::eExclusive, {}, vk::ImageLayout::eUndefined),
+        m_context->upload_queue()->wait(m_context->upload_queue()->submit(std::move(batch)));
+
+        return image;
+    }
+
+    std::shared_ptr<Image> GpuAllocator::init_image(UploadBatch &batch, uint32_t width, uint32_t height, uint32_t pixel_size, vk::Format format,
+                                                    const unsigned char *data, const vk::ImageUsageFlags &image_usage_flags, vk::ImageLayout il, bool gpu_only,
+                                                    bool generate_mips) const {
+        const vk::Extent2D   extent(width, height);
+        const vk::DeviceSize size = static_cast<vk::DeviceSize>(width) * height * pixel_size;
+
+        // linear images can't have more than one level on most implementations.
+        uint32_t mip_levels = generate_mips && gpu_only ? mip_level_count(extent) : 1;
+
+        const bool blit = mip_levels > 1 && supports_linear_blit(m_context->physical_device(), format);
+
+        std::optional<MipChain> chain;
+        if (mip_levels > 1 && !blit) {
+            chain = generate_mip_chain(data, extent, pixel_size, format, mip_levels);
+            if (!chain)
+                mip_levels = 1;
+        }
+
+        vk::ImageUsageFlags usage = vk::ImageUsageFlagBits::eTransferDst | image_usage_flags;
+        if (blit)
+            usage |= vk::ImageUsageFlagBits::eTransferSrc;
+
+        auto image = create_image(vk::ImageCreateInfo({}, vk::ImageType::e2D, format, vk::Extent3D(width, height, 1), mip_levels, 1, vk::SampleCountFlagBits::e1,
+                                                      gpu_only ? vk::ImageTiling::eOptimal : vk::ImageTiling::eLinear, usage, vk::SharingMode::eExclusive, {},
+                                                      vk::ImageLayout::eUndefined),
                                   VMA_MEMORY_USAGE_GPU_ONLY);
 
+        if (blit)
+            batch.upload_image_and_blit_mips(image, data, size, extent, pixel_size, mip_levels, il);
+        else if (chain)
+            batch.upload_image(image, chain->data.data(), chain->data.size(), chain->regions, pixel_size, il);
+        else
+            batch.upload_image(image, data, size, extent, pixel_size, il);
 
-        buffer->map_and_write(data, width * height * pixel_size, 0);
+        return image;
+    }
 
-        vk::BufferImageCopy copy{};
-        copy.bufferOffset                    = 0;
-        copy.bufferRowLength                 = 0;
-        copy.bufferImageHeight               = 0;
-        copy.imageSubresource.aspectMask     = vk::ImageAspectFlagBits::eColor;
-        copy.imageSubresource.mipLevel       = 0;
-        copy.imageSubresource.baseArrayLayer = 0;
-        copy.imageSubresource.layerCount     = 1;
-        copy.imageOffset                     = vk::Offset3D{0, 0, 0};
-        copy.imageExtent                     = vk::Extent3D{width, height, 1};
+    std::shared_ptr<Image> GpuAllocator::init_image(UploadBatch &batch, const Ktx2Texture &texture, const vk::ImageUsageFlags &image_usage_flags, vk::ImageLayout il) const {
+        if (is_block_compressed(texture.format) && !m_context->has_bc_compression()) {
+            std::cerr << "Error: The device doesn't support block compressed textures (" << vk::to_string(texture.format) << ")." << std::endl;
+            throw fatal_exc{};
+        }
 
-        m_context->single_time_commands([&](const vk::CommandBuffer &cmd) {
-            transitionImageLayout(cmd, image, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal, vk::PipelineStageFlagBits::eTransfer,
-                                  vk::PipelineStageFlagBits::eTransfer);
-            cmd.copyBufferToImage(buffer->handle(), image->handle(), vk::ImageLayout::eTransferDstOptimal, copy);
-            transitionImageLayout(cmd, image, vk::ImageLayout::eUndefined, il, vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer);
-        });
+        const vk::ImageCreateFlags flags = texture.faces == 6 ? vk::ImageCreateFlags(vk::ImageCreateFlagBits::eCubeCompatible) : vk::ImageCreateFlags{};
+
+        auto image = create_image(vk::ImageCreateInfo(flags, vk::ImageType::e2D, texture.format, texture.extent, texture.mip_levels, texture.array_layers(),
+                                                      vk::SampleCountFlagBits::e1, vk::ImageTiling::eOptimal, vk::ImageUsageFlagBits::eTransferDst | image_usage_flags,
+                                                      vk::SharingMode::eExclusive, {}, vk::ImageLayout::eUndefined),
+                                  VMA_MEMORY_USAGE_GPU_ONLY);
+
+        batch.upload_image(image, texture.data.data(), texture.data.size(), texture.regions, format_block(texture.format)->bytes, il);
 
         return image;
     }
 
     ImageView::ImageView(const std::shared_ptr<Context> &context, const Description &desc) : m_context(context), m_description(desc) {
+        create();
+
+        m_relocated_handle = m_description.image->on_relocated([this]() {
+            // relocation happens with nothing in flight, but the old view is still released like any other.
+            m_context->defer_destroy(m_image_view);
+            create();
+        });
+    }
+
+    void ImageView::create() {
         vk::ImageViewCreateInfo ivci{};
         ivci.image            = m_description.image->handle();
         ivci.viewType         = m_description.type;
@@ -503,7 +1526,8 @@ namespace kat {
     }
 
     ImageView::~ImageView() {
-        m_context->device().destroy(m_image_view);
+        m_description.image->remove_relocated_callback(m_relocated_handle);
+        m_context->defer_destroy(m_image_view);
     }
 
     Sampler::Sampler(const std::shared_ptr<Context> &context, const Description &desc) : m_context(context) {
@@ -528,7 +1552,7 @@ namespace kat {
     }
 
     Sampler::~Sampler() {
-        m_context->device().destroy(m_sampler);
+        m_context->defer_destroy(m_sampler);
     }
 
     void transitionImageLayout(const vk::CommandBuffer &cmd, const std::shared_ptr<Image> &image, vk::ImageLayout initial_layout, vk::ImageLayout final_layout,
@@ -4,12 +4,23 @@
 #include <memory>
 #include <vulkan/vulkan.hpp>
 
+#include "kat/graphics/deletion_queue.hpp"
 #include "kat/graphics/window.hpp"
 
 #include "kat/util/util.hpp"
 
+#include <array>
+#include <atomic>
+#include <deque>
+#include <eventpp/callbacklist.h>
 #include <filesystem>
 #include <functional>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+#include <variant>
 #include <vk_mem_alloc.h>
 #include <tuple>
 
@@ -21,34 +32,102 @@ namespace kat {
         uint32_t major, minor, patch;
     };
 
+    constexpr uint32_t       DEFAULT_FRAMES_IN_FLIGHT      = 2;
+    constexpr vk::DeviceSize DEFAULT_STAGING_RING_SIZE     = 8 * 1024 * 1024;
+    constexpr vk::DeviceSize DEFAULT_FRAME_ALLOCATOR_SIZE  = 4 * 1024 * 1024;
+    constexpr size_t         DEFAULT_SHADER_CACHE_CAPACITY = 256;
+
     struct ContextSettings {
         std::string app_name    = "App";
         Version     app_version = {0, 1, 0};
+
+        // Run without a window, surface or swapchain. Frames render into a ring of offscreen images instead (see headless_extent and headless_format), which
+        // makes it possible to run on machines without a display or gpu (e.g. with lavapipe).
+        bool         headless        = false;
+        vk::Extent2D headless_extent = {1280, 720};
+        vk::Format   headless_format = vk::Format::eB8G8R8A8Unorm;
+
+        // How many frames the cpu may record ahead of the gpu.
+        uint32_t frames_in_flight = DEFAULT_FRAMES_IN_FLIGHT;
+
+        // Where the pipeline cache is persisted between runs. An empty path keeps the cache in memory only.
+        std::filesystem::path pipeline_cache_path = "pipeline_cache.bin";
+
+        // Number of threads used to compile pipelines in the background. 0 picks a count based on the hardware concurrency.
+        uint32_t pipeline_compiler_threads = 0;
+
+        // Number of threads decoding textures for the TextureLoader. 0 picks a count based on the hardware concurrency.
+        uint32_t texture_loader_threads = 0;
+
+        // How many shader modules the ShaderCache keeps around before it starts evicting the least frequently used ones.
+        size_t shader_cache_capacity = DEFAULT_SHADER_CACHE_CAPACITY;
+
+        // Watch the spirv files of live pipelines and rebuild the pipelines when they change, see ShaderWatcher.
+        bool shader_hot_reload = false;
+
+        // Size of the upload staging ring per frame in flight.
+        vk::DeviceSize staging_ring_size = DEFAULT_STAGING_RING_SIZE;
+
+        // Size of the per-frame linear allocator's segment, per frame in flight.
+        vk::DeviceSize frame_allocator_size = DEFAULT_FRAME_ALLOCATOR_SIZE;
     };
 
     struct FrameInfo {
+        // both are null for headless contexts.
         vk::Semaphore image_available_semaphore;
         vk::Semaphore render_finished_semaphore;
         vk::Image     image;
         vk::ImageView image_view;
-        vk::Fence     in_flight_fence;
+
+        // The frame's submission must signal frame_timeline_semaphore with frame_number (Context::submit_frame() takes care of this).
+        vk::Semaphore frame_timeline_semaphore;
+        uint64_t      frame_number;
 
         // this should be used to get resources created from the image set like framebuffers (which are out of the scope of the context to manage).
         uint32_t image_index;
-    };
 
-    constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 2;
+        // index into per-frame-in-flight resources (command buffers, uniform buffers, ...), in [0, frames_in_flight).
+        uint32_t frame_index;
+    };
 
     class ShaderCache;
 
     class GpuAllocator;
 
+    class PipelineCompiler;
+
+    class PipelineRegistry;
+
+    class UploadQueue;
+
+    class UploadBatch;
+    class FrameAllocator;
+
+    class GpuProfiler;
+
+    class TextureLoader;
+
+    class AssetStore;
+
+    class ShaderWatcher;
+
+    class LayoutCache;
+
+    struct Ktx2Texture;
+
     class Context : public std::enable_shared_from_this<Context> {
         explicit Context(const std::unique_ptr<Window> &window, const ContextSettings &settings = {});
 
         void init();
 
+        void create_offscreen_images();
+
       public:
+        using swapchain_recreated_signature = void();
+        using swapchain_recreated_callbacks = eventpp::CallbackList<swapchain_recreated_signature>;
+        using swapchain_recreated_handle    = swapchain_recreated_callbacks::Handle;
+
+        // window may be null if settings.headless is set.
         static inline std::shared_ptr<Context> init(const std::unique_ptr<Window> &window, const ContextSettings &settings = {}) {
             auto ctx = std::shared_ptr<Context>(new Context(window, settings));
             ctx->init();
@@ -67,8 +146,17 @@ namespace kat {
 
         [[nodiscard]] inline vk::PhysicalDevice physical_device() const { return m_physical_device; };
 
+        // null for headless contexts.
         [[nodiscard]] inline vk::SurfaceKHR surface() const { return m_surface; };
 
+        [[nodiscard]] inline bool is_headless() const noexcept { return m_headless; };
+
+        // Whether VK_EXT_memory_budget is enabled, without it heap budgets are estimates.
+        [[nodiscard]] inline bool has_memory_budget() const noexcept { return m_memory_budget; };
+
+        // Whether textureCompressionBC is enabled, KTX2 textures in BCn formats can't be loaded without it.
+        [[nodiscard]] inline bool has_bc_compression() const noexcept { return m_bc_compression; };
+
         [[nodiscard]] inline vk::Device device() const { return m_device; };
 
         [[nodiscard]] inline vk::Queue graphics_queue() const { return m_graphics_queue; };
@@ -93,31 +181,112 @@ namespace kat {
 
         [[nodiscard]] inline uint32_t current_frame() const noexcept { return m_current_frame; };
 
+        [[nodiscard]] inline uint32_t frames_in_flight() const noexcept { return m_frames_in_flight; };
+
+        [[nodiscard]] inline vk::DeviceSize staging_ring_size() const noexcept { return m_staging_ring_size; };
+
+        // The number of the frame currently being recorded. Frame numbers start at 1 and increase by one every frame, 0 means "no frame".
+        [[nodiscard]] inline uint64_t frame_number() const noexcept { return m_frame_number.load(std::memory_order_acquire); };
+
+        // Timeline semaphore which is signaled with the frame number when the gpu finishes that frame.
+        [[nodiscard]] inline vk::Semaphore frame_timeline_semaphore() const { return m_frame_timeline; };
+
         [[nodiscard]] inline const std::vector<vk::Image> &swapchain_images() const { return m_swc_images; };
 
         [[nodiscard]] inline const std::vector<vk::ImageView> &swapchain_image_views() const { return m_swc_image_views; };
 
-        [[nodiscard]] inline vk::Extent2D swapchain_extent() const { return m_swc.extent; };
+        // For headless contexts, the swapchain images are the offscreen images.
+        [[nodiscard]] inline vk::Extent2D swapchain_extent() const { return m_swapchain_extent; };
 
-        [[nodiscard]] inline vk::Format swapchain_format() const { return static_cast<vk::Format>(m_swc.image_format); };
+        [[nodiscard]] inline vk::Format swapchain_format() const { return m_swapchain_format; };
 
-        [[nodiscard]] inline vk::Rect2D full_render_area() const { return vk::Rect2D{{0, 0}, m_swc.extent}; };
+        // The layout swapchain images have to be left in at the end of a frame. Offscreen images are left ready to be copied out, since there is nothing to present.
+        [[nodiscard]] inline vk::ImageLayout present_layout() const { return m_headless ? vk::ImageLayout::eTransferSrcOptimal : vk::ImageLayout::ePresentSrcKHR; };
+
+        [[nodiscard]] inline vk::Rect2D full_render_area() const { return vk::Rect2D{{0, 0}, m_swapchain_extent}; };
 
         [[nodiscard]] inline const std::unique_ptr<ShaderCache> &shader_cache() const { return m_shader_cache; };
 
-        [[nodiscard]] inline vk::PipelineCache pipeline_cache() const { return VK_NULL_HANDLE; }; // TODO: pipeline caches.
+        [[nodiscard]] inline vk::PipelineCache pipeline_cache() const { return m_pipeline_cache; };
+
+        [[nodiscard]] inline const std::unique_ptr<PipelineCompiler> &pipeline_compiler() const { return m_pipeline_compiler; };
+
+        [[nodiscard]] inline const std::unique_ptr<PipelineRegistry> &pipeline_registry() const { return m_pipeline_registry; };
+
+        [[nodiscard]] inline const std::unique_ptr<TextureLoader> &texture_loader() const { return m_texture_loader; };
+
+        [[nodiscard]] inline const std::unique_ptr<LayoutCache> &layout_cache() const { return m_layout_cache; };
+
+        // Every asset the engine loads by path (shaders, images) is opened through this, see AssetStore.
+        [[nodiscard]] inline const std::unique_ptr<AssetStore> &asset_store() const { return m_asset_store; };
+
+        // null unless ContextSettings::shader_hot_reload is set.
+        [[nodiscard]] inline const std::unique_ptr<ShaderWatcher> &shader_watcher() const { return m_shader_watcher; };
 
         [[nodiscard]] inline vk::Viewport full_viewport() const {
-            return vk::Viewport(0.0f, 0.0f, static_cast<float>(m_swc.extent.width), static_cast<float>(m_swc.extent.height), 0.0f, 1.0f);
+            return vk::Viewport(0.0f, 0.0f, static_cast<float>(m_swapchain_extent.width), static_cast<float>(m_swapchain_extent.height), 0.0f, 1.0f);
         };
 
         [[nodiscard]] const std::unique_ptr<GpuAllocator> &gpu_allocator() const { return m_gpu_allocator; }
 
+        [[nodiscard]] inline const std::unique_ptr<UploadQueue> &upload_queue() const { return m_upload_queue; };
+
+        // Reset at the start of every frame, see FrameAllocator.
+        [[nodiscard]] inline const std::unique_ptr<FrameAllocator> &frame_allocator() const { return m_frame_allocator; };
+
+        [[nodiscard]] inline const std::unique_ptr<GpuProfiler> &gpu_profiler() const { return m_gpu_profiler; };
+
         void create_swapchain();
 
-        [[nodiscard]] FrameInfo acquire_next_frame();
+        // Replaces the swapchain (passing the current one as oldSwapchain). The old swapchain and its image views are destroyed once the frames which might still be
+        // using them have retired, so this never has to wait for the device to idle. Swapchain recreation callbacks are run afterwards.
+        void recreate_swapchain();
+
+        // Called (on the render thread, from inside acquire_next_frame()) after the swapchain has been recreated. Anything created from the swapchain images
+        // (framebuffers, etc.) should be rebuilt here, and the old objects released through defer().
+        swapchain_recreated_handle on_swapchain_recreated(const std::function<swapchain_recreated_signature> &f);
+
+        void remove_swapchain_recreated_callback(const swapchain_recreated_handle &handle);
+
+        // Runs f once the gpu has finished every frame submitted so far (it's checked at the start of every frame). Thread safe: work pushed from off the render
+        // thread is tagged with whichever frame the render thread is recording at that moment. That's late enough, as long as the object's last user let go of it
+        // before the push, no frame started afterwards can use it.
+        void defer(std::function<void()> f);
+
+        // Destroys the object once the gpu has finished every frame submitted so far, like defer() but without allocating a function for common handle types.
+        // Resource wrappers (Buffer, Image, ImageView, Sampler) release their handles through this, so they can be dropped while frames are in flight.
+        void defer_destroy(DeletionQueue::Resource resource);
+
+        // Runs deferred work whose frames have retired. This is done automatically by acquire_next_frame().
+        void collect_deferred();
+
+        // Runs all deferred work immediately, the caller has to make sure the device is idle.
+        void flush_deferred();
+
+        // Writes the pipeline cache to ContextSettings::pipeline_cache_path. Safe to call multiple times (every call rewrites the file).
+        void save_pipeline_cache();
+
+        // Waits until the frame that previously used this frame slot has retired, then acquires the next swapchain image (recreating the swapchain if it is out of
+        // date). Returns nothing if there is currently nothing to render to (i.e. the window is minimized), in which case the frame should be skipped.
+        [[nodiscard]] std::optional<FrameInfo> acquire_next_frame();
+
+        // Submits the frame's command buffers to the graphics queue, waiting on image acquisition and signaling both the present semaphore and the frame timeline.
+        void submit_frame(const FrameInfo &frame_info, const std::vector<vk::CommandBuffer> &command_buffers,
+                          vk::PipelineStageFlags wait_stage = vk::PipelineStageFlagBits::eColorAttachmentOutput) const;
+
+        // The number of the newest frame the gpu has finished. Cheap, this is just a semaphore counter query.
+        [[nodiscard]] uint64_t completed_frame() const;
+
+        [[nodiscard]] inline bool is_frame_complete(uint64_t frame_number) const { return completed_frame() >= frame_number; };
+
+        // Blocks until the gpu has finished the given frame. Returns false on timeout.
+        bool wait_for_frame(uint64_t frame_number, uint64_t timeout = UINT64_MAX) const;
 
         vk::Semaphore create_semaphore() const;
+        vk::Semaphore create_timeline_semaphore(uint64_t initial_value = 0) const;
+
+        bool wait_for_semaphore(vk::Semaphore semaphore, uint64_t value, uint64_t timeout = UINT64_MAX) const;
+
         vk::Fence     create_fence(bool signaled) const;
         vk::Fence     create_fence() const;
         vk::Fence     create_fence_signaled() const;
@@ -126,6 +295,8 @@ namespace kat {
 
         void reset_fences(const std::vector<vk::Fence> &fences) const;
 
+        std::vector<vk::Semaphore> create_semaphores(uint32_t count) const;
+
         template <uint32_t N>
         std::array<vk::Semaphore, N> create_semaphores() {
             std::array<vk::Semaphore, N> arr;
@@ -160,6 +331,12 @@ namespace kat {
         vk::Queue get_queue(const QueueType &queue_type) const;
         uint32_t  get_queue_family(const QueueType &queue_type) const;
 
+        // Queue submission (and presentation) must be externally synchronized, all submissions should go through these rather than the raw queue handles.
+        // Queue types which share a vk::Queue also share the lock.
+        void submit(const QueueType &queue_type, const vk::SubmitInfo &submit_info, vk::Fence fence = {}) const;
+
+        [[nodiscard]] std::mutex &queue_mutex(vk::Queue queue) const;
+
         template <QueueType Q>
         vk::Queue get_queue() const;
 
@@ -182,6 +359,10 @@ namespace kat {
             return arr;
         };
 
+        [[nodiscard]] std::vector<vk::CommandBuffer> allocate_command_buffers_raw(const vk::CommandPool &pool, uint32_t count) const {
+            return m_device.allocateCommandBuffers(vk::CommandBufferAllocateInfo(pool, vk::CommandBufferLevel::ePrimary, count));
+        };
+
         void present();
 
         [[nodiscard]] vk::CommandBuffer begin_single_time_commands() const;
@@ -191,6 +372,10 @@ namespace kat {
         void single_time_commands(const std::function<void(const vk::CommandBuffer &)> &f) const;
 
       private:
+        bool m_headless;
+        bool m_memory_budget  = false;
+        bool m_bc_compression = false;
+
         vkb::Instance       m_inst;
         vkb::PhysicalDevice m_phys;
         vkb::Device         m_dev;
@@ -210,31 +395,84 @@ namespace kat {
         uint32_t m_transfer_family;
         uint32_t m_compute_family;
 
+        std::unordered_map<VkQueue, std::unique_ptr<std::mutex>> m_queue_mutexes;
+
         vkb::Swapchain   m_swc;
         vk::SwapchainKHR m_swapchain;
+        bool             m_swapchain_dirty = false;
+        vk::Extent2D     m_swapchain_extent;
+        vk::Format       m_swapchain_format;
+
+        swapchain_recreated_callbacks m_swapchain_recreated_callbacks;
+
+        std::unique_ptr<DeletionQueue> m_deletion_queue;
 
         std::vector<vk::Image>     m_swc_images;
         std::vector<vk::ImageView> m_swc_image_views;
 
-        uint32_t  m_current_frame = 0;
-        FrameInfo m_current_frame_info;
+        // headless only, backs m_swc_images.
+        std::vector<std::shared_ptr<Image>> m_offscreen_images;
+
+        uint32_t              m_current_frame = 0;
+        uint32_t              m_frames_in_flight;
+        std::atomic<uint64_t> m_frame_number = 0;
+
+        vk::DeviceSize m_staging_ring_size;
 
         uint32_t m_current_image_index;
 
-        std::array<vk::Semaphore, MAX_FRAMES_IN_FLIGHT> m_image_available_semaphores;
-        std::array<vk::Semaphore, MAX_FRAMES_IN_FLIGHT> m_render_finished_semaphores;
-        std::array<vk::Fence, MAX_FRAMES_IN_FLIGHT>     m_in_flight_fences;
+        // binary semaphores are still needed for the swapchain (presentation can't wait on timeline semaphores), everything else is paced by m_frame_timeline.
+        std::vector<vk::Semaphore> m_image_available_semaphores;
+        std::vector<vk::Semaphore> m_render_finished_semaphores;
+        vk::Semaphore              m_frame_timeline;
+
+        std::unique_ptr<ShaderCache>   m_shader_cache;
+        size_t                         m_shader_cache_capacity;
+        std::unique_ptr<ShaderWatcher> m_shader_watcher;
+        bool                           m_shader_hot_reload;
+        std::unique_ptr<GpuAllocator>  m_gpu_allocator;
+        std::unique_ptr<UploadQueue>   m_upload_queue;
+
+        std::unique_ptr<FrameAllocator> m_frame_allocator;
+        vk::DeviceSize                  m_frame_allocator_size;
 
-        std::unique_ptr<ShaderCache>  m_shader_cache;
-        std::unique_ptr<GpuAllocator> m_gpu_allocator;
+        std::unique_ptr<GpuProfiler> m_gpu_profiler;
+
+        std::unique_ptr<PipelineCompiler> m_pipeline_compiler;
+        uint32_t                          m_pipeline_compiler_threads;
+        std::unique_ptr<PipelineRegistry> m_pipeline_registry;
+        std::unique_ptr<LayoutCache>      m_layout_cache;
+        std::unique_ptr<TextureLoader>    m_texture_loader;
+        uint32_t                          m_texture_loader_threads;
+        std::unique_ptr<AssetStore>       m_asset_store;
 
         vk::CommandPool m_single_time_gt_pool;
+
+        std::filesystem::path m_pipeline_cache_path;
+        vk::PipelineCache     m_pipeline_cache;
+
+        void load_pipeline_cache();
+    };
+
+    // What an allocation is used for. Only used for accounting, see GpuAllocator::stats().
+    enum class MemoryCategory : uint32_t {
+        BUFFER,
+        IMAGE,
+        STAGING,
+        UNIFORM,
     };
 
+    constexpr size_t MEMORY_CATEGORY_COUNT = 4;
+
+    [[nodiscard]] const char *to_string(MemoryCategory category);
+
     class Buffer {
       public:
-        Buffer(const std::shared_ptr<Context> &context, vk::Buffer buffer, VmaAllocation allocation, VmaAllocationInfo allocation_info);
+        // buffers are only moved by defragmentation when they have a create_info (see GpuAllocator::create_buffer()).
+        Buffer(const std::shared_ptr<Context> &context, vk::Buffer buffer, VmaAllocation allocation, VmaAllocationInfo allocation_info,
+               MemoryCategory category = MemoryCategory::BUFFER, std::optional<vk::BufferCreateInfo> create_info = std::nullopt);
 
+        // the buffer isn't destroyed until the frames which may be using it have retired, see Context::defer_destroy().
         ~Buffer();
 
         void map_and_write(const void *data, const vk::DeviceSize &size, const vk::DeviceSize &offset) const;
@@ -251,46 +489,213 @@ namespace kat {
 
         void copy_from(const std::shared_ptr<Buffer> &other, const vk::DeviceSize &size, const vk::DeviceSize &src_offset, const vk::DeviceSize &dst_offset) const;
 
+        // Make cpu writes visible to the gpu / gpu writes visible to the cpu. These do nothing for host coherent memory, so they can always be called.
+        void flush(const vk::DeviceSize &offset = 0, const vk::DeviceSize &size = VK_WHOLE_SIZE) const;
+        void invalidate(const vk::DeviceSize &offset = 0, const vk::DeviceSize &size = VK_WHOLE_SIZE) const;
+
         [[nodiscard]] inline vk::Buffer handle() const { return m_buffer; };
 
+        // Only set for buffers created with VMA_ALLOCATION_CREATE_MAPPED_BIT, the pointer stays valid for the lifetime of the buffer.
+        [[nodiscard]] inline void *mapped_ptr() const { return m_allocation_info.pMappedData; };
+
+        [[nodiscard]] inline bool is_mapped() const { return m_allocation_info.pMappedData != nullptr; };
+
+        [[nodiscard]] inline vk::DeviceSize size() const { return m_allocation_info.size; };
+
+        [[nodiscard]] inline VmaAllocation allocation() const { return m_allocation; };
+
+        [[nodiscard]] inline MemoryCategory category() const { return m_category; };
+
+        // Whether defragmentation may move the buffer. When it does, handle() changes, see GpuAllocator::on_relocated().
+        [[nodiscard]] inline bool is_movable() const { return m_create_info.has_value(); };
+
       private:
-        vk::Buffer        m_buffer;
-        VmaAllocation     m_allocation;
-        VmaAllocationInfo m_allocation_info;
+        friend class GpuAllocator;
+
+        vk::Buffer                          m_buffer;
+        VmaAllocation                       m_allocation;
+        VmaAllocationInfo                   m_allocation_info;
+        MemoryCategory                      m_category;
+        std::optional<vk::BufferCreateInfo> m_create_info;
 
         std::shared_ptr<Context> m_context;
     };
 
     class Image {
       public:
-        Image(const std::shared_ptr<Context> &context, vk::Image image, VmaAllocation allocation, VmaAllocationInfo allocation_info);
+        using relocated_signature = void();
+        using relocated_callbacks = eventpp::CallbackList<relocated_signature>;
+        using relocated_handle    = relocated_callbacks::Handle;
+
+        // images are only moved by defragmentation when they have a create_info (see GpuAllocator::create_image()) and a resting layout.
+        Image(const std::shared_ptr<Context> &context, vk::Image image, VmaAllocation allocation, VmaAllocationInfo allocation_info,
+              MemoryCategory category = MemoryCategory::IMAGE, std::optional<vk::ImageCreateInfo> create_info = std::nullopt);
 
         ~Image();
 
         [[nodiscard]] inline vk::Image handle() const { return m_image; };
 
+        [[nodiscard]] inline VmaAllocation allocation() const { return m_allocation; };
+
+        [[nodiscard]] inline MemoryCategory category() const { return m_category; };
+
+        // The layout every subresource of the image is left in between uses, set by the upload queue once an upload has finished. Images which don't have one
+        // (render targets, storage images, images still being uploaded) are never moved, since the move has to know what layout to copy from.
+        // Guarded by the allocator's movable lock, since uploads retire on whichever thread collects them while defragmentation reads it on the render thread.
+        void set_resting_layout(vk::ImageLayout layout);
+
+        [[nodiscard]] std::optional<vk::ImageLayout> resting_layout() const;
+
+        [[nodiscard]] bool is_movable() const;
+
+        // Called after defragmentation has moved the image to a new handle (views of it have to be recreated, ImageView does that itself). The callback runs
+        // while the pass still holds the allocator's movable lock, so it must not release movable buffers or images, that's what GpuAllocator::on_relocated() is for.
+        relocated_handle on_relocated(const std::function<relocated_signature> &f);
+
+        void remove_relocated_callback(const relocated_handle &handle);
+
       private:
-        vk::Image         m_image;
-        VmaAllocation     m_allocation;
-        VmaAllocationInfo m_allocation_info;
+        friend class GpuAllocator;
+
+        vk::Image                          m_image;
+        VmaAllocation                      m_allocation;
+        VmaAllocationInfo                  m_allocation_info;
+        MemoryCategory                     m_category;
+        std::optional<vk::ImageCreateInfo> m_create_info;
+        std::optional<vk::ImageLayout>     m_resting_layout;
+        relocated_callbacks                m_relocated_callbacks;
 
         std::shared_ptr<Context> m_context;
     };
 
+    struct AllocationDescription {
+        VmaMemoryUsage           usage = VMA_MEMORY_USAGE_AUTO;
+        VmaAllocationCreateFlags flags = 0;
+
+        // buffers are counted as BUFFER and images as IMAGE unless this is set.
+        std::optional<MemoryCategory> category = std::nullopt;
+
+        // allocate from a custom pool instead of vma's default ones, see GpuAllocator::pool(). usage is ignored when this is set.
+        VmaPool pool = VK_NULL_HANDLE;
+
+        [[nodiscard]] constexpr AllocationDescription with_category(MemoryCategory c) const { return {usage, flags, c, pool}; };
+    };
+
+    // cpu written every frame (uniform buffers, staging), persistently mapped so writes are a plain memcpy.
+    constexpr AllocationDescription HOST_WRITE_MAPPED = {VMA_MEMORY_USAGE_AUTO, VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT};
+
+    // written by the gpu and read back on the cpu, persistently mapped.
+    constexpr AllocationDescription HOST_READ_MAPPED = {VMA_MEMORY_USAGE_AUTO, VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT};
+
+    struct MemoryCategoryStats {
+        uint64_t bytes;
+        uint64_t count;
+        uint64_t peak_bytes;
+        uint64_t total_allocations; // over the lifetime of the allocator
+    };
+
+    struct MemoryHeapStats {
+        uint32_t index;
+        bool     device_local;
+
+        // budget is how much the process can use before the driver starts paging (without VK_EXT_memory_budget this is an estimate), usage is what the
+        // process currently uses, including allocations not made through vma.
+        uint64_t budget;
+        uint64_t usage;
+        uint64_t peak_usage;
+
+        // what vma has allocated from the heap (block_bytes) and handed out of those blocks (allocation_bytes).
+        uint64_t block_bytes;
+        uint64_t allocation_bytes;
+        uint32_t block_count;
+        uint32_t allocation_count;
+    };
+
+    enum class PoolAlgorithm {
+        // vma's default general purpose allocator, resources can be freed in any order.
+        TLSF,
+
+        // bump allocation. Only cheap when resources are freed in the order they were allocated (ring buffer, with max_block_count = 1) or in reverse (stack).
+        LINEAR,
+    };
+
+    struct PoolDescription {
+        // a resource like the ones which will be allocated from the pool, used to pick the memory type.
+        std::variant<vk::BufferCreateInfo, vk::ImageCreateInfo> example;
+
+        // usage and flags pick the memory type, the category and flags are also used for every allocation made from the pool.
+        AllocationDescription allocation;
+
+        PoolAlgorithm  algorithm       = PoolAlgorithm::TLSF;
+        vk::DeviceSize block_size      = 0; // 0 uses vma's default
+        size_t         min_block_count = 0;
+        size_t         max_block_count = 0; // 0 means no limit
+    };
+
+    struct DefragmentationSettings {
+        // the most that is moved per step, every step drains the gpu so this bounds the hitch.
+        vk::DeviceSize max_bytes_per_pass       = 16 * 1024 * 1024;
+        uint32_t       max_allocations_per_pass = 64;
+
+        // the full algorithm packs allocations tighter, but moves a lot more memory.
+        bool full = false;
+
+        // a custom pool to defragment, vma's default pools if null.
+        VmaPool pool = VK_NULL_HANDLE;
+    };
+
+    struct DefragmentationStats {
+        uint64_t bytes_moved;
+        uint64_t bytes_freed;
+        uint32_t allocations_moved;
+        uint32_t blocks_freed;
+    };
+
+    struct MemoryPoolStats {
+        std::string   name;
+        PoolAlgorithm algorithm;
+        uint64_t      block_bytes;
+        uint64_t      allocation_bytes;
+        uint32_t      block_count;
+        uint32_t      allocation_count;
+    };
+
+    struct MemoryStats {
+        std::vector<MemoryHeapStats>                            heaps;
+        std::array<MemoryCategoryStats, MEMORY_CATEGORY_COUNT> categories;
+        std::vector<MemoryPoolStats>                            pools;
+    };
+
+    // Upload staging chunks come from this pool, they are created and released with every upload batch.
+    constexpr std::string_view STAGING_POOL = "staging";
+
     class GpuAllocator : public std::enable_shared_from_this<GpuAllocator> {
       public:
         explicit GpuAllocator(const std::shared_ptr<Context> &context);
 
         ~GpuAllocator();
 
-        [[nodiscard]] std::shared_ptr<Buffer> create_buffer(const vk::BufferCreateInfo &create_info, const VmaMemoryUsage &vma_memory_usage = VMA_MEMORY_USAGE_AUTO) const;
-        [[nodiscard]] std::shared_ptr<Image>  create_image(const vk::ImageCreateInfo &create_info, const VmaMemoryUsage &vma_memory_usage = VMA_MEMORY_USAGE_AUTO) const;
+        [[nodiscard]] std::shared_ptr<Buffer> create_buffer(const vk::BufferCreateInfo &create_info, const AllocationDescription &allocation_description) const;
+        [[nodiscard]] std::shared_ptr<Image>  create_image(const vk::ImageCreateInfo &create_info, const AllocationDescription &allocation_description) const;
+
+        [[nodiscard]] inline std::shared_ptr<Buffer> create_buffer(const vk::BufferCreateInfo &create_info, const VmaMemoryUsage &vma_memory_usage = VMA_MEMORY_USAGE_AUTO) const {
+            return create_buffer(create_info, AllocationDescription{vma_memory_usage});
+        };
+
+        [[nodiscard]] inline std::shared_ptr<Image> create_image(const vk::ImageCreateInfo &create_info, const VmaMemoryUsage &vma_memory_usage = VMA_MEMORY_USAGE_AUTO) const {
+            return create_image(create_info, AllocationDescription{vma_memory_usage});
+        };
 
         [[nodiscard]] inline std::shared_ptr<Buffer> create_buffer(const vk::DeviceSize &size, const vk::BufferUsageFlags usage,
                                                                    const VmaMemoryUsage &vma_memory_usage = VMA_MEMORY_USAGE_AUTO) const {
             return create_buffer(vk::BufferCreateInfo({}, size, usage, vk::SharingMode::eExclusive, {}), vma_memory_usage);
         };
 
+        [[nodiscard]] inline std::shared_ptr<Buffer> create_buffer(const vk::DeviceSize &size, const vk::BufferUsageFlags usage,
+                                                                   const AllocationDescription &allocation_description) const {
+            return create_buffer(vk::BufferCreateInfo({}, size, usage, vk::SharingMode::eExclusive, {}), allocation_description);
+        };
+
         void free_buffer(const vk::Buffer &buffer, const VmaAllocation &allocation) const;
         void free_image(const vk::Image &imageimage, const VmaAllocation &allocation) const;
 
@@ -300,21 +705,137 @@ namespace kat {
             return init_buffer(data.data(), data.size() * sizeof(T), usage, vma_memory_usage);
         };
 
+        template <typename T>
+        [[nodiscard]] std::shared_ptr<Buffer> init_buffer(UploadBatch &batch, const std::vector<T> &data, const vk::BufferUsageFlags usage,
+                                                          const VmaMemoryUsage &vma_memory_usage = VMA_MEMORY_USAGE_AUTO) const {
+            return init_buffer(batch, data.data(), data.size() * sizeof(T), usage, vma_memory_usage);
+        };
+
+        // these upload immediately and wait for the upload to finish, prefer the batched versions when creating more than one resource.
         [[nodiscard]] std::shared_ptr<Buffer> init_buffer(const void *data, const vk::DeviceSize &size, const vk::BufferUsageFlags usage,
                                                           const VmaMemoryUsage &vma_memory_usage = VMA_MEMORY_USAGE_AUTO) const;
 
-        [[nodiscard]] std::tuple<std::shared_ptr<Image>, vk::Format, vk::Extent2D> load_image(const std::filesystem::path &path) const;
+        [[nodiscard]] std::tuple<std::shared_ptr<Image>, vk::Format, vk::Extent2D> load_image(const std::filesystem::path &path, bool generate_mips = true) const;
 
         [[nodiscard]] std::shared_ptr<Image> init_image(uint32_t width, uint32_t height, uint32_t pixel_size, vk::Format format, unsigned char *data,
-                                                        const vk::ImageUsageFlags &image_usage_flags, vk::ImageLayout il, bool gpu_only) const;
+                                                        const vk::ImageUsageFlags &image_usage_flags, vk::ImageLayout il, bool gpu_only, bool generate_mips = false) const;
+
+        // the resources returned by these can't be used until the batch has been submitted to the upload queue.
+        [[nodiscard]] std::shared_ptr<Buffer> init_buffer(UploadBatch &batch, const void *data, const vk::DeviceSize &size, const vk::BufferUsageFlags usage,
+                                                          const VmaMemoryUsage &vma_memory_usage = VMA_MEMORY_USAGE_AUTO) const;
+
+        [[nodiscard]] std::tuple<std::shared_ptr<Image>, vk::Format, vk::Extent2D> load_image(UploadBatch &batch, const std::filesystem::path &path,
+                                                                                              bool generate_mips = true) const;
+
+        // Loads a png/jpg/ktx2 image which is already in memory (e.g. a mapped file), bytes only have to live until this returns.
+        [[nodiscard]] std::tuple<std::shared_ptr<Image>, vk::Format, vk::Extent2D> load_image(UploadBatch &batch, std::span<const unsigned char> bytes,
+                                                                                              bool generate_mips = true) const;
+
+        // generate_mips gives the image a full mip chain, blitted on the gpu when the format supports linear blits and filtered on the cpu otherwise. Formats which
+        // can't do either (and linear images) get a single level.
+        [[nodiscard]] std::shared_ptr<Image> init_image(UploadBatch &batch, uint32_t width, uint32_t height, uint32_t pixel_size, vk::Format format, const unsigned char *data,
+                                                        const vk::ImageUsageFlags &image_usage_flags, vk::ImageLayout il, bool gpu_only, bool generate_mips = false) const;
+
+        // Uploads every level, layer and face of a parsed KTX2 texture as is (cube maps get a cube compatible image). The bytes it was parsed from only have to
+        // live until this returns. Textures in a BCn format need has_bc_compression().
+        [[nodiscard]] std::shared_ptr<Image> init_image(UploadBatch &batch, const Ktx2Texture &texture, const vk::ImageUsageFlags &image_usage_flags = vk::ImageUsageFlagBits::eSampled,
+                                                        vk::ImageLayout il = vk::ImageLayout::eShaderReadOnlyOptimal) const;
 
         [[nodiscard]] void *map(const VmaAllocation &alloc) const;
 
         void unmap(const VmaAllocation &alloc) const;
 
+        [[nodiscard]] inline VmaAllocator handle() const { return m_allocator; };
+
+        void flush(const VmaAllocation &alloc, const vk::DeviceSize &offset, const vk::DeviceSize &size) const;
+        void invalidate(const VmaAllocation &alloc, const vk::DeviceSize &offset, const vk::DeviceSize &size) const;
+
+        // Creates a named pool, resources are allocated from it by passing pool(name) to create_buffer/create_image. Names have to be unique.
+        void create_pool(const std::string &name, const PoolDescription &description);
+
+        // The allocation description to create a resource in the named pool. Unknown names are a fatal error.
+        [[nodiscard]] AllocationDescription pool(std::string_view name) const;
+
+        using relocated_signature = void();
+        using relocated_callbacks = eventpp::CallbackList<relocated_signature>;
+        using relocated_handle    = relocated_callbacks::Handle;
+
+        // Starts moving movable buffers and images (see Buffer::is_movable() and Image::is_movable()) into fewer memory blocks. The work is split into bounded
+        // passes, one per frame, run by the context before the frame is recorded. Does nothing if a defragmentation is already running.
+        void begin_defragmentation(const DefragmentationSettings &settings = {});
+
+        void cancel_defragmentation();
+
+        [[nodiscard]] bool is_defragmenting() const;
+
+        // Starts a defragmentation with the given settings when enough memory is wasted in partially used blocks. Checked every few hundred frames.
+        void set_auto_defragmentation(std::optional<DefragmentationSettings> settings);
+
+        // Runs one pass, called by the context with the gpu drained. Resources moved in the pass have new handles afterwards, and anything which refers to them
+        // by handle (descriptor sets, framebuffers, ...) has to be rewritten in an on_relocated() callback.
+        void defragmentation_step();
+
+        relocated_handle on_relocated(const std::function<relocated_signature> &f);
+
+        void remove_relocated_callback(const relocated_handle &handle);
+
+        // Totals of the last finished defragmentation.
+        [[nodiscard]] std::optional<DefragmentationStats> last_defragmentation() const;
+
+        // Called by the context at the start of every frame. Samples the heap budgets for the peak usage, and warns when a heap gets close to its budget.
+        void begin_frame(uint64_t frame_number);
+
+        [[nodiscard]] MemoryStats stats() const;
+
+        // Writes stats() along with vma's detailed statistics as json. Returns false (with a warning) if the file can't be written.
+        bool write_stats_json(const std::filesystem::path &path) const;
+
       private:
+        friend class Buffer;
+        friend class Image;
+
+        struct CategoryCounters {
+            std::atomic<uint64_t> bytes             = 0;
+            std::atomic<uint64_t> count             = 0;
+            std::atomic<uint64_t> peak_bytes        = 0;
+            std::atomic<uint64_t> total_allocations = 0;
+        };
+
+        struct Pool {
+            VmaPool               handle;
+            AllocationDescription allocation;
+            PoolAlgorithm         algorithm;
+        };
+
+        void track_allocation(MemoryCategory category, vk::DeviceSize size) const;
+        void track_free(MemoryCategory category, vk::DeviceSize size) const;
+
+        void track_movable(VmaAllocation allocation, std::variant<Buffer *, Image *> resource) const;
+        void untrack_movable(VmaAllocation allocation) const;
+
+        void end_defragmentation();
+
         std::shared_ptr<Context> m_context;
         VmaAllocator             m_allocator = VK_NULL_HANDLE;
+
+        mutable std::mutex                    m_pools_mutex;
+        std::unordered_map<std::string, Pool> m_pools;
+
+        mutable std::array<CategoryCounters, MEMORY_CATEGORY_COUNT> m_categories;
+
+        mutable std::mutex    m_heap_mutex;
+        std::vector<uint64_t> m_heap_peaks;
+        std::vector<bool>     m_heap_warned;
+
+        // resources which defragmentation is allowed to move, by allocation.
+        mutable std::mutex                                                          m_movable_mutex;
+        mutable std::unordered_map<VmaAllocation, std::variant<Buffer *, Image *>> m_movable;
+
+        mutable std::mutex                     m_defrag_mutex;
+        VmaDefragmentationContext              m_defrag_context = VK_NULL_HANDLE;
+        std::optional<DefragmentationSettings> m_auto_defrag;
+        std::optional<DefragmentationStats>    m_last_defrag;
+        relocated_callbacks                    m_relocated_callbacks;
     };
 
     class ImageView {
@@ -330,15 +851,19 @@ namespace kat {
             std::optional<vk::ImageUsageFlags> restricted_usage = std::nullopt;
         };
 
+        // the view is recreated (with a new handle) if defragmentation moves the image.
         ImageView(const std::shared_ptr<Context> &context, const Description &desc);
         ~ImageView();
 
         [[nodiscard]] inline vk::ImageView handle() const { return m_image_view; };
 
       private:
+        void create();
+
         std::shared_ptr<Context> m_context;
         vk::ImageView            m_image_view;
         Description              m_description;
+        Image::relocated_handle  m_relocated_handle;
     };
 
     class Sampler {
@@ -346,7 +871,7 @@ namespace kat {
         struct Description {
             vk::Filter             mag_filter               = vk::Filter::eLinear;
             vk::Filter             min_filter               = vk::Filter::eLinear;
-            vk::SamplerMipmapMode  mipmap_mode              = vk::SamplerMipmapMode::eNearest;
+            vk::SamplerMipmapMode  mipmap_mode              = vk::SamplerMipmapMode::eLinear;
             vk::SamplerAddressMode address_mode_u           = vk::SamplerAddressMode::eClampToEdge;
             vk::SamplerAddressMode address_mode_v           = vk::SamplerAddressMode::eClampToEdge;
             vk::SamplerAddressMode address_mode_w           = vk::SamplerAddressMode::eClampToEdge;
@@ -356,7 +881,7 @@ namespace kat {
             bool                   enable_compare           = false;
             vk::CompareOp          compare_op               = vk::CompareOp::eAlways;
             float                  min_lod                  = 0.0f;
-            float                  max_lod                  = 0.0f;
+            float                  max_lod                  = VK_LOD_CLAMP_NONE; // uses every level of the image view
             vk::BorderColor        border_color             = vk::BorderColor::eIntOpaqueBlack;
             bool                   unnormalized_coordinates = false;
         };
@@ -0,0 +1,61 @@
+#include "kat/graphics/deletion_queue.hpp"
+
+#include <vector>
+
+namespace kat {
+    template <typename... Ts>
+    struct overloaded : Ts... {
+        using Ts::operator()...;
+    };
+
+    DeletionQueue::DeletionQueue(vk::Device device) : m_device(device) {}
+
+    void DeletionQueue::push(uint64_t value, Resource resource) {
+        std::lock_guard lock(m_mutex);
+        m_entries.emplace_back(value, std::move(resource));
+    }
+
+    void DeletionQueue::collect(uint64_t completed_value) {
+        std::vector<Resource> ready;
+        {
+            std::lock_guard lock(m_mutex);
+            // entries are queued in order, so we can stop at the first one which hasn't retired yet.
+            while (!m_entries.empty() && m_entries.front().first <= completed_value) {
+                ready.push_back(std::move(m_entries.front().second));
+                m_entries.pop_front();
+            }
+        }
+
+        // destroyed outside of the lock, deferred functions are allowed to queue more work.
+        for (auto &resource : ready) {
+            destroy(resource);
+        }
+    }
+
+    void DeletionQueue::flush() {
+        std::deque<std::pair<uint64_t, Resource>> all;
+        {
+            std::lock_guard lock(m_mutex);
+            all.swap(m_entries);
+        }
+
+        for (auto &[_, resource] : all) {
+            destroy(resource);
+        }
+    }
+
+    size_t DeletionQueue::size() {
+        std::lock_guard lock(m_mutex);
+        return m_entries.size();
+    }
+
+    void DeletionQueue::destroy(Resource &resource) const {
+        std::visit(overloaded{
+                       [&](const AllocatedBuffer &buffer) { vmaDestroyBuffer(m_allocator, buffer.buffer, buffer.allocation); },
+                       [&](const AllocatedImage &image) { vmaDestroyImage(m_allocator, image.image, image.allocation); },
+                       [&](const std::function<void()> &f) { f(); },
+                       [&](const auto &handle) { m_device.destroy(handle); },
+                   },
+                   resource);
+    }
+} // namespace kat
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include <vk_mem_alloc.h>
+
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <variant>
+
+namespace kat {
+
+    struct AllocatedBuffer {
+        vk::Buffer    buffer;
+        VmaAllocation allocation;
+    };
+
+    struct AllocatedImage {
+        vk::Image     image;
+        VmaAllocation allocation;
+    };
+
+    // Holds on to vulkan objects until the gpu is done with them. Every entry is tagged with a timeline value (the context uses frame numbers), and is destroyed
+    // once collect() is called with a completed value at or past it. Common handle types are stored directly so releasing a resource doesn't allocate, anything
+    // else can be queued as a function.
+    class DeletionQueue {
+      public:
+        using Resource = std::variant<AllocatedBuffer, AllocatedImage, vk::ImageView, vk::Sampler, vk::Framebuffer, vk::Pipeline, vk::PipelineLayout, vk::DescriptorSetLayout,
+                                      vk::DescriptorPool, vk::CommandPool, vk::QueryPool, vk::Semaphore, vk::Fence, std::function<void()>>;
+
+        explicit DeletionQueue(vk::Device device);
+
+        // Buffers and images can't be queued until the allocator has been set.
+        inline void set_allocator(VmaAllocator allocator) { m_allocator = allocator; };
+
+        // Values have to be pushed in increasing order. Thread safe.
+        void push(uint64_t value, Resource resource);
+
+        // Destroys everything tagged with a value <= completed_value.
+        void collect(uint64_t completed_value);
+
+        // Destroys everything, the caller has to make sure the device is idle.
+        void flush();
+
+        [[nodiscard]] size_t size();
+
+      private:
+        void destroy(Resource &resource) const;
+
+        vk::Device   m_device;
+        VmaAllocator m_allocator = VK_NULL_HANDLE;
+
+        std::mutex                                 m_mutex;
+        std::deque<std::pair<uint64_t, Resource>> m_entries;
+    };
+
+} // namespace kat
@@ -0,0 +1,49 @@
+#include "kat/graphics/frame_allocator.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+namespace kat {
+    FrameAllocator::FrameAllocator(const std::shared_ptr<Context> &context, vk::DeviceSize frame_size) : m_context(context) {
+        const auto limits = m_context->physical_device().getProperties().limits;
+        m_min_alignment   = std::max(limits.minUniformBufferOffsetAlignment, limits.minStorageBufferOffsetAlignment);
+
+        // every segment has to start at an aligned offset too.
+        m_frame_size = (frame_size + m_min_alignment - 1) / m_min_alignment * m_min_alignment;
+
+        m_buffer = m_context->gpu_allocator()->create_buffer(m_frame_size * m_context->frames_in_flight(),
+                                                             vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eStorageBuffer |
+                                                                 vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eIndexBuffer,
+                                                             HOST_WRITE_MAPPED.with_category(MemoryCategory::UNIFORM));
+        m_mapped = static_cast<char *>(m_buffer->mapped_ptr());
+    }
+
+    void FrameAllocator::begin_frame(uint32_t frame_index) {
+        m_segment_start = m_frame_size * frame_index;
+        m_used.store(0, std::memory_order_relaxed);
+    }
+
+    FrameAllocator::Allocation FrameAllocator::allocate(vk::DeviceSize size, vk::DeviceSize alignment) {
+        if (alignment == 0)
+            alignment = m_min_alignment;
+
+        vk::DeviceSize used = m_used.load(std::memory_order_relaxed);
+        vk::DeviceSize offset;
+        do {
+            offset = (used + alignment - 1) / alignment * alignment;
+
+            if (offset + size > m_frame_size) {
+                std::cerr << "Error: Frame allocator is out of memory (" << size << " bytes requested, " << m_frame_size - used << " of " << m_frame_size
+                          << " bytes left). Increase ContextSettings::frame_allocator_size." << std::endl;
+                throw fatal_exc{};
+            }
+        } while (!m_used.compare_exchange_weak(used, offset + size, std::memory_order_relaxed));
+
+        return Allocation{m_buffer->handle(), m_segment_start + offset, m_mapped + m_segment_start + offset, size};
+    }
+
+    void FrameAllocator::flush() const {
+        if (const vk::DeviceSize used = m_used.load(std::memory_order_relaxed); used > 0)
+            m_buffer->flush(m_segment_start, used);
+    }
+} // namespace kat
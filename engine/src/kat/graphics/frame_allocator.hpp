@@ -0,0 +1,68 @@
+#pragma once
+
+#include "kat/graphics/context.hpp"
+
+#include <atomic>
+#include <cstring>
+#include <memory>
+
+namespace kat {
+
+    // Linear allocator for data that only lives for one frame (uniform blocks, per-object constants, dynamic vertices, ...).
+    // One persistently mapped buffer is split into a segment per frame in flight, allocating is an atomic bump within the current frame's segment, and the
+    // whole segment is reset at once when the frame that last used it has retired. Allocations are aligned for use as dynamic uniform/storage buffer offsets.
+    class FrameAllocator {
+      public:
+        struct Allocation {
+            vk::Buffer     buffer;
+            vk::DeviceSize offset;
+            void          *mapped;
+            vk::DeviceSize size;
+
+            // for vk::DescriptorType::eUniformBufferDynamic / eStorageBufferDynamic bindings which point at the start of the buffer.
+            [[nodiscard]] inline uint32_t dynamic_offset() const { return static_cast<uint32_t>(offset); };
+        };
+
+        FrameAllocator(const std::shared_ptr<Context> &context, vk::DeviceSize frame_size);
+
+        FrameAllocator(const FrameAllocator &)            = delete;
+        FrameAllocator &operator=(const FrameAllocator &) = delete;
+
+        // Called by the context once the frame which last used this segment has retired.
+        void begin_frame(uint32_t frame_index);
+
+        // An alignment of 0 uses min_alignment(). Running out of space in a frame is a fatal error, raise ContextSettings::frame_allocator_size instead.
+        [[nodiscard]] Allocation allocate(vk::DeviceSize size, vk::DeviceSize alignment = 0);
+
+        template <typename T>
+        [[nodiscard]] Allocation push(const T &data) {
+            Allocation allocation = allocate(sizeof(T));
+            std::memcpy(allocation.mapped, &data, sizeof(T));
+            return allocation;
+        };
+
+        // Flushes everything written in the current frame, called by the context when the frame is submitted.
+        void flush() const;
+
+        [[nodiscard]] inline const std::shared_ptr<Buffer> &buffer() const { return m_buffer; };
+
+        [[nodiscard]] inline vk::DeviceSize frame_size() const { return m_frame_size; };
+
+        // The largest of the device's minimum uniform and storage buffer offset alignments.
+        [[nodiscard]] inline vk::DeviceSize min_alignment() const { return m_min_alignment; };
+
+        // Bytes allocated in the current frame.
+        [[nodiscard]] inline vk::DeviceSize used() const { return m_used.load(std::memory_order_relaxed); };
+
+      private:
+        std::shared_ptr<Context> m_context;
+        std::shared_ptr<Buffer>  m_buffer;
+        char                    *m_mapped;
+        vk::DeviceSize           m_frame_size;
+        vk::DeviceSize           m_min_alignment;
+
+        vk::DeviceSize              m_segment_start = 0;
+        std::atomic<vk::DeviceSize> m_used          = 0;
+    };
+
+} // namespace kat
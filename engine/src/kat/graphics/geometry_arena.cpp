@@ -0,0 +1,132 @@
+#include "kat/graphics/geometry_arena.hpp"
+
+#include "kat/graphics/upload_queue.hpp"
+
+#include <iostream>
+
+namespace kat {
+    namespace {
+        VmaVirtualBlock create_block(uint32_t size) {
+            // the blocks count elements rather than bytes, so offsets come out as a first vertex / first index directly.
+            VmaVirtualBlockCreateInfo ci{};
+            ci.size = size;
+
+            VmaVirtualBlock block;
+            if (const auto res = static_cast<vk::Result>(vmaCreateVirtualBlock(&ci, &block)); res != vk::Result::eSuccess) {
+                std::cerr << "Error: Failed to create geometry arena block. Result: " << vk::to_string(res) << std::endl;
+                throw fatal_exc{};
+            }
+
+            return block;
+        }
+
+        uint32_t used_in(VmaVirtualBlock block) {
+            VmaStatistics stats;
+            vmaGetVirtualBlockStatistics(block, &stats);
+            return static_cast<uint32_t>(stats.allocationBytes);
+        }
+    } // namespace
+
+    GeometryArena::GeometryArena(const std::shared_ptr<Context> &context, const Description &description)
+        : m_context(context), m_description(description), m_blocks(std::make_shared<Blocks>()) {
+        // the buffers are exclusive to the graphics family. Uploads only ever transfer ownership of the range they write, the rest of the buffer stays with the
+        // graphics queue and can keep being drawn from in the meantime.
+        m_vertex_buffer = m_context->gpu_allocator()->create_buffer(m_description.vertex_stride * m_description.max_vertices,
+                                                                    vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst | m_description.extra_usage,
+                                                                    VMA_MEMORY_USAGE_GPU_ONLY);
+        m_index_buffer  = m_context->gpu_allocator()->create_buffer(sizeof(uint32_t) * m_description.max_indices,
+                                                                    vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eTransferDst | m_description.extra_usage,
+                                                                    VMA_MEMORY_USAGE_GPU_ONLY);
+
+        m_blocks->vertices = create_block(m_description.max_vertices);
+        m_blocks->indices  = create_block(m_description.max_indices);
+    }
+
+    GeometryArena::~GeometryArena() {
+        // queued after any deferred frees, so those have all run by the time the blocks are destroyed.
+        m_context->defer([blocks = m_blocks]() {
+            vmaClearVirtualBlock(blocks->vertices);
+            vmaClearVirtualBlock(blocks->indices);
+            vmaDestroyVirtualBlock(blocks->vertices);
+            vmaDestroyVirtualBlock(blocks->indices);
+        });
+    }
+
+    std::optional<GeometryArena::Range> GeometryArena::allocate(uint32_t vertex_count, uint32_t index_count) {
+        std::lock_guard lock(m_blocks->mutex);
+
+        Range range{};
+        range.vertex_count = vertex_count;
+        range.index_count  = index_count;
+
+        VmaVirtualAllocationCreateInfo ci{};
+        VkDeviceSize                   offset;
+
+        if (vertex_count > 0) {
+            ci.size = vertex_count;
+            if (vmaVirtualAllocate(m_blocks->vertices, &ci, &range.vertex_allocation, &offset) != VK_SUCCESS)
+                return std::nullopt;
+            range.vertex_offset = static_cast<uint32_t>(offset);
+        }
+
+        if (index_count > 0) {
+            ci.size = index_count;
+            if (vmaVirtualAllocate(m_blocks->indices, &ci, &range.index_allocation, &offset) != VK_SUCCESS) {
+                if (range.vertex_allocation)
+                    vmaVirtualFree(m_blocks->vertices, range.vertex_allocation);
+                return std::nullopt;
+            }
+            range.first_index = static_cast<uint32_t>(offset);
+        }
+
+        return range;
+    }
+
+    GeometryArena::Range GeometryArena::upload(UploadBatch &batch, const void *vertices, uint32_t vertex_count, const std::vector<uint32_t> &indices) {
+        const auto range = allocate(vertex_count, static_cast<uint32_t>(indices.size()));
+        if (!range) {
+            std::cerr << "Error: Geometry arena is out of space (" << vertex_count << " vertices and " << indices.size() << " indices requested, " << used_vertices() << "/"
+                      << m_description.max_vertices << " vertices and " << used_indices() << "/" << m_description.max_indices << " indices in use)." << std::endl;
+            throw fatal_exc{};
+        }
+
+        if (vertex_count > 0)
+            batch.upload_buffer(m_vertex_buffer, vertices, m_description.vertex_stride * vertex_count, m_description.vertex_stride * range->vertex_offset);
+
+        if (!indices.empty())
+            batch.upload_buffer(m_index_buffer, indices.data(), sizeof(uint32_t) * indices.size(), sizeof(uint32_t) * range->first_index);
+
+        return *range;
+    }
+
+    void GeometryArena::free(const Range &range) {
+        m_context->defer([blocks = m_blocks, range]() {
+            std::lock_guard lock(blocks->mutex);
+            if (range.vertex_allocation)
+                vmaVirtualFree(blocks->vertices, range.vertex_allocation);
+            if (range.index_allocation)
+                vmaVirtualFree(blocks->indices, range.index_allocation);
+        });
+    }
+
+    void GeometryArena::bind(const vk::CommandBuffer &cmd, uint32_t binding) const {
+        const vk::Buffer         buf = m_vertex_buffer->handle();
+        constexpr vk::DeviceSize off = 0;
+        cmd.bindVertexBuffers(binding, buf, off);
+        cmd.bindIndexBuffer(m_index_buffer->handle(), 0, vk::IndexType::eUint32);
+    }
+
+    void GeometryArena::draw(const vk::CommandBuffer &cmd, const Range &range, uint32_t instance_count, uint32_t first_instance) const {
+        cmd.drawIndexed(range.index_count, instance_count, range.first_index, static_cast<int32_t>(range.vertex_offset), first_instance);
+    }
+
+    uint32_t GeometryArena::used_vertices() const {
+        std::lock_guard lock(m_blocks->mutex);
+        return used_in(m_blocks->vertices);
+    }
+
+    uint32_t GeometryArena::used_indices() const {
+        std::lock_guard lock(m_blocks->mutex);
+        return used_in(m_blocks->indices);
+    }
+} // namespace kat
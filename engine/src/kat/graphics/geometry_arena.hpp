@@ -0,0 +1,98 @@
+#pragma once
+
+#include "kat/graphics/context.hpp"
+
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+namespace kat {
+
+    class UploadBatch;
+
+    // One device local vertex buffer and one index buffer shared by many meshes. Each mesh gets a range of vertices and indices from an offset allocator
+    // (a vma virtual block), so everything in the arena is drawn after a single bind, using the range's vertex offset and first index.
+    //
+    // All of the vertices in an arena share a stride, meshes with a different vertex layout need an arena of their own. Indices are always 32 bit.
+    class GeometryArena {
+      public:
+        struct Description {
+            vk::DeviceSize vertex_stride;
+            uint32_t       max_vertices;
+            uint32_t       max_indices;
+
+            // added to the usage of both buffers, e.g. eStorageBuffer to read the geometry from compute shaders.
+            vk::BufferUsageFlags extra_usage = {};
+        };
+
+        struct Range {
+            VmaVirtualAllocation vertex_allocation = VK_NULL_HANDLE;
+            VmaVirtualAllocation index_allocation  = VK_NULL_HANDLE;
+
+            uint32_t vertex_offset = 0;
+            uint32_t vertex_count  = 0;
+            uint32_t first_index   = 0;
+            uint32_t index_count   = 0;
+
+            [[nodiscard]] inline vk::DrawIndexedIndirectCommand indirect_command(uint32_t instance_count = 1, uint32_t first_instance = 0) const {
+                return {index_count, instance_count, first_index, static_cast<int32_t>(vertex_offset), first_instance};
+            };
+        };
+
+        GeometryArena(const std::shared_ptr<Context> &context, const Description &description);
+
+        // the buffers and offset allocator are released once the frames using them have retired.
+        ~GeometryArena();
+
+        GeometryArena(const GeometryArena &)            = delete;
+        GeometryArena &operator=(const GeometryArena &) = delete;
+
+        // Reserves space without writing anything. Returns nullopt when the arena doesn't have a large enough free range left. Thread safe.
+        [[nodiscard]] std::optional<Range> allocate(uint32_t vertex_count, uint32_t index_count);
+
+        // Allocates a range and uploads the mesh into it. Running out of space is a fatal error. The range can't be drawn until the batch has been submitted.
+        [[nodiscard]] Range upload(UploadBatch &batch, const void *vertices, uint32_t vertex_count, const std::vector<uint32_t> &indices);
+
+        template <typename V>
+        [[nodiscard]] Range upload(UploadBatch &batch, const std::vector<V> &vertices, const std::vector<uint32_t> &indices) {
+            return upload(batch, vertices.data(), static_cast<uint32_t>(vertices.size()), indices);
+        };
+
+        // The range is returned to the arena once the frames which may be drawing it have retired.
+        void free(const Range &range);
+
+        // Binds the vertex buffer to the given binding, and the index buffer.
+        void bind(const vk::CommandBuffer &cmd, uint32_t binding = 0) const;
+
+        // The arena has to be bound.
+        void draw(const vk::CommandBuffer &cmd, const Range &range, uint32_t instance_count = 1, uint32_t first_instance = 0) const;
+
+        [[nodiscard]] inline const std::shared_ptr<Buffer> &vertex_buffer() const { return m_vertex_buffer; };
+
+        [[nodiscard]] inline const std::shared_ptr<Buffer> &index_buffer() const { return m_index_buffer; };
+
+        [[nodiscard]] inline const Description &description() const { return m_description; };
+
+        // Vertices and indices currently handed out.
+        [[nodiscard]] uint32_t used_vertices() const;
+        [[nodiscard]] uint32_t used_indices() const;
+
+      private:
+        // shared with deferred frees, which may run after the arena is gone.
+        struct Blocks {
+            std::mutex      mutex;
+            VmaVirtualBlock vertices = VK_NULL_HANDLE;
+            VmaVirtualBlock indices  = VK_NULL_HANDLE;
+        };
+
+        std::shared_ptr<Context> m_context;
+        Description              m_description;
+
+        std::shared_ptr<Buffer> m_vertex_buffer;
+        std::shared_ptr<Buffer> m_index_buffer;
+
+        std::shared_ptr<Blocks> m_blocks;
+    };
+
+} // namespace kat
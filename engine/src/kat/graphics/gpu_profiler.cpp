@@ -0,0 +1,151 @@
+#include "kat/graphics/gpu_profiler.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <numeric>
+#include <unordered_map>
+
+namespace kat {
+    GpuProfiler::Scope::Scope(GpuProfiler &profiler, const vk::CommandBuffer &cmd, std::string_view name)
+        : m_profiler(profiler), m_cmd(cmd), m_id(profiler.begin_scope(cmd, name)) {}
+
+    GpuProfiler::Scope::~Scope() {
+        m_profiler.end_scope(m_cmd, m_id);
+    }
+
+    GpuProfiler::GpuProfiler(const std::shared_ptr<Context> &context, uint32_t max_scopes, uint32_t history)
+        : m_context(context), m_max_scopes(max_scopes), m_history_length(history) {
+        const auto props          = m_context->physical_device().getProperties();
+        const auto family_props   = m_context->physical_device().getQueueFamilyProperties();
+        const uint32_t valid_bits = family_props.at(m_context->graphics_family()).timestampValidBits;
+
+        m_supported        = valid_bits > 0 && props.limits.timestampPeriod > 0.0f;
+        m_timestamp_period = props.limits.timestampPeriod;
+        m_timestamp_mask   = valid_bits >= 64 ? UINT64_MAX : (uint64_t{1} << valid_bits) - 1;
+
+        if (!m_supported) {
+            std::cerr << "Warning: The graphics queue doesn't support timestamps, gpu profiling is disabled." << std::endl;
+            return;
+        }
+
+        m_slots.resize(m_context->frames_in_flight());
+        for (auto &slot : m_slots) {
+            // every scope takes two queries, one at the start and one at the end.
+            slot.pool = m_context->device().createQueryPool(vk::QueryPoolCreateInfo({}, vk::QueryType::eTimestamp, m_max_scopes * 2));
+            m_context->device().resetQueryPool(slot.pool, 0, m_max_scopes * 2);
+        }
+    }
+
+    GpuProfiler::~GpuProfiler() {
+        for (const auto &slot : m_slots) {
+            m_context->defer_destroy(slot.pool);
+        }
+    }
+
+    void GpuProfiler::begin_frame(uint32_t frame_index) {
+        if (!m_supported)
+            return;
+
+        m_current_slot = frame_index;
+        m_depth        = 0;
+
+        auto &slot = m_slots.at(m_current_slot);
+        if (slot.next_query == 0)
+            return;
+
+        resolve(slot);
+
+        m_context->device().resetQueryPool(slot.pool, 0, slot.next_query);
+        slot.next_query = 0;
+        slot.scopes.clear();
+    }
+
+    GpuProfiler::ScopeId GpuProfiler::begin_scope(const vk::CommandBuffer &cmd, std::string_view name) {
+        if (!m_supported)
+            return INVALID_SCOPE;
+
+        auto &slot = m_slots.at(m_current_slot);
+        if (slot.next_query + 2 > m_max_scopes * 2)
+            return INVALID_SCOPE;
+
+        const uint32_t query = slot.next_query;
+        slot.next_query += 2;
+
+        cmd.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, slot.pool, query);
+        slot.scopes.push_back(RecordedScope{std::string(name), m_depth++, query, false});
+
+        return static_cast<ScopeId>(slot.scopes.size() - 1);
+    }
+
+    void GpuProfiler::end_scope(const vk::CommandBuffer &cmd, ScopeId id) {
+        if (id == INVALID_SCOPE)
+            return;
+
+        auto &scope = m_slots.at(m_current_slot).scopes.at(id);
+        cmd.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, m_slots.at(m_current_slot).pool, scope.first_query + 1);
+        scope.closed = true;
+        m_depth--;
+    }
+
+    void GpuProfiler::resolve(FrameSlot &slot) {
+        std::vector<uint64_t> timestamps(slot.next_query);
+
+        // the frame has retired, so everything it wrote is available. Scopes which were never closed are simply skipped.
+        const auto res = m_context->device().getQueryPoolResults(slot.pool, 0, slot.next_query, timestamps.size() * sizeof(uint64_t), timestamps.data(),
+                                                                 sizeof(uint64_t), vk::QueryResultFlagBits::e64);
+        if (res != vk::Result::eSuccess)
+            return;
+
+        // a scope can be opened more than once per frame (e.g. once per draw), those are summed up.
+        std::unordered_map<std::string, std::pair<uint32_t, float>> frame_times;
+        std::vector<std::string>                                    order;
+
+        for (const auto &scope : slot.scopes) {
+            if (!scope.closed)
+                continue;
+
+            const uint64_t begin = timestamps[scope.first_query] & m_timestamp_mask;
+            const uint64_t end   = timestamps[scope.first_query + 1] & m_timestamp_mask;
+            const float    ms    = static_cast<float>(static_cast<double>((end - begin) & m_timestamp_mask) * m_timestamp_period / 1'000'000.0);
+
+            auto [it, inserted] = frame_times.try_emplace(scope.name, scope.depth, 0.0f);
+            it->second.second += ms;
+            if (inserted)
+                order.push_back(scope.name);
+        }
+
+        std::lock_guard lock(m_history_mutex);
+        for (const auto &name : order) {
+            const auto &[depth, ms] = frame_times.at(name);
+
+            auto history = std::ranges::find(m_history, name, &History::name);
+            if (history == m_history.end()) {
+                history = m_history.insert(m_history.end(), History{name, depth, {}});
+            }
+
+            history->depth = depth;
+            history->samples.push_back(ms);
+            if (history->samples.size() > m_history_length)
+                history->samples.pop_front();
+        }
+    }
+
+    std::vector<GpuProfiler::ScopeStats> GpuProfiler::stats() const {
+        std::lock_guard lock(m_history_mutex);
+
+        std::vector<ScopeStats> result;
+        result.reserve(m_history.size());
+
+        for (const auto &history : m_history) {
+            if (history.samples.empty())
+                continue;
+
+            const auto [min, max] = std::ranges::minmax(history.samples);
+            const float sum       = std::accumulate(history.samples.begin(), history.samples.end(), 0.0f);
+
+            result.push_back(ScopeStats{history.name, history.depth, history.samples.back(), min, sum / static_cast<float>(history.samples.size()), max});
+        }
+
+        return result;
+    }
+} // namespace kat
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "kat/graphics/context.hpp"
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace kat {
+
+    constexpr uint32_t DEFAULT_GPU_PROFILER_MAX_SCOPES = 256;
+    constexpr uint32_t DEFAULT_GPU_PROFILER_HISTORY    = 120;
+
+    // Measures gpu time with timestamp queries. There is a query pool per frame in flight, scopes are written into the current frame's pool, and the results are
+    // read back (without waiting) when the context reuses that frame slot, at which point the frame has retired. Timings are kept for the last `history` frames.
+    //
+    // Scopes have to be recorded from the render thread, into command buffers submitted with the current frame.
+    class GpuProfiler {
+      public:
+        using ScopeId = uint32_t;
+
+        static constexpr ScopeId INVALID_SCOPE = UINT32_MAX;
+
+        struct ScopeStats {
+            std::string name;
+            uint32_t    depth;
+
+            // milliseconds, over the last `history` frames the scope was recorded in.
+            float last;
+            float min;
+            float avg;
+            float max;
+        };
+
+        // Opens a scope on construction and closes it on destruction.
+        class Scope {
+          public:
+            Scope(GpuProfiler &profiler, const vk::CommandBuffer &cmd, std::string_view name);
+            ~Scope();
+
+            Scope(const Scope &)            = delete;
+            Scope &operator=(const Scope &) = delete;
+
+          private:
+            GpuProfiler      &m_profiler;
+            vk::CommandBuffer m_cmd;
+            ScopeId           m_id;
+        };
+
+        GpuProfiler(const std::shared_ptr<Context> &context, uint32_t max_scopes = DEFAULT_GPU_PROFILER_MAX_SCOPES, uint32_t history = DEFAULT_GPU_PROFILER_HISTORY);
+
+        ~GpuProfiler();
+
+        // Called by the context once the frame which last used this slot has retired. Collects that frame's results and resets the slot's queries.
+        void begin_frame(uint32_t frame_index);
+
+        // Returns INVALID_SCOPE (and records nothing) if timestamps aren't supported or the frame has run out of queries.
+        ScopeId begin_scope(const vk::CommandBuffer &cmd, std::string_view name);
+        void    end_scope(const vk::CommandBuffer &cmd, ScopeId id);
+
+        // Scopes in the order they were first seen.
+        [[nodiscard]] std::vector<ScopeStats> stats() const;
+
+        // False if the graphics queue can't write timestamps, the profiler does nothing in that case.
+        [[nodiscard]] inline bool is_supported() const { return m_supported; };
+
+      private:
+        struct RecordedScope {
+            std::string name;
+            uint32_t    depth;
+            uint32_t    first_query;
+            bool        closed;
+        };
+
+        struct FrameSlot {
+            vk::QueryPool              pool;
+            uint32_t                   next_query = 0;
+            std::vector<RecordedScope> scopes;
+        };
+
+        struct History {
+            std::string       name;
+            uint32_t          depth;
+            std::deque<float> samples;
+        };
+
+        void resolve(FrameSlot &slot);
+
+        std::shared_ptr<Context> m_context;
+
+        bool     m_supported;
+        double   m_timestamp_period; // nanoseconds per tick
+        uint64_t m_timestamp_mask;
+        uint32_t m_max_scopes;
+        uint32_t m_history_length;
+
+        std::vector<FrameSlot> m_slots;
+        uint32_t               m_current_slot = 0;
+        uint32_t               m_depth        = 0;
+
+        mutable std::mutex   m_history_mutex;
+        std::vector<History> m_history;
+    };
+
+} // namespace kat
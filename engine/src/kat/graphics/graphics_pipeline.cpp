@@ -1,11 +1,180 @@
 #include "kat/graphics/graphics_pipeline.hpp"
 #include "graphics_pipeline.hpp"
 
+#include "kat/graphics/shader_watcher.hpp"
+#include "kat/util/hash.hpp"
+
+#include <vulkan/vulkan_format_traits.hpp>
+
+#include <algorithm>
 #include <iostream>
+#include <string_view>
+#include <utility>
 
 namespace kat {
+    namespace {
+        enum class NumericClass { FLOAT, SINT, UINT, OTHER };
+
+        // what the shader sees, normalized and scaled formats are read as floats whatever their size.
+        NumericClass numeric_class(vk::Format format) {
+            if (vk::componentCount(format) == 0)
+                return NumericClass::OTHER;
+
+            const std::string_view numeric = vk::componentNumericFormat(format, 0);
+            if (numeric == "SINT")
+                return NumericClass::SINT;
+            if (numeric == "UINT")
+                return NumericClass::UINT;
+            if (numeric == "SFLOAT" || numeric == "UFLOAT" || numeric == "UNORM" || numeric == "SNORM" || numeric == "USCALED" || numeric == "SSCALED" ||
+                numeric == "SRGB")
+                return NumericClass::FLOAT;
+            return NumericClass::OTHER;
+        }
+
+        bool is_compatible_descriptor(vk::DescriptorType reflected, vk::DescriptorType provided) {
+            // reflection can't tell dynamic buffers apart (see LayoutOverrides).
+            if (reflected == vk::DescriptorType::eUniformBuffer && provided == vk::DescriptorType::eUniformBufferDynamic)
+                return true;
+            if (reflected == vk::DescriptorType::eStorageBuffer && provided == vk::DescriptorType::eStorageBufferDynamic)
+                return true;
+            return reflected == provided;
+        }
+
+        // H is a Hasher or a KeyWriter, so the hashes and the keys the caches compare on a hit always cover the same things.
+        template <typename H>
+        void hash_stencil_op_state(H &h, const vk::StencilOpState &s) {
+            h.value(s.failOp).value(s.passOp).value(s.depthFailOp).value(s.compareOp).value(s.compareMask).value(s.writeMask).value(s.reference);
+        }
+
+        template <typename H>
+        void hash_descriptor_set_layout_description(H &h, const DescriptorSetLayout::Description &desc) {
+            h.value(desc.bindings.size());
+            for (const auto &b : desc.bindings) {
+                h.value(b.binding).value(b.descriptorType).value(b.descriptorCount).value(b.stageFlags);
+
+                // the samplers themselves rather than where they're stored, equal layouts often keep them in different arrays and a reused address can hold others.
+                h.value(b.pImmutableSamplers != nullptr);
+                if (b.pImmutableSamplers) {
+                    for (uint32_t i = 0; i < b.descriptorCount; i++) {
+                        const auto sampler = static_cast<VkSampler>(b.pImmutableSamplers[i]);
+                        h.bytes(&sampler, sizeof(VkSampler));
+                    }
+                }
+            }
+        }
+
+        template <typename H>
+        void hash_pipeline_layout_description(H &h, const PipelineLayout::Description &desc) {
+            h.value(desc.push_constant_ranges.size());
+            for (const auto &r : desc.push_constant_ranges) {
+                h.value(r.stageFlags).value(r.offset).value(r.size);
+            }
+
+            h.value(desc.descriptor_set_layouts.size());
+            for (const auto &l : desc.descriptor_set_layouts) {
+                hash_descriptor_set_layout_description(h, l->description());
+            }
+        }
+
+        template <typename H>
+        void hash_pipeline_description(H &h, const GraphicsPipeline::Description &desc) {
+            h.value(desc.shader_stages.size());
+            for (const auto &stage : desc.shader_stages) {
+                h.string(stage.shader_id.path).value(stage.stage).string(stage.entry_point);
+            }
+
+            h.value(desc.vertex_layout.bindings.size());
+            for (const auto &binding : desc.vertex_layout.bindings) {
+                h.value(binding.binding).value(binding.stride).value(binding.input_rate);
+                h.value(binding.attributes.size());
+                for (const auto &attrib : binding.attributes) {
+                    h.value(attrib.location).value(attrib.format).value(attrib.offset);
+                }
+            }
+
+            h.value(desc.primitive_state.topology).value(desc.primitive_state.enable_primitive_restart);
+
+            const auto &rs = desc.rasterizer_state;
+            h.value(rs.enable_depth_clamp).value(rs.discard_rasterizer_output).value(rs.polygon_mode).value(rs.line_width).value(rs.cull_mode).value(rs.front_face);
+            h.value(rs.enable_depth_bias).value(rs.depth_bias_constant_factor).value(rs.depth_bias_clamp).value(rs.depth_bias_slope_factor);
+
+            const auto &ms = desc.multisample_state;
+            h.value(ms.enable_sample_shading).value(ms.rasterization_samples).value(ms.min_sample_shading).value(ms.enable_alpha_to_coverage).value(ms.enable_alpha_to_one);
+            h.value(ms.sample_mask.size());
+            for (const auto &mask : ms.sample_mask) {
+                h.value(mask);
+            }
+
+            const auto &ds = desc.depth_stencil_state;
+            h.value(ds.enable_depth_test).value(ds.enable_depth_write).value(ds.depth_compare_op).value(ds.enable_depth_bounds_test).value(ds.enable_stencil_test);
+            hash_stencil_op_state(h, ds.stencil_front);
+            hash_stencil_op_state(h, ds.stencil_back);
+            h.value(ds.min_depth_bound).value(ds.max_depth_bound);
+
+            h.value(desc.blend_state.enable_logic_op).value(desc.blend_state.logic_op);
+            h.value(desc.blend_state.blend_attachments.size());
+            for (const auto &a : desc.blend_state.blend_attachments) {
+                h.value(a.blendEnable).value(a.srcColorBlendFactor).value(a.dstColorBlendFactor).value(a.colorBlendOp);
+                h.value(a.srcAlphaBlendFactor).value(a.dstAlphaBlendFactor).value(a.alphaBlendOp).value(a.colorWriteMask);
+            }
+            for (const auto &c : desc.blend_state.blend_constants) {
+                h.value(c);
+            }
+
+            h.value(desc.patch_control_points);
+
+            // viewports and scissors are ignored by the driver when they are dynamic state, so they shouldn't split otherwise identical pipelines.
+            const auto is_dynamic = [&](vk::DynamicState state) { return std::ranges::find(desc.dynamic_states, state) != desc.dynamic_states.end(); };
+
+            h.value(desc.viewports.size());
+            if (!is_dynamic(vk::DynamicState::eViewport)) {
+                for (const auto &v : desc.viewports) {
+                    h.value(v.x).value(v.y).value(v.width).value(v.height).value(v.minDepth).value(v.maxDepth);
+                }
+            }
+
+            h.value(desc.scissors.size());
+            if (!is_dynamic(vk::DynamicState::eScissor)) {
+                for (const auto &r : desc.scissors) {
+                    h.value(r.offset.x).value(r.offset.y).value(r.extent.width).value(r.extent.height);
+                }
+            }
+
+            h.value(desc.dynamic_states.size());
+            for (const auto &state : desc.dynamic_states) {
+                h.value(state);
+            }
+
+            hash_pipeline_layout_description(h, desc.layout->description());
+            h.string(desc.render_pass->description().compatibility_key()).value(desc.subpass);
+        }
+    } // namespace
+
+    uint64_t DescriptorSetLayout::Description::hash() const {
+        Hasher h;
+        hash_descriptor_set_layout_description(h, *this);
+        return h.digest();
+    }
 
-    PipelineLayout::PipelineLayout(const std::shared_ptr<Context> &context, const Description &desc) : m_context(context) {
+    std::string DescriptorSetLayout::Description::key() const {
+        KeyWriter k;
+        hash_descriptor_set_layout_description(k, *this);
+        return k.take();
+    }
+
+    uint64_t PipelineLayout::Description::hash() const {
+        Hasher h;
+        hash_pipeline_layout_description(h, *this);
+        return h.digest();
+    }
+
+    std::string PipelineLayout::Description::key() const {
+        KeyWriter k;
+        hash_pipeline_layout_description(k, *this);
+        return k.take();
+    }
+
+    PipelineLayout::PipelineLayout(const std::shared_ptr<Context> &context, const Description &desc) : m_context(context), m_description(desc) {
         vk::PipelineLayoutCreateInfo ci{};
         ci.setPushConstantRanges(desc.push_constant_ranges);
 
@@ -25,13 +194,56 @@ namespace kat {
         cmd.bindDescriptorSets(bind_point, m_pipeline_layout, first_set, sets.size(), sets.data(), dynamic_offsets.size(), dynamic_offsets.data());
     }
 
-    GraphicsPipeline::GraphicsPipeline(const std::shared_ptr<Context> &context, const Description &desc) : m_context(context) {
+    GraphicsPipeline::GraphicsPipeline(const std::shared_ptr<Context> &context, const Description &desc) : GraphicsPipeline(context, desc, context->pipeline_cache()) {}
+
+    GraphicsPipeline::GraphicsPipeline(const std::shared_ptr<Context> &context, const Description &desc, vk::PipelineCache pipeline_cache)
+        : m_context(context), m_description(desc) {
+        m_pipeline = build(pipeline_cache);
+
+        if (const auto &watcher = m_context->shader_watcher())
+            watcher->track(this);
+    }
+
+    GraphicsPipeline::~GraphicsPipeline() {
+        // untracked first, so a rebuild can't swap the handle while it's being destroyed.
+        if (const auto &watcher = m_context->shader_watcher())
+            watcher->untrack(this);
+
+        // command buffers which bound it may still be in flight.
+        m_context->defer_destroy(m_pipeline);
+    }
+
+    bool GraphicsPipeline::rebuild() {
+        validate_layout();
+
+        vk::Pipeline pipeline;
+        try {
+            pipeline = build(m_context->pipeline_cache());
+        } catch (const std::exception &e) {
+            std::cerr << "Warning: Failed to rebuild pipeline, keeping the old one: " << e.what() << std::endl;
+            return false;
+        }
+
+        // frames in flight may still be using the old one.
+        m_context->defer_destroy(std::exchange(m_pipeline, pipeline));
+        return true;
+    }
+
+    vk::Pipeline GraphicsPipeline::build(vk::PipelineCache pipeline_cache) const {
+        const auto &desc = m_description;
+
+        validate_vertex_layout();
+
         vk::GraphicsPipelineCreateInfo ci{};
 
+        // the modules can't be evicted from the cache until the pipeline has been created.
+        std::vector<ShaderModuleRef>                   modules;
         std::vector<vk::PipelineShaderStageCreateInfo> shader_stages;
+        modules.reserve(desc.shader_stages.size());
         shader_stages.reserve(desc.shader_stages.size());
         for (const auto &stage : desc.shader_stages) {
-            shader_stages.push_back(vk::PipelineShaderStageCreateInfo({}, stage.stage, m_context->shader_cache()->get(stage.shader_id), stage.entry_point.c_str()));
+            modules.push_back(m_context->shader_cache()->get(stage.shader_id));
+            shader_stages.push_back(vk::PipelineShaderStageCreateInfo({}, stage.stage, modules.back().handle(), stage.entry_point.c_str()));
         }
 
         vk::PipelineVertexInputStateCreateInfo vertex_input{};
@@ -114,7 +326,61 @@ namespace kat {
         ci.renderPass          = desc.render_pass->handle();
         ci.subpass             = desc.subpass;
 
-        m_pipeline = m_context->device().createGraphicsPipeline(m_context->pipeline_cache(), ci).value;
+        return m_context->device().createGraphicsPipeline(pipeline_cache, ci).value;
+    }
+
+    void GraphicsPipeline::validate_vertex_layout() const {
+        const auto stage = std::ranges::find(m_description.shader_stages, vk::ShaderStageFlagBits::eVertex, &ShaderStage::stage);
+        if (stage == m_description.shader_stages.end())
+            return;
+
+        for (const auto &input : m_context->shader_cache()->reflect(stage->shader_id).vertex_inputs) {
+            const VertexAttribute *attribute = nullptr;
+            for (const auto &binding : m_description.vertex_layout.bindings) {
+                if (const auto it = std::ranges::find(binding.attributes, input.location, &VertexAttribute::location); it != binding.attributes.end())
+                    attribute = &*it;
+            }
+
+            if (!attribute) {
+                std::cerr << "Warning: " << stage->shader_id.path << " reads location " << input.location << ", which the vertex layout doesn't provide." << std::endl;
+            } else if (numeric_class(attribute->format) != numeric_class(input.format) || vk::componentCount(attribute->format) != vk::componentCount(input.format)) {
+                // packed formats (R8G8B8A8_UNORM for a vec4, ...) are fine, only what the shader ends up reading has to match.
+                std::cerr << "Warning: " << stage->shader_id.path << " reads location " << input.location << " as " << vk::to_string(input.format)
+                          << ", but the vertex layout provides " << vk::to_string(attribute->format) << "." << std::endl;
+            }
+        }
+    }
+
+    void GraphicsPipeline::validate_layout() const {
+        const auto &layout = m_description.layout->description();
+
+        for (const auto &stage : m_description.shader_stages) {
+            const ShaderReflection reflection = m_context->shader_cache()->reflect(stage.shader_id);
+
+            for (const auto &b : reflection.bindings) {
+                const vk::DescriptorSetLayoutBinding *provided = nullptr;
+                if (b.set < layout.descriptor_set_layouts.size()) {
+                    const auto &bindings = layout.descriptor_set_layouts[b.set]->description().bindings;
+                    if (const auto it = std::ranges::find(bindings, b.binding, &vk::DescriptorSetLayoutBinding::binding); it != bindings.end())
+                        provided = &*it;
+                }
+
+                if (!provided || !is_compatible_descriptor(b.type, provided->descriptorType) || provided->descriptorCount < b.count ||
+                    !(provided->stageFlags & stage.stage)) {
+                    std::cerr << "Warning: " << stage.shader_id.path << " declares set " << b.set << " binding " << b.binding << " as " << vk::to_string(b.type)
+                              << ", which the pipeline layout doesn't match." << std::endl;
+                }
+            }
+
+            if (const auto &push = reflection.push_constants) {
+                const bool covered = std::ranges::any_of(layout.push_constant_ranges, [&](const vk::PushConstantRange &r) {
+                    return (r.stageFlags & stage.stage) && r.offset <= push->offset && push->offset + push->size <= r.offset + r.size;
+                });
+
+                if (!covered)
+                    std::cerr << "Warning: " << stage.shader_id.path << "'s push constants aren't covered by the pipeline layout." << std::endl;
+            }
+        }
     }
 
     void GraphicsPipeline::bind(const vk::CommandBuffer &cmd) const {
@@ -126,7 +392,19 @@ namespace kat {
         return *this;
     }
 
-    DescriptorSetLayout::DescriptorSetLayout(const std::shared_ptr<Context> &context, const Description &desc) : m_context(context) {
+    uint64_t GraphicsPipeline::Description::hash() const {
+        Hasher h;
+        hash_pipeline_description(h, *this);
+        return h.digest();
+    }
+
+    std::string GraphicsPipeline::Description::key() const {
+        KeyWriter k;
+        hash_pipeline_description(k, *this);
+        return k.take();
+    }
+
+    DescriptorSetLayout::DescriptorSetLayout(const std::shared_ptr<Context> &context, const Description &desc) : m_context(context), m_description(desc) {
         vk::DescriptorSetLayoutCreateInfo ci{};
         ci.setBindings(desc.bindings);
 
@@ -37,16 +37,24 @@ namespace kat {
       public:
         struct Description {
             std::vector<vk::DescriptorSetLayoutBinding> bindings;
+
+            [[nodiscard]] uint64_t hash() const;
+
+            // Covers the same as hash(), but equal only for equal descriptions (see KeyWriter).
+            [[nodiscard]] std::string key() const;
         };
 
         DescriptorSetLayout(const std::shared_ptr<Context> &context, const Description &desc);
 
         [[nodiscard]] inline vk::DescriptorSetLayout handle() const { return m_descriptor_set_layout; };
 
+        [[nodiscard]] inline const Description &description() const { return m_description; };
+
       private:
         std::shared_ptr<Context> m_context;
 
         vk::DescriptorSetLayout m_descriptor_set_layout;
+        Description             m_description;
     };
 
     class PipelineLayout {
@@ -57,12 +65,19 @@ namespace kat {
             std::vector<vk::PushConstantRange> push_constant_ranges;
 
             std::vector<std::shared_ptr<DescriptorSetLayout>> descriptor_set_layouts;
+
+            // Hashes the contents of the set layouts rather than their handles, identically defined layouts are interchangeable as far as pipelines are concerned.
+            [[nodiscard]] uint64_t hash() const;
+
+            [[nodiscard]] std::string key() const;
         };
 
         PipelineLayout(const std::shared_ptr<Context> &context, const Description &desc);
 
         [[nodiscard]] inline vk::PipelineLayout handle() const { return m_pipeline_layout; };
 
+        [[nodiscard]] inline const Description &description() const { return m_description; };
+
         void bind_descriptor_sets(const vk::CommandBuffer &cmd, const vk::PipelineBindPoint &bind_point, uint32_t first_set, const std::vector<vk::DescriptorSet> &sets,
                                   const std::vector<uint32_t> &dynamic_offsets) const;
 
@@ -70,6 +85,7 @@ namespace kat {
         std::shared_ptr<Context> m_context;
 
         vk::PipelineLayout m_pipeline_layout;
+        Description        m_description;
     };
 
     class DescriptorPool {
@@ -159,17 +175,45 @@ namespace kat {
             uint32_t                        subpass;
 
             Description &add_shader(const ShaderId &id, vk::ShaderStageFlagBits stage, const std::string &entry_point = "main");
+
+            // Stable hash over everything which affects the resulting vk::Pipeline.
+            [[nodiscard]] uint64_t hash() const;
+
+            // The same as a collision free key, which the PipelineRegistry deduplicates pipelines by.
+            [[nodiscard]] std::string key() const;
         };
 
         GraphicsPipeline(const std::shared_ptr<Context> &context, const Description &desc);
 
+        // Builds the pipeline against the given cache instead of the context's cache.
+        GraphicsPipeline(const std::shared_ptr<Context> &context, const Description &desc, vk::PipelineCache pipeline_cache);
+
+        ~GraphicsPipeline();
+
         [[nodiscard]] inline vk::Pipeline handle() const { return m_pipeline; };
 
+        [[nodiscard]] inline const Description &description() const { return m_description; };
+
         void bind(const vk::CommandBuffer &cmd) const;
 
+        // Recreates the pipeline from the current shader code (see ShaderWatcher). The old handle is destroyed once the frames in flight are done with it, so
+        // this has to be called on the render thread between frames. Keeps the old pipeline and returns false if the new one can't be built.
+        // The pipeline layout is kept as it is, descriptor sets have already been allocated against it. A reload which changes the shader's bindings or push
+        // constants is reported on cerr, and needs the pipeline to be recreated with a new layout.
+        bool rebuild();
+
       private:
+        [[nodiscard]] vk::Pipeline build(vk::PipelineCache pipeline_cache) const;
+
+        // Warns about vertex inputs of the vertex shader which the vertex layout doesn't provide, or provides as another numeric type or component count.
+        void validate_vertex_layout() const;
+
+        // Warns about bindings and push constants of the shaders which the pipeline layout doesn't provide.
+        void validate_layout() const;
+
         std::shared_ptr<Context> m_context;
 
         vk::Pipeline m_pipeline;
+        Description  m_description;
     };
 } // namespace kat
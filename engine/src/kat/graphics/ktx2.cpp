@@ -0,0 +1,427 @@
+#include "kat/graphics/ktx2.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+
+namespace kat {
+    namespace {
+        constexpr std::array<unsigned char, 12> KTX2_IDENTIFIER = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+
+        // identifier, 9 header fields and the index (dfd, kvd and sgd offsets and lengths).
+        constexpr size_t HEADER_SIZE      = 12 + 9 * 4 + 4 * 4 + 2 * 8;
+        constexpr size_t LEVEL_INDEX_SIZE = 3 * 8;
+
+        struct Header {
+            uint32_t vk_format;
+            uint32_t type_size;
+            uint32_t pixel_width;
+            uint32_t pixel_height;
+            uint32_t pixel_depth;
+            uint32_t layer_count;
+            uint32_t face_count;
+            uint32_t level_count;
+            uint32_t supercompression_scheme;
+        };
+
+        struct LevelIndex {
+            uint64_t byte_offset;
+            uint64_t byte_length;
+            uint64_t uncompressed_byte_length;
+        };
+
+        // data format descriptor color models and channel ids, from the khronos data format spec.
+        constexpr uint8_t DF_MODEL_RGBSDA = 1;
+        constexpr uint8_t DF_MODEL_BC1A   = 128;
+        constexpr uint8_t DF_MODEL_BC2    = 129;
+        constexpr uint8_t DF_MODEL_BC3    = 130;
+        constexpr uint8_t DF_MODEL_BC4    = 131;
+        constexpr uint8_t DF_MODEL_BC5    = 132;
+        constexpr uint8_t DF_MODEL_BC6H   = 133;
+        constexpr uint8_t DF_MODEL_BC7    = 134;
+
+        constexpr uint8_t DF_CHANNEL_RED   = 0;
+        constexpr uint8_t DF_CHANNEL_GREEN = 1;
+        constexpr uint8_t DF_CHANNEL_BLUE  = 2;
+        constexpr uint8_t DF_CHANNEL_ALPHA = 15;
+
+        constexpr uint8_t DF_SAMPLE_LINEAR = 0x10;
+        constexpr uint8_t DF_SAMPLE_SIGNED = 0x40;
+        constexpr uint8_t DF_SAMPLE_FLOAT  = 0x80;
+
+        constexpr uint8_t DF_TRANSFER_LINEAR = 1;
+        constexpr uint8_t DF_TRANSFER_SRGB   = 2;
+
+        struct Sample {
+            uint16_t bit_offset;
+            uint8_t  bit_length; // minus one
+            uint8_t  channel;
+            uint32_t lower;
+            uint32_t upper;
+        };
+
+        template <typename T>
+        void append(std::vector<unsigned char> &out, T value) {
+            const auto *p = reinterpret_cast<const unsigned char *>(&value);
+            out.insert(out.end(), p, p + sizeof(T));
+        }
+
+        bool is_srgb(vk::Format format) {
+            switch (format) {
+            case vk::Format::eR8Srgb:
+            case vk::Format::eR8G8Srgb:
+            case vk::Format::eR8G8B8Srgb:
+            case vk::Format::eB8G8R8Srgb:
+            case vk::Format::eR8G8B8A8Srgb:
+            case vk::Format::eB8G8R8A8Srgb:
+            case vk::Format::eBc1RgbSrgbBlock:
+            case vk::Format::eBc1RgbaSrgbBlock:
+            case vk::Format::eBc2SrgbBlock:
+            case vk::Format::eBc3SrgbBlock:
+            case vk::Format::eBc7SrgbBlock:
+                return true;
+            default:
+                return false;
+            }
+        }
+
+        // the color model and samples of the format's basic data format descriptor block.
+        std::optional<std::pair<uint8_t, std::vector<Sample>>> describe(vk::Format format) {
+            constexpr uint32_t FULL = 0xFFFFFFFF;
+
+            // compressed formats have one sample per 64 bit half of the block.
+            const auto bc = [](uint8_t model, std::initializer_list<uint8_t> channels, uint8_t qualifiers = 0) {
+                std::vector<Sample> samples;
+                uint16_t            offset = 0;
+                for (const uint8_t channel : channels) {
+                    samples.push_back(Sample{offset, 63, static_cast<uint8_t>(channel | qualifiers), 0, FULL});
+                    offset += 64;
+                }
+                return std::make_pair(model, samples);
+            };
+
+            const auto rgba = [&](std::initializer_list<uint8_t> channels) {
+                std::vector<Sample> samples;
+                uint16_t            offset = 0;
+                for (const uint8_t channel : channels) {
+                    // alpha is never gamma encoded.
+                    const uint8_t qualifiers = channel == DF_CHANNEL_ALPHA && is_srgb(format) ? DF_SAMPLE_LINEAR : 0;
+                    samples.push_back(Sample{offset, 7, static_cast<uint8_t>(channel | qualifiers), 0, 255});
+                    offset += 8;
+                }
+                return std::make_pair(DF_MODEL_RGBSDA, samples);
+            };
+
+            switch (format) {
+            case vk::Format::eR8Unorm:
+            case vk::Format::eR8Srgb:
+                return rgba({DF_CHANNEL_RED});
+            case vk::Format::eR8G8Unorm:
+            case vk::Format::eR8G8Srgb:
+                return rgba({DF_CHANNEL_RED, DF_CHANNEL_GREEN});
+            case vk::Format::eR8G8B8Unorm:
+            case vk::Format::eR8G8B8Srgb:
+                return rgba({DF_CHANNEL_RED, DF_CHANNEL_GREEN, DF_CHANNEL_BLUE});
+            case vk::Format::eB8G8R8Unorm:
+            case vk::Format::eB8G8R8Srgb:
+                return rgba({DF_CHANNEL_BLUE, DF_CHANNEL_GREEN, DF_CHANNEL_RED});
+            case vk::Format::eR8G8B8A8Unorm:
+            case vk::Format::eR8G8B8A8Srgb:
+                return rgba({DF_CHANNEL_RED, DF_CHANNEL_GREEN, DF_CHANNEL_BLUE, DF_CHANNEL_ALPHA});
+            case vk::Format::eB8G8R8A8Unorm:
+            case vk::Format::eB8G8R8A8Srgb:
+                return rgba({DF_CHANNEL_BLUE, DF_CHANNEL_GREEN, DF_CHANNEL_RED, DF_CHANNEL_ALPHA});
+            case vk::Format::eBc1RgbUnormBlock:
+            case vk::Format::eBc1RgbSrgbBlock:
+                return bc(DF_MODEL_BC1A, {0});
+            case vk::Format::eBc1RgbaUnormBlock:
+            case vk::Format::eBc1RgbaSrgbBlock:
+                return bc(DF_MODEL_BC1A, {1});
+            case vk::Format::eBc2UnormBlock:
+            case vk::Format::eBc2SrgbBlock:
+                return bc(DF_MODEL_BC2, {DF_CHANNEL_ALPHA, 0});
+            case vk::Format::eBc3UnormBlock:
+            case vk::Format::eBc3SrgbBlock:
+                return bc(DF_MODEL_BC3, {DF_CHANNEL_ALPHA, 0});
+            case vk::Format::eBc4UnormBlock:
+                return bc(DF_MODEL_BC4, {0});
+            case vk::Format::eBc4SnormBlock:
+                return bc(DF_MODEL_BC4, {0}, DF_SAMPLE_SIGNED);
+            case vk::Format::eBc5UnormBlock:
+                return bc(DF_MODEL_BC5, {DF_CHANNEL_RED, DF_CHANNEL_GREEN});
+            case vk::Format::eBc5SnormBlock:
+                return bc(DF_MODEL_BC5, {DF_CHANNEL_RED, DF_CHANNEL_GREEN}, DF_SAMPLE_SIGNED);
+            case vk::Format::eBc6HUfloatBlock:
+                return std::make_pair(DF_MODEL_BC6H, std::vector{Sample{0, 127, DF_SAMPLE_FLOAT, 0xBF800000, 0x7F800000}});
+            case vk::Format::eBc6HSfloatBlock:
+                return std::make_pair(DF_MODEL_BC6H, std::vector{Sample{0, 127, DF_SAMPLE_FLOAT | DF_SAMPLE_SIGNED, 0xBF800000, 0x7F800000}});
+            case vk::Format::eBc7UnormBlock:
+            case vk::Format::eBc7SrgbBlock:
+                return std::make_pair(DF_MODEL_BC7, std::vector{Sample{0, 127, 0, 0, FULL}});
+            default:
+                return std::nullopt;
+            }
+        }
+
+        const char *supercompression_name(uint32_t scheme) {
+            switch (scheme) {
+            case 1:
+                return "BasisLZ";
+            case 2:
+                return "zstd";
+            case 3:
+                return "zlib";
+            default:
+                return "unknown";
+            }
+        }
+    } // namespace
+
+    std::optional<FormatBlock> format_block(vk::Format format) {
+        switch (format) {
+        case vk::Format::eR8Unorm:
+        case vk::Format::eR8Srgb:
+            return FormatBlock{1, 1, 1};
+        case vk::Format::eR8G8Unorm:
+        case vk::Format::eR8G8Srgb:
+            return FormatBlock{1, 1, 2};
+        case vk::Format::eR8G8B8Unorm:
+        case vk::Format::eR8G8B8Srgb:
+        case vk::Format::eB8G8R8Unorm:
+        case vk::Format::eB8G8R8Srgb:
+            return FormatBlock{1, 1, 3};
+        case vk::Format::eR8G8B8A8Unorm:
+        case vk::Format::eR8G8B8A8Srgb:
+        case vk::Format::eB8G8R8A8Unorm:
+        case vk::Format::eB8G8R8A8Srgb:
+            return FormatBlock{1, 1, 4};
+        case vk::Format::eBc1RgbUnormBlock:
+        case vk::Format::eBc1RgbSrgbBlock:
+        case vk::Format::eBc1RgbaUnormBlock:
+        case vk::Format::eBc1RgbaSrgbBlock:
+        case vk::Format::eBc4UnormBlock:
+        case vk::Format::eBc4SnormBlock:
+            return FormatBlock{4, 4, 8};
+        case vk::Format::eBc2UnormBlock:
+        case vk::Format::eBc2SrgbBlock:
+        case vk::Format::eBc3UnormBlock:
+        case vk::Format::eBc3SrgbBlock:
+        case vk::Format::eBc5UnormBlock:
+        case vk::Format::eBc5SnormBlock:
+        case vk::Format::eBc6HUfloatBlock:
+        case vk::Format::eBc6HSfloatBlock:
+        case vk::Format::eBc7UnormBlock:
+        case vk::Format::eBc7SrgbBlock:
+            return FormatBlock{4, 4, 16};
+        default:
+            return std::nullopt;
+        }
+    }
+
+    bool is_block_compressed(vk::Format format) {
+        const auto block = format_block(format);
+        return block && block->width > 1;
+    }
+
+    bool is_ktx2(std::span<const unsigned char> bytes) {
+        return bytes.size() >= KTX2_IDENTIFIER.size() && std::equal(KTX2_IDENTIFIER.begin(), KTX2_IDENTIFIER.end(), bytes.begin());
+    }
+
+    std::optional<Ktx2Texture> parse_ktx2(std::span<const unsigned char> bytes) {
+        if (bytes.size() < HEADER_SIZE || !is_ktx2(bytes)) {
+            std::cerr << "Error: Not a KTX2 file." << std::endl;
+            return std::nullopt;
+        }
+
+        Header header{};
+        std::memcpy(&header, bytes.data() + KTX2_IDENTIFIER.size(), sizeof(Header));
+
+        if (header.supercompression_scheme != 0) {
+            std::cerr << "Error: KTX2 file is " << supercompression_name(header.supercompression_scheme)
+                      << " supercompressed, only files without supercompression can be loaded. Transcode it to a BCn format offline." << std::endl;
+            return std::nullopt;
+        }
+
+        const auto format = static_cast<vk::Format>(header.vk_format);
+        const auto block  = format_block(format);
+        if (!block) {
+            std::cerr << "Error: KTX2 file has an unsupported format (" << vk::to_string(format) << ")." << std::endl;
+            return std::nullopt;
+        }
+
+        if (header.pixel_width == 0 || header.pixel_height == 0 || header.pixel_depth > 1) {
+            std::cerr << "Error: Only 2d KTX2 textures are supported (" << header.pixel_width << "x" << header.pixel_height << "x" << header.pixel_depth << ")." << std::endl;
+            return std::nullopt;
+        }
+
+        if (header.face_count != 1 && header.face_count != 6) {
+            std::cerr << "Error: KTX2 file has an invalid face count (" << header.face_count << ")." << std::endl;
+            return std::nullopt;
+        }
+
+        if (header.face_count == 6 && header.pixel_width != header.pixel_height) {
+            std::cerr << "Error: KTX2 cubemap faces aren't square (" << header.pixel_width << "x" << header.pixel_height << ")." << std::endl;
+            return std::nullopt;
+        }
+
+        if (static_cast<uint64_t>(std::max(1u, header.layer_count)) * header.face_count > UINT32_MAX) {
+            std::cerr << "Error: KTX2 file has too many layers (" << header.layer_count << ")." << std::endl;
+            return std::nullopt;
+        }
+
+        // a level count of 0 asks the loader to generate mips, which compressed formats can't do, so only the base level is used.
+        const uint32_t level_count = std::max(1u, header.level_count);
+        if (level_count > static_cast<uint32_t>(std::bit_width(std::max(header.pixel_width, header.pixel_height)))) {
+            std::cerr << "Error: KTX2 file has more levels (" << level_count << ") than a " << header.pixel_width << "x" << header.pixel_height << " texture can have."
+                      << std::endl;
+            return std::nullopt;
+        }
+
+        if (bytes.size() < HEADER_SIZE + LEVEL_INDEX_SIZE * level_count) {
+            std::cerr << "Error: KTX2 file is truncated." << std::endl;
+            return std::nullopt;
+        }
+
+        Ktx2Texture texture{};
+        texture.format     = format;
+        texture.extent     = vk::Extent3D{header.pixel_width, header.pixel_height, 1};
+        texture.mip_levels = level_count;
+        texture.layers     = std::max(1u, header.layer_count);
+        texture.faces      = header.face_count;
+
+        std::vector<LevelIndex> levels(level_count);
+        std::memcpy(levels.data(), bytes.data() + HEADER_SIZE, LEVEL_INDEX_SIZE * level_count);
+
+        uint64_t data_begin = UINT64_MAX, data_end = 0;
+        for (uint32_t mip = 0; mip < level_count; mip++) {
+            const uint32_t width  = std::max(1u, header.pixel_width >> mip);
+            const uint32_t height = std::max(1u, header.pixel_height >> mip);
+
+            const uint64_t blocks = static_cast<uint64_t>((width + block->width - 1) / block->width) * ((height + block->height - 1) / block->height);
+            if (blocks > UINT64_MAX / block->bytes / texture.array_layers()) {
+                std::cerr << "Error: KTX2 file's level " << mip << " is too large." << std::endl;
+                return std::nullopt;
+            }
+            const uint64_t expected = blocks * block->bytes * texture.array_layers();
+
+            // written so that crafted offsets and lengths can't overflow past the check.
+            const auto &level = levels[mip];
+            if (level.byte_length < expected || level.byte_offset > bytes.size() || level.byte_length > bytes.size() - level.byte_offset) {
+                std::cerr << "Error: KTX2 file has an invalid or truncated level " << mip << "." << std::endl;
+                return std::nullopt;
+            }
+
+            data_begin = std::min(data_begin, level.byte_offset);
+            data_end   = std::max(data_end, level.byte_offset + level.byte_length);
+        }
+
+        texture.data = bytes.subspan(data_begin, data_end - data_begin);
+
+        for (uint32_t mip = 0; mip < level_count; mip++) {
+            // layers and faces of a level are stored one after the other, which is exactly how a multi layer copy reads them.
+            vk::BufferImageCopy copy{};
+            copy.bufferOffset                    = levels[mip].byte_offset - data_begin;
+            copy.imageSubresource.aspectMask     = vk::ImageAspectFlagBits::eColor;
+            copy.imageSubresource.mipLevel       = mip;
+            copy.imageSubresource.baseArrayLayer = 0;
+            copy.imageSubresource.layerCount     = texture.array_layers();
+            copy.imageExtent                     = vk::Extent3D{std::max(1u, header.pixel_width >> mip), std::max(1u, header.pixel_height >> mip), 1};
+            texture.regions.push_back(copy);
+        }
+
+        return texture;
+    }
+
+    bool write_ktx2(const std::filesystem::path &path, vk::Format format, vk::Extent2D extent, const std::vector<std::vector<unsigned char>> &levels) {
+        const auto block       = format_block(format);
+        const auto description = describe(format);
+        if (!block || !description) {
+            std::cerr << "Warning: Can't write " << vk::to_string(format) << " textures to KTX2." << std::endl;
+            return false;
+        }
+
+        const auto &[model, samples] = *description;
+        const auto  level_count      = static_cast<uint32_t>(levels.size());
+
+        // data format descriptor: the total size, then a single basic block.
+        std::vector<unsigned char> dfd;
+        const auto                 basic_size = static_cast<uint16_t>(24 + 16 * samples.size());
+        append<uint32_t>(dfd, 4 + basic_size);
+        append<uint32_t>(dfd, 0); // khronos vendor, basic descriptor type
+        append<uint16_t>(dfd, 2); // version 1.3
+        append<uint16_t>(dfd, basic_size);
+        append<uint8_t>(dfd, model);
+        append<uint8_t>(dfd, 1); // bt709 primaries
+        append<uint8_t>(dfd, is_srgb(format) ? DF_TRANSFER_SRGB : DF_TRANSFER_LINEAR);
+        append<uint8_t>(dfd, 0); // straight alpha
+        append<uint8_t>(dfd, static_cast<uint8_t>(block->width - 1));
+        append<uint8_t>(dfd, static_cast<uint8_t>(block->height - 1));
+        append<uint16_t>(dfd, 0);
+        append<uint8_t>(dfd, static_cast<uint8_t>(block->bytes));
+        dfd.insert(dfd.end(), 7, 0);
+        for (const auto &sample : samples) {
+            append<uint16_t>(dfd, sample.bit_offset);
+            append<uint8_t>(dfd, sample.bit_length);
+            append<uint8_t>(dfd, sample.channel);
+            append<uint32_t>(dfd, 0); // sample position
+            append<uint32_t>(dfd, sample.lower);
+            append<uint32_t>(dfd, sample.upper);
+        }
+
+        std::vector<unsigned char> kvd;
+        {
+            // a key and its value, both null terminated.
+            constexpr char writer[] = "KTXwriter\0katengine";
+            append<uint32_t>(kvd, sizeof(writer));
+            kvd.insert(kvd.end(), writer, writer + sizeof(writer));
+            kvd.resize((kvd.size() + 3) / 4 * 4, 0);
+        }
+
+        const uint64_t dfd_offset = HEADER_SIZE + LEVEL_INDEX_SIZE * level_count;
+        const uint64_t kvd_offset = dfd_offset + dfd.size();
+
+        // levels are stored smallest first, each aligned to the block size (and 4).
+        const uint64_t          alignment = std::lcm<uint64_t>(block->bytes, 4);
+        std::vector<LevelIndex> index(level_count);
+        uint64_t                offset = kvd_offset + kvd.size();
+        for (uint32_t i = level_count; i-- > 0;) {
+            offset   = (offset + alignment - 1) / alignment * alignment;
+            index[i] = LevelIndex{offset, levels[i].size(), levels[i].size()};
+            offset += levels[i].size();
+        }
+
+        std::vector<unsigned char> out;
+        out.reserve(offset);
+        out.insert(out.end(), KTX2_IDENTIFIER.begin(), KTX2_IDENTIFIER.end());
+        append(out, Header{static_cast<uint32_t>(format), 1, extent.width, extent.height, 0, 0, 1, level_count, 0});
+        append<uint32_t>(out, static_cast<uint32_t>(dfd_offset));
+        append<uint32_t>(out, static_cast<uint32_t>(dfd.size()));
+        append<uint32_t>(out, static_cast<uint32_t>(kvd_offset));
+        append<uint32_t>(out, static_cast<uint32_t>(kvd.size()));
+        append<uint64_t>(out, 0); // no supercompression global data
+        append<uint64_t>(out, 0);
+        for (const auto &level : index) {
+            append(out, level);
+        }
+
+        out.insert(out.end(), dfd.begin(), dfd.end());
+        out.insert(out.end(), kvd.begin(), kvd.end());
+        for (uint32_t i = level_count; i-- > 0;) {
+            out.resize(index[i].byte_offset, 0);
+            out.insert(out.end(), levels[i].begin(), levels[i].end());
+        }
+
+        std::ofstream file(path, std::ios::binary);
+        file.write(reinterpret_cast<const char *>(out.data()), static_cast<std::streamsize>(out.size()));
+        if (!file) {
+            std::cerr << "Warning: Failed to write " << path << "." << std::endl;
+            return false;
+        }
+
+        return true;
+    }
+} // namespace kat
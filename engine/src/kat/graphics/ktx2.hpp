@@ -0,0 +1,51 @@
+#pragma once
+
+#include "kat/util/util.hpp"
+
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace kat {
+
+    // The size of one texel block of a format, in texels and bytes. Uncompressed formats have 1x1 blocks.
+    struct FormatBlock {
+        uint32_t width;
+        uint32_t height;
+        uint32_t bytes;
+    };
+
+    // Only knows the formats the texture loaders deal with: 8 bit unorm/srgb and the BCn formats. Returns nullopt for anything else.
+    [[nodiscard]] std::optional<FormatBlock> format_block(vk::Format format);
+
+    [[nodiscard]] bool is_block_compressed(vk::Format format);
+
+    // A KTX2 texture, pointing into the bytes it was parsed from (which have to outlive it). Only files without supercompression can be read, BasisLZ and
+    // zstd supercompressed files have to be transcoded offline (ktxconvert or `ktx transcode`).
+    struct Ktx2Texture {
+        vk::Format   format;
+        vk::Extent3D extent;
+        uint32_t     mip_levels;
+        uint32_t     layers; // 1 for non-array textures
+        uint32_t     faces;  // 6 for cube maps
+
+        // every level, from the first level's offset to the end of the last one. The levels aren't necessarily stored in order.
+        std::span<const unsigned char> data;
+
+        // one per level, covering every layer and face of it. Buffer offsets are relative to data.
+        std::vector<vk::BufferImageCopy> regions;
+
+        [[nodiscard]] inline uint32_t array_layers() const { return layers * faces; };
+    };
+
+    // Reports what's wrong with the file on cerr and returns nullopt when it can't be used.
+    [[nodiscard]] std::optional<Ktx2Texture> parse_ktx2(std::span<const unsigned char> bytes);
+
+    // Writes a 2d texture with the given levels (largest first, each tightly packed) without supercompression. Only formats format_block() knows are supported.
+    bool write_ktx2(const std::filesystem::path &path, vk::Format format, vk::Extent2D extent, const std::vector<std::vector<unsigned char>> &levels);
+
+    // Checks for the KTX2 identifier.
+    [[nodiscard]] bool is_ktx2(std::span<const unsigned char> bytes);
+
+} // namespace kat
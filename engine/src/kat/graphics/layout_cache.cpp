@@ -0,0 +1,103 @@
+#include "kat/graphics/layout_cache.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <ranges>
+
+namespace kat {
+    LayoutCache::LayoutCache(const std::shared_ptr<Context> &context) : m_context(context) {}
+
+    std::shared_ptr<DescriptorSetLayout> LayoutCache::get_set_layout(const DescriptorSetLayout::Description &desc) {
+        std::lock_guard lock(m_mutex);
+
+        // layouts are cheap to create, unlike pipelines there's no point in building them outside of the lock.
+        auto &entry = m_set_layouts[desc.key()];
+        if (auto layout = entry.lock())
+            return layout;
+
+        auto layout = std::make_shared<DescriptorSetLayout>(m_context, desc);
+        entry       = layout;
+        return layout;
+    }
+
+    std::shared_ptr<PipelineLayout> LayoutCache::get_pipeline_layout(const PipelineLayout::Description &desc) {
+        std::lock_guard lock(m_mutex);
+
+        auto &entry = m_pipeline_layouts[desc.key()];
+        if (auto layout = entry.lock())
+            return layout;
+
+        auto layout = std::make_shared<PipelineLayout>(m_context, desc);
+        entry       = layout;
+        return layout;
+    }
+
+    std::shared_ptr<PipelineLayout> LayoutCache::get_reflected(std::span<const ShaderStage> stages, const LayoutOverrides &overrides) {
+        // by set, then binding.
+        std::map<uint32_t, std::map<uint32_t, vk::DescriptorSetLayoutBinding>> sets;
+        std::optional<vk::PushConstantRange>                                   push_constants;
+
+        for (const auto &stage : stages) {
+            const ShaderReflection reflection = m_context->shader_cache()->reflect(stage.shader_id);
+
+            for (const auto &b : reflection.bindings) {
+                const bool dynamic = std::ranges::contains(overrides.dynamic_buffers, std::pair(b.set, b.binding));
+
+                vk::DescriptorType type = b.type;
+                if (dynamic && type == vk::DescriptorType::eUniformBuffer)
+                    type = vk::DescriptorType::eUniformBufferDynamic;
+                else if (dynamic && type == vk::DescriptorType::eStorageBuffer)
+                    type = vk::DescriptorType::eStorageBufferDynamic;
+
+                auto [it, inserted] = sets[b.set].try_emplace(b.binding, b.binding, type, b.count, stage.stage);
+                if (inserted)
+                    continue;
+
+                if (it->second.descriptorType != type) {
+                    std::cerr << "Warning: " << stage.shader_id.path << " declares set " << b.set << " binding " << b.binding << " as " << vk::to_string(type)
+                              << ", but another stage declares it as " << vk::to_string(it->second.descriptorType) << "." << std::endl;
+                }
+                it->second.stageFlags |= stage.stage;
+                it->second.descriptorCount = std::max(it->second.descriptorCount, b.count);
+            }
+
+            if (reflection.push_constants) {
+                const auto &range = *reflection.push_constants;
+                if (!push_constants) {
+                    push_constants = vk::PushConstantRange(stage.stage, range.offset, range.size);
+                } else {
+                    const uint32_t end         = std::max(push_constants->offset + push_constants->size, range.offset + range.size);
+                    push_constants->offset     = std::min(push_constants->offset, range.offset);
+                    push_constants->size       = end - push_constants->offset;
+                    push_constants->stageFlags |= stage.stage;
+                }
+            }
+        }
+
+        PipelineLayout::Description desc{};
+        if (push_constants)
+            desc.push_constant_ranges = {*push_constants};
+
+        const uint32_t set_count = sets.empty() ? 0 : sets.rbegin()->first + 1;
+        for (uint32_t set = 0; set < set_count; set++) {
+            DescriptorSetLayout::Description set_desc{};
+            if (const auto it = sets.find(set); it != sets.end()) {
+                for (const auto &binding : it->second | std::views::values) {
+                    set_desc.bindings.push_back(binding);
+                }
+            }
+
+            desc.descriptor_set_layouts.push_back(get_set_layout(set_desc));
+        }
+
+        return get_pipeline_layout(desc);
+    }
+
+    void LayoutCache::prune() {
+        std::lock_guard lock(m_mutex);
+        std::erase_if(m_set_layouts, [](const auto &entry) { return entry.second.expired(); });
+        std::erase_if(m_pipeline_layouts, [](const auto &entry) { return entry.second.expired(); });
+    }
+} // namespace kat
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "kat/graphics/context.hpp"
+#include "kat/graphics/graphics_pipeline.hpp"
+
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace kat {
+
+    // What reflection can't tell from spirv alone.
+    struct LayoutOverrides {
+        // (set, binding) pairs of buffers which are bound with dynamic offsets.
+        std::vector<std::pair<uint32_t, uint32_t>> dynamic_buffers;
+    };
+
+    // Deduplicates descriptor set and pipeline layouts by their description (see DescriptorSetLayout::Description::key()), and derives pipeline layouts from the
+    // reflected shaders of a pipeline so they can't disagree with the glsl. Like the PipelineRegistry, only weak references are held.
+    class LayoutCache {
+      public:
+        explicit LayoutCache(const std::shared_ptr<Context> &context);
+
+        [[nodiscard]] std::shared_ptr<DescriptorSetLayout> get_set_layout(const DescriptorSetLayout::Description &desc);
+
+        [[nodiscard]] std::shared_ptr<PipelineLayout> get_pipeline_layout(const PipelineLayout::Description &desc);
+
+        // Merges the reflection of every stage: a binding gets the stage flags of every stage declaring it, and the push constants become a single range
+        // covering every stage's. Sets nothing is bound to in between used ones get empty layouts.
+        [[nodiscard]] std::shared_ptr<PipelineLayout> get_reflected(std::span<const ShaderStage> stages, const LayoutOverrides &overrides = {});
+
+        // Drops entries for layouts which have been destroyed.
+        void prune();
+
+      private:
+        std::shared_ptr<Context> m_context;
+
+        std::mutex                                                         m_mutex;
+        std::unordered_map<std::string, std::weak_ptr<DescriptorSetLayout>> m_set_layouts;
+        std::unordered_map<std::string, std::weak_ptr<PipelineLayout>>      m_pipeline_layouts;
+    };
+
+} // namespace kat
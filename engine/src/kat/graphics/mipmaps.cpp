@@ -0,0 +1,250 @@
+#include "kat/graphics/mipmaps.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <numbers>
+#include <numeric>
+
+namespace kat {
+    namespace {
+        struct Kernel {
+            // taps relative to the center of the 2 source texels a destination texel covers, the first one sits at -(size/2) + 1.
+            std::vector<float> weights;
+        };
+
+        float bessel_i0(float x) {
+            // power series, converges quickly for the alphas used here.
+            float sum = 1.0f, term = 1.0f;
+            for (int k = 1; k < 20; k++) {
+                term *= (x / (2.0f * static_cast<float>(k))) * (x / (2.0f * static_cast<float>(k)));
+                sum += term;
+            }
+            return sum;
+        }
+
+        Kernel make_kernel(MipFilter filter) {
+            if (filter == MipFilter::BOX)
+                return Kernel{{0.5f, 0.5f}};
+
+            // 6 taps of a sinc cut off at half the source frequency, windowed with a kaiser window.
+            constexpr int   TAPS  = 6;
+            constexpr float ALPHA = 4.0f;
+            constexpr float WIDTH = TAPS / 2.0f;
+
+            Kernel kernel;
+            float  total = 0.0f;
+            for (int i = 0; i < TAPS; i++) {
+                const float d      = static_cast<float>(i - TAPS / 2) + 0.5f; // distance from the center in source texels
+                const float x      = d * 0.5f;
+                const float sinc   = std::sin(std::numbers::pi_v<float> * x) / (std::numbers::pi_v<float> * x);
+                const float r      = d / WIDTH;
+                const float window = bessel_i0(ALPHA * std::sqrt(std::max(0.0f, 1.0f - r * r))) / bessel_i0(ALPHA);
+
+                kernel.weights.push_back(sinc * window);
+                total += sinc * window;
+            }
+
+            for (auto &w : kernel.weights) {
+                w /= total;
+            }
+
+            return kernel;
+        }
+
+        // filters one axis down to dst_size, the other axis is left alone.
+        std::vector<float> downsample(const std::vector<float> &src, uint32_t width, uint32_t height, uint32_t channels, bool horizontal, uint32_t dst_size,
+                                      const Kernel &kernel) {
+            const uint32_t dst_width  = horizontal ? dst_size : width;
+            const uint32_t dst_height = horizontal ? height : dst_size;
+            const int      src_size   = static_cast<int>(horizontal ? width : height);
+            const int      first_tap  = 1 - static_cast<int>(kernel.weights.size()) / 2;
+
+            std::vector<float> dst(static_cast<size_t>(dst_width) * dst_height * channels, 0.0f);
+
+            for (uint32_t y = 0; y < dst_height; y++) {
+                for (uint32_t x = 0; x < dst_width; x++) {
+                    float *out = &dst[(static_cast<size_t>(y) * dst_width + x) * channels];
+
+                    for (size_t t = 0; t < kernel.weights.size(); t++) {
+                        // edges are clamped, odd sizes just lose the last row/column's share of the average.
+                        const int base = 2 * static_cast<int>(horizontal ? x : y) + first_tap + static_cast<int>(t);
+                        const int s    = std::clamp(base, 0, src_size - 1);
+
+                        const uint32_t sx = horizontal ? static_cast<uint32_t>(s) : x;
+                        const uint32_t sy = horizontal ? y : static_cast<uint32_t>(s);
+
+                        const float *in = &src[(static_cast<size_t>(sy) * width + sx) * channels];
+                        for (uint32_t c = 0; c < channels; c++) {
+                            out[c] += in[c] * kernel.weights[t];
+                        }
+                    }
+                }
+            }
+
+            return dst;
+        }
+
+        bool is_srgb(vk::Format format) {
+            switch (format) {
+            case vk::Format::eR8Srgb:
+            case vk::Format::eR8G8Srgb:
+            case vk::Format::eR8G8B8Srgb:
+            case vk::Format::eB8G8R8Srgb:
+            case vk::Format::eR8G8B8A8Srgb:
+            case vk::Format::eB8G8R8A8Srgb:
+                return true;
+            default:
+                return false;
+            }
+        }
+
+        float srgb_to_linear(float v) {
+            return v <= 0.04045f ? v / 12.92f : std::pow((v + 0.055f) / 1.055f, 2.4f);
+        }
+
+        float linear_to_srgb(float v) {
+            return v <= 0.0031308f ? v * 12.92f : 1.055f * std::pow(v, 1.0f / 2.4f) - 0.055f;
+        }
+    } // namespace
+
+    uint32_t mip_level_count(vk::Extent2D extent) {
+        return std::bit_width(std::max(extent.width, extent.height));
+    }
+
+    bool supports_linear_blit(vk::PhysicalDevice physical_device, vk::Format format) {
+        const auto features = physical_device.getFormatProperties(format).optimalTilingFeatures;
+        return (features & vk::FormatFeatureFlagBits::eBlitSrc) && (features & vk::FormatFeatureFlagBits::eBlitDst) &&
+               (features & vk::FormatFeatureFlagBits::eSampledImageFilterLinear);
+    }
+
+    bool supports_cpu_mip_generation(vk::Format format) {
+        switch (format) {
+        case vk::Format::eR8Unorm:
+        case vk::Format::eR8G8Unorm:
+        case vk::Format::eR8G8B8Unorm:
+        case vk::Format::eB8G8R8Unorm:
+        case vk::Format::eR8G8B8A8Unorm:
+        case vk::Format::eB8G8R8A8Unorm:
+            return true;
+        default:
+            return is_srgb(format);
+        }
+    }
+
+    std::optional<MipChain> generate_mip_chain(const unsigned char *data, vk::Extent2D extent, uint32_t pixel_size, vk::Format format, uint32_t mip_levels,
+                                               MipFilter filter) {
+        if (!supports_cpu_mip_generation(format))
+            return std::nullopt;
+
+        // one byte per channel. The alpha channel (the 4th, or the 2nd of a two channel srgb format) is never gamma encoded.
+        const uint32_t channels    = pixel_size;
+        const bool     srgb        = is_srgb(format);
+        const uint32_t alpha_index = channels == 4 || channels == 2 ? channels - 1 : channels;
+        const Kernel   kernel      = make_kernel(filter);
+
+        std::array<float, 256> to_float{};
+        for (uint32_t i = 0; i < 256; i++) {
+            to_float[i] = static_cast<float>(i) / 255.0f;
+        }
+
+        std::array<float, 256> to_linear{};
+        for (uint32_t i = 0; i < 256; i++) {
+            to_linear[i] = srgb_to_linear(to_float[i]);
+        }
+
+        MipChain chain;
+
+        uint32_t width  = extent.width;
+        uint32_t height = extent.height;
+
+        // level 0 is copied as is, the rest are filtered from the previous level at full precision.
+        const size_t level0_size = static_cast<size_t>(width) * height * pixel_size;
+        chain.data.assign(data, data + level0_size);
+
+        std::vector<float> level(static_cast<size_t>(width) * height * channels);
+        for (size_t i = 0; i < level.size(); i++) {
+            const bool gamma = srgb && i % channels != alpha_index;
+            level[i]         = gamma ? to_linear[data[i]] : to_float[data[i]];
+        }
+
+        const auto add_region = [&](uint32_t mip, vk::DeviceSize offset, uint32_t w, uint32_t h) {
+            vk::BufferImageCopy copy{};
+            copy.bufferOffset                    = offset;
+            copy.imageSubresource.aspectMask     = vk::ImageAspectFlagBits::eColor;
+            copy.imageSubresource.mipLevel       = mip;
+            copy.imageSubresource.baseArrayLayer = 0;
+            copy.imageSubresource.layerCount     = 1;
+            copy.imageExtent                     = vk::Extent3D{w, h, 1};
+            chain.regions.push_back(copy);
+        };
+
+        add_region(0, 0, width, height);
+
+        for (uint32_t mip = 1; mip < mip_levels; mip++) {
+            const uint32_t new_width  = std::max(1u, width / 2);
+            const uint32_t new_height = std::max(1u, height / 2);
+
+            if (new_width != width)
+                level = downsample(level, width, height, channels, true, new_width, kernel);
+            if (new_height != height)
+                level = downsample(level, new_width, height, channels, false, new_height, kernel);
+
+            width  = new_width;
+            height = new_height;
+
+            // copy regions have to start on a multiple of 4 (and of the texel size).
+            const size_t alignment = std::lcm<size_t>(4, pixel_size);
+            const size_t offset    = (chain.data.size() + alignment - 1) / alignment * alignment;
+            chain.data.resize(offset + level.size());
+
+            for (size_t i = 0; i < level.size(); i++) {
+                const bool  gamma = srgb && i % channels != alpha_index;
+                const float v     = std::clamp(gamma ? linear_to_srgb(level[i]) : level[i], 0.0f, 1.0f);
+                chain.data[offset + i] = static_cast<unsigned char>(std::lround(v * 255.0f));
+            }
+
+            add_region(mip, offset, width, height);
+        }
+
+        return chain;
+    }
+
+    void record_mip_generation(const vk::CommandBuffer &cmd, vk::Image image, vk::Extent2D extent, uint32_t mip_levels, vk::ImageLayout final_layout) {
+        const auto level_range = [](uint32_t mip) { return vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, mip, 1, 0, 1); };
+
+        int32_t width  = static_cast<int32_t>(extent.width);
+        int32_t height = static_cast<int32_t>(extent.height);
+
+        for (uint32_t mip = 1; mip < mip_levels; mip++) {
+            // the previous level was just written (by the upload or the last blit), and is read from now on.
+            cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer, {}, {}, {},
+                                vk::ImageMemoryBarrier(vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eTransferRead, vk::ImageLayout::eTransferDstOptimal,
+                                                       vk::ImageLayout::eTransferSrcOptimal, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, image, level_range(mip - 1)));
+
+            const int32_t new_width  = std::max(1, width / 2);
+            const int32_t new_height = std::max(1, height / 2);
+
+            vk::ImageBlit blit{};
+            blit.srcSubresource = vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, mip - 1, 0, 1);
+            blit.srcOffsets[1]  = vk::Offset3D{width, height, 1};
+            blit.dstSubresource = vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, mip, 0, 1);
+            blit.dstOffsets[1]  = vk::Offset3D{new_width, new_height, 1};
+
+            cmd.blitImage(image, vk::ImageLayout::eTransferSrcOptimal, image, vk::ImageLayout::eTransferDstOptimal, blit, vk::Filter::eLinear);
+
+            cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eAllCommands, {}, {}, {},
+                                vk::ImageMemoryBarrier(vk::AccessFlagBits::eTransferRead, vk::AccessFlagBits::eMemoryRead, vk::ImageLayout::eTransferSrcOptimal, final_layout,
+                                                       VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, image, level_range(mip - 1)));
+
+            width  = new_width;
+            height = new_height;
+        }
+
+        // the last level is only ever written.
+        cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eAllCommands, {}, {}, {},
+                            vk::ImageMemoryBarrier(vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eMemoryRead, vk::ImageLayout::eTransferDstOptimal, final_layout,
+                                                   VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, image, level_range(mip_levels - 1)));
+    }
+} // namespace kat
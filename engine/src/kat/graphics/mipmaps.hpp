@@ -0,0 +1,39 @@
+#pragma once
+
+#include "kat/util/util.hpp"
+
+#include <optional>
+#include <vector>
+
+namespace kat {
+
+    enum class MipFilter {
+        BOX,    // 2x2 average, fast
+        KAISER, // kaiser windowed sinc, keeps distant detail sharper at the cost of a wider kernel
+    };
+
+    // A complete mip chain packed level after level, ready for UploadBatch::upload_image().
+    struct MipChain {
+        std::vector<unsigned char>       data;
+        std::vector<vk::BufferImageCopy> regions; // one per level, buffer offsets are relative to data
+    };
+
+    // The number of levels in a full mip chain, down to 1x1.
+    [[nodiscard]] uint32_t mip_level_count(vk::Extent2D extent);
+
+    // Whether the format can be used as both source and destination of linear blits with optimal tiling, which is what gpu mip generation needs.
+    [[nodiscard]] bool supports_linear_blit(vk::PhysicalDevice physical_device, vk::Format format);
+
+    // Whether generate_mip_chain() can handle the format (8 bit unorm and srgb formats).
+    [[nodiscard]] bool supports_cpu_mip_generation(vk::Format format);
+
+    // Downsamples a tightly packed 2d image on the cpu, for formats which can't be blitted. sRGB formats are filtered in linear space. Returns nullopt when the
+    // format isn't supported.
+    [[nodiscard]] std::optional<MipChain> generate_mip_chain(const unsigned char *data, vk::Extent2D extent, uint32_t pixel_size, vk::Format format, uint32_t mip_levels,
+                                                             MipFilter filter = MipFilter::BOX);
+
+    // Records blits filling levels 1 and up of a 2d image from level 0. Every level has to be in eTransferDstOptimal with level 0 already written, and they all end
+    // up in final_layout. Needs a queue with graphics support.
+    void record_mip_generation(const vk::CommandBuffer &cmd, vk::Image image, vk::Extent2D extent, uint32_t mip_levels, vk::ImageLayout final_layout);
+
+} // namespace kat
@@ -0,0 +1,76 @@
+#include "kat/graphics/pipeline_compiler.hpp"
+
+#include <iostream>
+
+namespace kat {
+    AsyncGraphicsPipeline::AsyncGraphicsPipeline(std::shared_ptr<GraphicsPipeline> placeholder) : m_placeholder(std::move(placeholder)) {}
+
+    std::shared_ptr<AsyncGraphicsPipeline> AsyncGraphicsPipeline::completed(std::shared_ptr<GraphicsPipeline> pipeline) {
+        auto async_pipeline = std::make_shared<AsyncGraphicsPipeline>(nullptr);
+        async_pipeline->finish(std::move(pipeline));
+        return async_pipeline;
+    }
+
+    std::shared_ptr<GraphicsPipeline> AsyncGraphicsPipeline::get() const {
+        if (is_ready())
+            return m_pipeline;
+        return m_placeholder;
+    }
+
+    void AsyncGraphicsPipeline::wait() const {
+        m_state.wait(State::PENDING, std::memory_order_acquire);
+    }
+
+    bool AsyncGraphicsPipeline::bind(const vk::CommandBuffer &cmd) const {
+        const auto pipeline = get();
+        if (!pipeline)
+            return false;
+
+        pipeline->bind(cmd);
+        return true;
+    }
+
+    void AsyncGraphicsPipeline::finish(std::shared_ptr<GraphicsPipeline> pipeline) {
+        m_pipeline = std::move(pipeline);
+        m_state.store(m_pipeline ? State::READY : State::FAILED, std::memory_order_release);
+        m_state.notify_all();
+    }
+
+    PipelineCompiler::PipelineCompiler(const std::shared_ptr<Context> &context, uint32_t thread_count)
+        : m_context(context), m_thread_pool(thread_count == 0 ? ThreadPool::default_thread_count() : thread_count) {}
+
+    PipelineCompiler::~PipelineCompiler() {
+        shutdown();
+    }
+
+    std::shared_ptr<AsyncGraphicsPipeline> PipelineCompiler::compile(const GraphicsPipeline::Description &desc, std::shared_ptr<GraphicsPipeline> placeholder,
+                                                                     ReadyCallback on_ready) {
+        auto async_pipeline = std::make_shared<AsyncGraphicsPipeline>(std::move(placeholder));
+
+        // the description is copied into the task, which also keeps the layout and render pass alive until the pipeline has been built.
+        m_thread_pool.submit([this, desc, async_pipeline, on_ready = std::move(on_ready)](uint32_t) {
+            std::shared_ptr<GraphicsPipeline> pipeline;
+            try {
+                // the shared cache is internally synchronized, and it's the one loaded from disk, so background compiles still start warm.
+                pipeline = std::make_shared<GraphicsPipeline>(m_context, desc, m_context->pipeline_cache());
+            } catch (const std::exception &e) {
+                std::cerr << "Error: Failed to compile graphics pipeline: " << e.what() << std::endl;
+            }
+
+            if (pipeline && on_ready)
+                on_ready(pipeline);
+
+            async_pipeline->finish(std::move(pipeline));
+        });
+
+        return async_pipeline;
+    }
+
+    void PipelineCompiler::shutdown() {
+        if (m_shut_down)
+            return;
+        m_shut_down = true;
+
+        m_thread_pool.shutdown();
+    }
+} // namespace kat
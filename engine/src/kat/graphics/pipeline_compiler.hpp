@@ -0,0 +1,75 @@
+#pragma once
+
+#include "kat/graphics/context.hpp"
+#include "kat/graphics/graphics_pipeline.hpp"
+#include "kat/util/thread_pool.hpp"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+
+namespace kat {
+
+    // A graphics pipeline which is being compiled in the background. Until compilation finishes, the placeholder pipeline (if any) is used instead.
+    class AsyncGraphicsPipeline {
+      public:
+        enum class State : uint32_t { PENDING, READY, FAILED };
+
+        explicit AsyncGraphicsPipeline(std::shared_ptr<GraphicsPipeline> placeholder);
+
+        // Wraps a pipeline which already exists, so callers holding an AsyncGraphicsPipeline don't need to care whether it was compiled or reused.
+        [[nodiscard]] static std::shared_ptr<AsyncGraphicsPipeline> completed(std::shared_ptr<GraphicsPipeline> pipeline);
+
+        [[nodiscard]] inline State state() const { return m_state.load(std::memory_order_acquire); };
+
+        [[nodiscard]] inline bool is_ready() const { return state() == State::READY; };
+
+        [[nodiscard]] inline bool is_done() const { return state() != State::PENDING; };
+
+        // The compiled pipeline if it's ready, otherwise the placeholder (which may be null).
+        [[nodiscard]] std::shared_ptr<GraphicsPipeline> get() const;
+
+        [[nodiscard]] inline const std::shared_ptr<GraphicsPipeline> &placeholder() const { return m_placeholder; };
+
+        // Blocks until compilation finishes (successfully or not).
+        void wait() const;
+
+        // Binds the compiled pipeline, or the placeholder if compilation hasn't finished. Returns false (and binds nothing) if neither is available, in which case the
+        // caller should skip the draws which depend on this pipeline.
+        bool bind(const vk::CommandBuffer &cmd) const;
+
+      private:
+        friend class PipelineCompiler;
+
+        void finish(std::shared_ptr<GraphicsPipeline> pipeline);
+
+        std::shared_ptr<GraphicsPipeline> m_placeholder;
+        std::shared_ptr<GraphicsPipeline> m_pipeline; // only written once, before m_state is released.
+        std::atomic<State>                m_state = State::PENDING;
+    };
+
+    // Compiles graphics pipelines on a pool of worker threads so that creating new pipelines mid-session doesn't stall the render thread.
+    // The workers build against the context's pipeline cache, so they hit what was loaded from disk and their results are saved with it.
+    class PipelineCompiler {
+      public:
+        explicit PipelineCompiler(const std::shared_ptr<Context> &context, uint32_t thread_count = 0);
+
+        ~PipelineCompiler();
+
+        using ReadyCallback = std::function<void(const std::shared_ptr<GraphicsPipeline> &)>;
+
+        // on_ready is called on the worker thread once the pipeline has been built successfully, before the AsyncGraphicsPipeline is marked as ready.
+        [[nodiscard]] std::shared_ptr<AsyncGraphicsPipeline> compile(const GraphicsPipeline::Description &desc, std::shared_ptr<GraphicsPipeline> placeholder = nullptr,
+                                                                     ReadyCallback on_ready = {});
+
+        // Finishes any queued compilations and stops the workers.
+        void shutdown();
+
+      private:
+        std::shared_ptr<Context> m_context;
+
+        ThreadPool m_thread_pool;
+        bool       m_shut_down = false;
+    };
+
+} // namespace kat
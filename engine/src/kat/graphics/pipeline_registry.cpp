@@ -0,0 +1,81 @@
+#include "kat/graphics/pipeline_registry.hpp"
+
+#include <algorithm>
+
+namespace kat {
+    PipelineRegistry::PipelineRegistry(const std::shared_ptr<Context> &context) : m_context(context) {}
+
+    std::shared_ptr<GraphicsPipeline> PipelineRegistry::get_or_create(const GraphicsPipeline::Description &desc) {
+        const std::string key = desc.key();
+
+        std::shared_ptr<AsyncGraphicsPipeline> pending;
+        {
+            std::lock_guard lock(m_mutex);
+            if (auto it = m_pipelines.find(key); it != m_pipelines.end()) {
+                if (auto pipeline = it->second.lock())
+                    return pipeline;
+            }
+
+            if (auto it = m_pending.find(key); it != m_pending.end()) {
+                pending = it->second.lock();
+            }
+        }
+
+        // someone is already compiling this one in the background, waiting for it is cheaper than compiling it twice.
+        if (pending) {
+            pending->wait();
+            if (pending->is_ready())
+                return pending->get();
+        }
+
+        // built without holding the lock, building a pipeline can take a while and other threads shouldn't have to wait on unrelated pipelines.
+        auto pipeline = std::make_shared<GraphicsPipeline>(m_context, desc);
+
+        std::lock_guard lock(m_mutex);
+        auto           &entry = m_pipelines[key];
+        if (auto existing = entry.lock()) {
+            // lost the race to another thread, use theirs so there is only ever one live pipeline per description.
+            return existing;
+        }
+
+        entry = pipeline;
+        return pipeline;
+    }
+
+    std::shared_ptr<AsyncGraphicsPipeline> PipelineRegistry::get_or_compile(const GraphicsPipeline::Description &desc, std::shared_ptr<GraphicsPipeline> placeholder) {
+        const std::string key = desc.key();
+
+        std::lock_guard lock(m_mutex);
+        if (auto it = m_pipelines.find(key); it != m_pipelines.end()) {
+            if (auto pipeline = it->second.lock())
+                return AsyncGraphicsPipeline::completed(std::move(pipeline));
+        }
+
+        auto &entry = m_pending[key];
+        if (auto existing = entry.lock()) {
+            if (existing->state() != AsyncGraphicsPipeline::State::FAILED)
+                return existing;
+        }
+
+        auto async_pipeline = m_context->pipeline_compiler()->compile(desc, std::move(placeholder), [this, key](const std::shared_ptr<GraphicsPipeline> &pipeline) {
+            std::lock_guard lock(m_mutex);
+            auto           &e = m_pipelines[key];
+            if (e.expired())
+                e = pipeline;
+        });
+
+        entry = async_pipeline;
+        return async_pipeline;
+    }
+
+    void PipelineRegistry::prune() {
+        std::lock_guard lock(m_mutex);
+        std::erase_if(m_pipelines, [](const auto &entry) { return entry.second.expired(); });
+        std::erase_if(m_pending, [](const auto &entry) { return entry.second.expired() || entry.second.lock()->is_done(); });
+    }
+
+    size_t PipelineRegistry::size() {
+        std::lock_guard lock(m_mutex);
+        return std::ranges::count_if(m_pipelines, [](const auto &entry) { return !entry.second.expired(); });
+    }
+} // namespace kat
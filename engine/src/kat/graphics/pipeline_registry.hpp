@@ -0,0 +1,41 @@
+#pragma once
+
+#include "kat/graphics/context.hpp"
+#include "kat/graphics/graphics_pipeline.hpp"
+#include "kat/graphics/pipeline_compiler.hpp"
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace kat {
+
+    // Deduplicates graphics pipelines by their description (see GraphicsPipeline::Description::key()).
+    // The registry only holds weak references, so a pipeline is destroyed once nothing uses it anymore; asking for it again afterwards simply rebuilds it (which
+    // is cheap thanks to the pipeline cache).
+    class PipelineRegistry {
+      public:
+        explicit PipelineRegistry(const std::shared_ptr<Context> &context);
+
+        // Returns the existing pipeline for this description, or builds one on the calling thread.
+        [[nodiscard]] std::shared_ptr<GraphicsPipeline> get_or_create(const GraphicsPipeline::Description &desc);
+
+        // Returns the existing pipeline for this description, or starts compiling one on the context's PipelineCompiler.
+        [[nodiscard]] std::shared_ptr<AsyncGraphicsPipeline> get_or_compile(const GraphicsPipeline::Description &desc, std::shared_ptr<GraphicsPipeline> placeholder = nullptr);
+
+        // Drops entries for pipelines which have been destroyed.
+        void prune();
+
+        // Number of live pipelines tracked by the registry.
+        [[nodiscard]] size_t size();
+
+      private:
+        std::shared_ptr<Context> m_context;
+
+        std::mutex                                                           m_mutex;
+        std::unordered_map<std::string, std::weak_ptr<GraphicsPipeline>>      m_pipelines;
+        std::unordered_map<std::string, std::weak_ptr<AsyncGraphicsPipeline>> m_pending;
+    };
+
+} // namespace kat
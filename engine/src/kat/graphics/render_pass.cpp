@@ -1,9 +1,51 @@
 #include "kat/graphics/render_pass.hpp"
 
+#include "kat/util/hash.hpp"
+
 #include <ranges>
 
 namespace kat {
-    RenderPass::RenderPass(const std::shared_ptr<kat::Context>& context, const RenderPass::Description &desc) : m_context(context) {
+    namespace {
+        // H is a Hasher or a KeyWriter.
+        template <typename H>
+        void hash_attachment_references(H &h, const std::vector<vk::AttachmentReference2> &refs) {
+            h.value(refs.size());
+            for (const auto &ref : refs) {
+                h.value(ref.attachment);
+            }
+        }
+
+        template <typename H>
+        void hash_compatibility(H &h, const RenderPass::Description &desc) {
+            h.value(desc.attachments.size());
+            for (const auto &attc : desc.attachments) {
+                h.value(attc.format).value(attc.samples);
+            }
+
+            h.value(desc.subpasses.size());
+            for (const auto &subp : desc.subpasses) {
+                h.value(subp.bind_point).value(subp.view_mask);
+                hash_attachment_references(h, subp.color_attachments);
+                hash_attachment_references(h, subp.input_attachments);
+                hash_attachment_references(h, subp.resolve_attachments);
+                h.value(subp.depth_stencil_attachment.has_value() ? subp.depth_stencil_attachment->attachment : VK_ATTACHMENT_UNUSED);
+            }
+        }
+    } // namespace
+
+    uint64_t RenderPass::Description::compatibility_hash() const {
+        Hasher h;
+        hash_compatibility(h, *this);
+        return h.digest();
+    }
+
+    std::string RenderPass::Description::compatibility_key() const {
+        KeyWriter k;
+        hash_compatibility(k, *this);
+        return k.take();
+    }
+
+    RenderPass::RenderPass(const std::shared_ptr<kat::Context>& context, const RenderPass::Description &desc) : m_context(context), m_description(desc) {
         std::vector<vk::AttachmentDescription2> attachments;
         attachments.reserve(desc.attachments.size());
         for (const auto& attc : desc.attachments) {
@@ -2,6 +2,7 @@
 
 #include "kat/graphics/context.hpp"
 
+#include <string>
 #include <variant>
 #include <vector>
 
@@ -70,6 +71,13 @@ namespace kat {
             std::vector<AttachmentLayout>  attachments;
             std::vector<Subpass>           subpasses;
             std::vector<SubpassDependency> dependencies;
+
+            // Hash of the parts of the description which affect render pass compatibility (attachment formats/sample counts and subpass references), pipelines
+            // built for one render pass can be used with any compatible one.
+            [[nodiscard]] uint64_t compatibility_hash() const;
+
+            // The same parts as a collision free key, see KeyWriter.
+            [[nodiscard]] std::string compatibility_key() const;
         };
 
         using ClearValue = std::variant<kat::color, vk::ClearDepthStencilValue>;
@@ -94,8 +102,11 @@ namespace kat {
 
         [[nodiscard]] inline vk::RenderPass handle() const { return m_render_pass; };
 
+        [[nodiscard]] inline const Description &description() const { return m_description; };
+
       private:
         std::shared_ptr<kat::Context> m_context;
         vk::RenderPass                m_render_pass;
+        Description                   m_description;
     };
 } // namespace kat
@@ -1,76 +1,201 @@
 #include "kat/graphics/shader_cache.hpp"
 
-#include <fstream>
+#include "kat/util/asset_store.hpp"
+#include "kat/util/hash.hpp"
+
+#include <algorithm>
+#include <cstring>
 #include <iostream>
+#include <ranges>
+#include <tuple>
+#include <utility>
 
 namespace kat {
-    std::vector<uint32_t> ShaderId::load_code() const {
-        std::ifstream f(path, std::ios::ate | std::ios::in | std::ios::binary);
+    std::vector<uint32_t> ShaderId::load_code(const AssetStore &assets) const {
+        const auto file = assets.open(path);
 
-        if (!f.good()) {
+        if (!file) {
             std::cerr << "File not found: " << path << std::endl;
             throw kat::fatal_exc{};
         }
 
-        auto end = f.tellg();
-        f.seekg(0);
-
+        // the module is created from an aligned copy, the asset only lives as long as this call.
         std::vector<uint32_t> code;
-        code.resize(end / sizeof(uint32_t));
-
-        f.read(reinterpret_cast<char *>(code.data()), code.size() * sizeof(uint32_t));
+        code.resize(file->size() / sizeof(uint32_t));
 
-        f.close();
+        std::memcpy(code.data(), file->data(), code.size() * sizeof(uint32_t));
 
         return code;
     }
 
-    ShaderCache::ShaderCache(const std::shared_ptr<kat::Context> &context) : m_context(context) {}
+    ShaderModuleRef::ShaderModuleRef(ShaderCache *cache, uint64_t key, vk::ShaderModule module) : m_cache(cache), m_key(key), m_module(module) {}
+
+    ShaderModuleRef::ShaderModuleRef(ShaderModuleRef &&other) noexcept
+        : m_cache(std::exchange(other.m_cache, nullptr)), m_key(other.m_key), m_module(std::exchange(other.m_module, nullptr)) {}
+
+    ShaderModuleRef &ShaderModuleRef::operator=(ShaderModuleRef &&other) noexcept {
+        if (this != &other) {
+            release();
+
+            m_cache  = std::exchange(other.m_cache, nullptr);
+            m_key    = other.m_key;
+            m_module = std::exchange(other.m_module, nullptr);
+        }
+
+        return *this;
+    }
+
+    ShaderModuleRef::~ShaderModuleRef() {
+        release();
+    }
+
+    void ShaderModuleRef::release() {
+        if (m_cache)
+            m_cache->release(m_key);
+        m_cache = nullptr;
+    }
+
+    ShaderCache::ShaderCache(const std::shared_ptr<kat::Context> &context, size_t capacity) : m_context(context), m_capacity(std::max<size_t>(capacity, 1)) {}
 
     ShaderCache::~ShaderCache() {
-        for (const auto &sm : m_cache) {
-            m_context->device().destroy(sm.second);
+        for (const auto &[_, entry] : m_modules) {
+            m_context->device().destroy(entry.module);
         }
     }
 
-    vk::ShaderModule ShaderCache::get(const ShaderId &id) {
-        auto it = m_cache.find(id);
-        if (it != m_cache.end()) {
-            return it->second;
+    ShaderModuleRef ShaderCache::get(const ShaderId &id) {
+        std::lock_guard lock(m_mutex);
+
+        if (const auto it = m_ids.find(id); it != m_ids.end()) {
+            return use(it->second, m_modules.at(it->second));
         }
 
-        // Load shader
+        std::vector<uint32_t> code = id.load_code(*m_context->asset_store());
+
+        // the same code under another path. The hash only says where to look, on a collision the next key is tried. Evicting an entry can cut such a chain short,
+        // which at worst loads the same code into a second module.
+        uint64_t key = hash_bytes(code.data(), code.size() * sizeof(uint32_t));
+        for (auto it = m_modules.find(key); it != m_modules.end(); it = m_modules.find(++key)) {
+            if (it->second.code == code) {
+                it->second.ids.push_back(id);
+                m_ids.insert({id, key});
+                return use(key, it->second);
+            }
+        }
 
-        std::vector<uint32_t> code = id.load_code();
+        evict_if_full();
 
         vk::ShaderModuleCreateInfo ci{};
         ci.setCode(code);
 
-        vk::ShaderModule sm = m_context->device().createShaderModule(ci);
-
-        m_cache.insert({id, sm});
+        Entry entry{};
+        entry.module     = m_context->device().createShaderModule(ci);
+        entry.reflection = reflect_spirv(code).value_or(ShaderReflection{});
+        entry.code       = std::move(code);
+        entry.ids.push_back(id);
 
-        return sm;
+        // eviction may have freed an earlier key in the chain, key is still free either way.
+        m_ids.insert({id, key});
+        return use(key, m_modules.insert({key, std::move(entry)}).first->second);
     }
 
-    std::optional<vk::ShaderModule> ShaderCache::get_if_present(const ShaderId &id) {
-        auto it = m_cache.find(id);
-        if (it != m_cache.end()) {
-            return it->second;
+    std::optional<ShaderModuleRef> ShaderCache::get_if_present(const ShaderId &id) {
+        std::lock_guard lock(m_mutex);
+
+        if (const auto it = m_ids.find(id); it != m_ids.end()) {
+            return use(it->second, m_modules.at(it->second));
         }
 
         return std::nullopt;
     }
 
     void ShaderCache::reset() {
-        for (const auto &sm : m_cache) {
-            m_context->device().destroy(sm.second);
+        std::lock_guard lock(m_mutex);
+
+        for (const auto &[_, entry] : m_modules) {
+            m_context->device().destroy(entry.module);
         }
 
-        m_cache.clear();
+        m_modules.clear();
+        m_ids.clear();
     }
 
     bool ShaderCache::is_loaded(const ShaderId &id) {
-        return m_cache.contains(id);
+        std::lock_guard lock(m_mutex);
+        return m_ids.contains(id);
+    }
+
+    ShaderReflection ShaderCache::reflect(const ShaderId &id) {
+        // keeps the module from being evicted before the reflection has been copied out.
+        const ShaderModuleRef module = get(id);
+
+        std::lock_guard lock(m_mutex);
+        return m_modules.at(module.m_key).reflection;
+    }
+
+    void ShaderCache::forget(const ShaderId &id) {
+        std::lock_guard lock(m_mutex);
+
+        const auto it = m_ids.find(id);
+        if (it == m_ids.end())
+            return;
+
+        const auto entry = m_modules.find(it->second);
+        m_ids.erase(it);
+
+        std::erase(entry->second.ids, id);
+        if (entry->second.ids.empty() && entry->second.refs == 0) {
+            m_context->device().destroy(entry->second.module);
+            m_modules.erase(entry);
+        }
+    }
+
+    size_t ShaderCache::size() {
+        std::lock_guard lock(m_mutex);
+        return m_modules.size();
+    }
+
+    ShaderModuleRef ShaderCache::use(uint64_t key, Entry &entry) {
+        entry.uses++;
+        entry.last_used = ++m_clock;
+        entry.refs++;
+        return ShaderModuleRef(this, key, entry.module);
+    }
+
+    void ShaderCache::evict_if_full() {
+        // a linear scan, but it only runs on misses, which read a file and create a module anyway.
+        while (m_modules.size() >= m_capacity) {
+            auto victim = m_modules.end();
+            for (auto it = m_modules.begin(); it != m_modules.end(); ++it) {
+                if (it->second.refs > 0)
+                    continue;
+                if (victim == m_modules.end() || std::tie(it->second.uses, it->second.last_used) < std::tie(victim->second.uses, victim->second.last_used))
+                    victim = it;
+            }
+
+            // everything is in use, go over capacity rather than destroying a module out from under a pipeline.
+            if (victim == m_modules.end())
+                return;
+
+            for (const auto &id : victim->second.ids) {
+                m_ids.erase(id);
+            }
+            m_context->device().destroy(victim->second.module);
+            m_modules.erase(victim);
+            m_evictions.fetch_add(1, std::memory_order_relaxed);
+
+            // ages the counts, otherwise modules used a lot early on would outlive everything loaded later.
+            for (auto &entry : m_modules | std::views::values) {
+                entry.uses /= 2;
+            }
+        }
+    }
+
+    void ShaderCache::release(uint64_t key) {
+        std::lock_guard lock(m_mutex);
+
+        // reset() may have dropped it already.
+        if (const auto it = m_modules.find(key); it != m_modules.end() && it->second.refs > 0)
+            it->second.refs--;
     }
 } // namespace kat
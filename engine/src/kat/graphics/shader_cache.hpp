@@ -1,7 +1,10 @@
 #pragma once
 
 #include "kat/graphics/context.hpp"
+#include "kat/graphics/shader_reflection.hpp"
 
+#include <atomic>
+#include <mutex>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -18,7 +21,7 @@ namespace kat {
 
         inline ShaderId(const std::filesystem::path& path_) : path(path_.string()) {};
 
-        std::vector<uint32_t> load_code() const;
+        std::vector<uint32_t> load_code(const AssetStore &assets) const;
 
         inline friend bool operator==(const ShaderId &a, const ShaderId &b) { return a.path == b.path; };
     };
@@ -31,24 +34,93 @@ struct std::hash<kat::ShaderId> {
 
 namespace kat {
 
-    // In the future, instead of an unordered_map, we should use an lfu cache.
+    class ShaderCache;
+
+    // Keeps a module from being evicted while it's in use (e.g. while a pipeline is being created from it). Pipelines don't need their modules once they're
+    // created, so the reference can be dropped right after.
+    class ShaderModuleRef {
+      public:
+        ShaderModuleRef(ShaderModuleRef &&other) noexcept;
+        ShaderModuleRef &operator=(ShaderModuleRef &&other) noexcept;
+
+        ShaderModuleRef(const ShaderModuleRef &)            = delete;
+        ShaderModuleRef &operator=(const ShaderModuleRef &) = delete;
+
+        ~ShaderModuleRef();
+
+        [[nodiscard]] inline vk::ShaderModule handle() const { return m_module; };
+
+      private:
+        friend class ShaderCache;
+
+        ShaderModuleRef(ShaderCache *cache, uint64_t key, vk::ShaderModule module);
+
+        void release();
+
+        ShaderCache     *m_cache = nullptr;
+        uint64_t         m_key   = 0;
+        vk::ShaderModule m_module;
+    };
+
+    // Shader modules are keyed by a hash of their code, so the same spirv loaded from different paths (or after a file was copied) shares a module. The code is
+    // kept and compared before sharing, so a hash collision can't hand out another shader's module. Once the cache holds more than its capacity, the least
+    // frequently used module which isn't referenced is destroyed to make room. Use counts are halved whenever something is evicted, so modules which were only
+    // hot at startup eventually make way.
+    // All methods are thread safe (pipelines get built on worker threads by the PipelineCompiler).
     class ShaderCache {
       public:
-        explicit ShaderCache(const std::shared_ptr<kat::Context> &context);
+        explicit ShaderCache(const std::shared_ptr<kat::Context> &context, size_t capacity = DEFAULT_SHADER_CACHE_CAPACITY);
 
         ~ShaderCache();
 
-        vk::ShaderModule get(const ShaderId &id);
+        ShaderModuleRef get(const ShaderId &id);
 
-        std::optional<vk::ShaderModule> get_if_present(const ShaderId &id);
+        std::optional<ShaderModuleRef> get_if_present(const ShaderId &id);
 
+        // Destroys every module. Must not be called while anything holds a ShaderModuleRef.
         void reset();
 
         bool is_loaded(const ShaderId &id);
 
+        // The module's bindings, push constants and vertex inputs, reflected once when it's loaded. Loads the module if it isn't loaded yet.
+        ShaderReflection reflect(const ShaderId &id);
+
+        // Makes the next get() for this id read its file again. The old module is destroyed right away if nothing else uses it.
+        void forget(const ShaderId &id);
+
+        [[nodiscard]] size_t size();
+
+        [[nodiscard]] inline size_t capacity() const { return m_capacity; };
+
+        [[nodiscard]] inline uint64_t evictions() const { return m_evictions.load(std::memory_order_relaxed); };
+
       private:
+        friend class ShaderModuleRef;
+
+        struct Entry {
+            vk::ShaderModule      module;
+            std::vector<uint32_t> code;
+            uint64_t              uses      = 0;
+            uint64_t              last_used = 0; // breaks ties between modules used equally often, the older one goes first
+            uint32_t              refs      = 0;
+            std::vector<ShaderId> ids; // every id which resolved to this code
+            ShaderReflection      reflection;
+        };
+
+        // m_mutex has to be held.
+        ShaderModuleRef use(uint64_t key, Entry &entry);
+
+        void evict_if_full();
+
+        void release(uint64_t key);
+
         std::shared_ptr<kat::Context> m_context;
+        size_t                        m_capacity;
 
-        std::unordered_map<ShaderId, vk::ShaderModule> m_cache;
+        std::unordered_map<uint64_t, Entry>    m_modules; // by code hash, colliding code goes to the next free key
+        std::unordered_map<ShaderId, uint64_t> m_ids;     // so that hits don't have to read the file again
+        uint64_t                               m_clock     = 0;
+        std::atomic<uint64_t>                  m_evictions = 0;
+        std::mutex                             m_mutex;
     };
 } // namespace kat
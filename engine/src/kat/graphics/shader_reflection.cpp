@@ -0,0 +1,404 @@
+#include "kat/graphics/shader_reflection.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace kat {
+    namespace {
+        constexpr uint32_t SPIRV_MAGIC = 0x07230203;
+
+        // the handful of opcodes, decorations and enums this needs, from the spirv spec.
+        enum Op : uint32_t {
+            OP_ENTRY_POINT       = 15,
+            OP_TYPE_INT          = 21,
+            OP_TYPE_FLOAT        = 22,
+            OP_TYPE_VECTOR       = 23,
+            OP_TYPE_MATRIX       = 24,
+            OP_TYPE_IMAGE        = 25,
+            OP_TYPE_SAMPLER      = 26,
+            OP_TYPE_SAMPLED      = 27,
+            OP_TYPE_ARRAY        = 28,
+            OP_TYPE_RUNTIME      = 29,
+            OP_TYPE_STRUCT       = 30,
+            OP_TYPE_POINTER      = 32,
+            OP_CONSTANT          = 43,
+            OP_VARIABLE          = 59,
+            OP_DECORATE          = 71,
+            OP_MEMBER_DECORATE   = 72,
+            OP_TYPE_ACCELERATION = 5341,
+        };
+
+        enum Decoration : uint32_t {
+            DECORATION_BLOCK          = 2,
+            DECORATION_BUFFER_BLOCK   = 3,
+            DECORATION_ARRAY_STRIDE   = 6,
+            DECORATION_MATRIX_STRIDE  = 7,
+            DECORATION_BUILT_IN       = 11,
+            DECORATION_LOCATION       = 30,
+            DECORATION_BINDING        = 33,
+            DECORATION_DESCRIPTOR_SET = 34,
+            DECORATION_OFFSET         = 35,
+        };
+
+        enum StorageClass : uint32_t {
+            STORAGE_UNIFORM_CONSTANT = 0,
+            STORAGE_INPUT            = 1,
+            STORAGE_UNIFORM          = 2,
+            STORAGE_PUSH_CONSTANT    = 9,
+            STORAGE_STORAGE_BUFFER   = 12,
+        };
+
+        constexpr uint32_t DIM_BUFFER       = 5;
+        constexpr uint32_t DIM_SUBPASS_DATA = 6;
+
+        struct Type {
+            uint32_t              op;
+            std::vector<uint32_t> operands; // everything after the result id
+        };
+
+        struct Decorations {
+            std::optional<uint32_t> set;
+            std::optional<uint32_t> binding;
+            std::optional<uint32_t> location;
+            uint32_t                array_stride = 0;
+            bool                    block        = false;
+            bool                    buffer_block = false;
+            bool                    built_in     = false;
+        };
+
+        struct MemberDecorations {
+            uint32_t offset        = 0;
+            uint32_t matrix_stride = 0;
+        };
+
+        struct Variable {
+            uint32_t id;
+            uint32_t type; // the pointer's pointee
+            uint32_t storage_class;
+        };
+
+        class Module {
+          public:
+            bool parse(std::span<const uint32_t> code) {
+                if (code.size() < 5 || code[0] != SPIRV_MAGIC) {
+                    std::cerr << "Warning: Not a spirv module." << std::endl;
+                    return false;
+                }
+
+                for (size_t i = 5; i < code.size();) {
+                    const uint32_t word_count = code[i] >> 16;
+                    const uint32_t op         = code[i] & 0xFFFF;
+                    if (word_count == 0 || i + word_count > code.size()) {
+                        std::cerr << "Warning: Truncated spirv instruction." << std::endl;
+                        return false;
+                    }
+
+                    instruction(op, code.subspan(i + 1, word_count - 1));
+                    i += word_count;
+                }
+
+                return true;
+            }
+
+            vk::ShaderStageFlags                                         stages;
+            std::vector<Variable>                                        variables;
+            std::unordered_map<uint32_t, Type>                           types;
+            std::unordered_map<uint32_t, uint32_t>                       constants;
+            std::unordered_map<uint32_t, Decorations>                    decorations;
+            std::unordered_map<uint32_t, std::vector<MemberDecorations>> member_decorations;
+
+            // arrays are unwrapped into the element type and the total element count. Runtime arrays count as 1.
+            [[nodiscard]] std::pair<uint32_t, uint32_t> unwrap_arrays(uint32_t type) const {
+                uint32_t count = 1;
+                while (true) {
+                    const auto &t = types.at(type);
+                    if (t.op == OP_TYPE_ARRAY) {
+                        count *= constant(t.operands[1]);
+                        type = t.operands[0];
+                    } else if (t.op == OP_TYPE_RUNTIME) {
+                        type = t.operands[0];
+                    } else {
+                        return {type, count};
+                    }
+                }
+            }
+
+            [[nodiscard]] uint32_t size_of(uint32_t type, uint32_t matrix_stride = 0) const {
+                const auto &t = types.at(type);
+                switch (t.op) {
+                case OP_TYPE_INT:
+                case OP_TYPE_FLOAT:
+                    return t.operands[0] / 8;
+                case OP_TYPE_VECTOR:
+                    return size_of(t.operands[0]) * t.operands[1];
+                case OP_TYPE_MATRIX:
+                    return (matrix_stride ? matrix_stride : size_of(t.operands[0])) * t.operands[1];
+                case OP_TYPE_ARRAY: {
+                    const uint32_t stride = decoration(type).array_stride;
+                    return (stride ? stride : size_of(t.operands[0], matrix_stride)) * constant(t.operands[1]);
+                }
+                case OP_TYPE_STRUCT: {
+                    uint32_t   size    = 0;
+                    const auto members = member_decorations.find(type);
+                    for (size_t i = 0; i < t.operands.size(); i++) {
+                        const MemberDecorations m = members != member_decorations.end() && i < members->second.size() ? members->second[i] : MemberDecorations{};
+                        size                      = std::max(size, m.offset + size_of(t.operands[i], m.matrix_stride));
+                    }
+                    return size;
+                }
+                default:
+                    return 0;
+                }
+            }
+
+            // the lowest member offset, push constant blocks of later stages often start past the earlier stages' members.
+            [[nodiscard]] uint32_t first_offset(uint32_t struct_type) const {
+                const auto members = member_decorations.find(struct_type);
+                if (members == member_decorations.end() || members->second.empty())
+                    return 0;
+                return std::ranges::min(members->second, {}, &MemberDecorations::offset).offset;
+            }
+
+            [[nodiscard]] Decorations decoration(uint32_t id) const {
+                const auto it = decorations.find(id);
+                return it != decorations.end() ? it->second : Decorations{};
+            }
+
+            [[nodiscard]] uint32_t constant(uint32_t id) const {
+                const auto it = constants.find(id);
+                return it != constants.end() ? it->second : 1;
+            }
+
+          private:
+            void instruction(uint32_t op, std::span<const uint32_t> operands) {
+                switch (op) {
+                case OP_ENTRY_POINT:
+                    if (!operands.empty())
+                        stages |= stage_of(operands[0]);
+                    break;
+                case OP_TYPE_INT:
+                case OP_TYPE_FLOAT:
+                case OP_TYPE_VECTOR:
+                case OP_TYPE_MATRIX:
+                case OP_TYPE_IMAGE:
+                case OP_TYPE_SAMPLER:
+                case OP_TYPE_SAMPLED:
+                case OP_TYPE_ARRAY:
+                case OP_TYPE_RUNTIME:
+                case OP_TYPE_STRUCT:
+                case OP_TYPE_POINTER:
+                case OP_TYPE_ACCELERATION:
+                    if (!operands.empty())
+                        types[operands[0]] = Type{op, {operands.begin() + 1, operands.end()}};
+                    break;
+                case OP_CONSTANT:
+                    // only 32 bit integer constants matter (array lengths), wider ones keep their low word.
+                    if (operands.size() >= 3)
+                        constants[operands[1]] = operands[2];
+                    break;
+                case OP_VARIABLE:
+                    if (operands.size() >= 3) {
+                        const auto pointer = types.find(operands[0]);
+                        if (pointer != types.end() && pointer->second.op == OP_TYPE_POINTER)
+                            variables.push_back(Variable{operands[1], pointer->second.operands[1], operands[2]});
+                    }
+                    break;
+                case OP_DECORATE:
+                    if (operands.size() >= 2)
+                        decorate(decorations[operands[0]], operands[1], operands.subspan(2));
+                    break;
+                case OP_MEMBER_DECORATE:
+                    if (operands.size() >= 4) {
+                        auto &members = member_decorations[operands[0]];
+                        if (members.size() <= operands[1])
+                            members.resize(operands[1] + 1);
+                        if (operands[2] == DECORATION_OFFSET)
+                            members[operands[1]].offset = operands[3];
+                        else if (operands[2] == DECORATION_MATRIX_STRIDE)
+                            members[operands[1]].matrix_stride = operands[3];
+                    }
+                    break;
+                default:
+                    break;
+                }
+            }
+
+            static void decorate(Decorations &d, uint32_t decoration, std::span<const uint32_t> literals) {
+                const uint32_t value = literals.empty() ? 0 : literals[0];
+                switch (decoration) {
+                case DECORATION_BLOCK:
+                    d.block = true;
+                    break;
+                case DECORATION_BUFFER_BLOCK:
+                    d.buffer_block = true;
+                    break;
+                case DECORATION_ARRAY_STRIDE:
+                    d.array_stride = value;
+                    break;
+                case DECORATION_BUILT_IN:
+                    d.built_in = true;
+                    break;
+                case DECORATION_LOCATION:
+                    d.location = value;
+                    break;
+                case DECORATION_BINDING:
+                    d.binding = value;
+                    break;
+                case DECORATION_DESCRIPTOR_SET:
+                    d.set = value;
+                    break;
+                default:
+                    break;
+                }
+            }
+
+            static vk::ShaderStageFlags stage_of(uint32_t execution_model) {
+                switch (execution_model) {
+                case 0:
+                    return vk::ShaderStageFlagBits::eVertex;
+                case 1:
+                    return vk::ShaderStageFlagBits::eTessellationControl;
+                case 2:
+                    return vk::ShaderStageFlagBits::eTessellationEvaluation;
+                case 3:
+                    return vk::ShaderStageFlagBits::eGeometry;
+                case 4:
+                    return vk::ShaderStageFlagBits::eFragment;
+                case 5:
+                    return vk::ShaderStageFlagBits::eCompute;
+                default:
+                    return {};
+                }
+            }
+        };
+
+        std::optional<vk::DescriptorType> descriptor_type(const Module &module, uint32_t type, uint32_t storage_class) {
+            const auto &t = module.types.at(type);
+
+            switch (storage_class) {
+            case STORAGE_UNIFORM_CONSTANT:
+                switch (t.op) {
+                case OP_TYPE_SAMPLER:
+                    return vk::DescriptorType::eSampler;
+                case OP_TYPE_SAMPLED:
+                    // a sampled image of a buffer is a texel buffer (e.g. samplerBuffer), not a combined sampler.
+                    if (module.types.at(t.operands[0]).operands[1] == DIM_BUFFER)
+                        return vk::DescriptorType::eUniformTexelBuffer;
+                    return vk::DescriptorType::eCombinedImageSampler;
+                case OP_TYPE_IMAGE: {
+                    const uint32_t dim     = t.operands[1];
+                    const uint32_t sampled = t.operands[5];
+                    if (dim == DIM_SUBPASS_DATA)
+                        return vk::DescriptorType::eInputAttachment;
+                    if (dim == DIM_BUFFER)
+                        return sampled == 2 ? vk::DescriptorType::eStorageTexelBuffer : vk::DescriptorType::eUniformTexelBuffer;
+                    return sampled == 2 ? vk::DescriptorType::eStorageImage : vk::DescriptorType::eSampledImage;
+                }
+                case OP_TYPE_ACCELERATION:
+                    return vk::DescriptorType::eAccelerationStructureKHR;
+                default:
+                    return std::nullopt;
+                }
+            case STORAGE_UNIFORM:
+                if (module.decoration(type).buffer_block)
+                    return vk::DescriptorType::eStorageBuffer;
+                return vk::DescriptorType::eUniformBuffer;
+            case STORAGE_STORAGE_BUFFER:
+                return vk::DescriptorType::eStorageBuffer;
+            default:
+                return std::nullopt;
+            }
+        }
+
+        vk::Format vertex_format(const Module &module, uint32_t type) {
+            const auto &t          = module.types.at(type);
+            const auto  components = t.op == OP_TYPE_VECTOR ? t.operands[1] : 1;
+            const auto &scalar     = t.op == OP_TYPE_VECTOR ? module.types.at(t.operands[0]) : t;
+
+            if (scalar.operands.empty() || scalar.operands[0] != 32 || components < 1 || components > 4)
+                return vk::Format::eUndefined;
+
+            constexpr vk::Format SFLOAT[] = {vk::Format::eR32Sfloat, vk::Format::eR32G32Sfloat, vk::Format::eR32G32B32Sfloat, vk::Format::eR32G32B32A32Sfloat};
+            constexpr vk::Format SINT[]   = {vk::Format::eR32Sint, vk::Format::eR32G32Sint, vk::Format::eR32G32B32Sint, vk::Format::eR32G32B32A32Sint};
+            constexpr vk::Format UINT[]   = {vk::Format::eR32Uint, vk::Format::eR32G32Uint, vk::Format::eR32G32B32Uint, vk::Format::eR32G32B32A32Uint};
+
+            if (scalar.op == OP_TYPE_FLOAT)
+                return SFLOAT[components - 1];
+            if (scalar.op == OP_TYPE_INT)
+                return scalar.operands[1] ? SINT[components - 1] : UINT[components - 1];
+            return vk::Format::eUndefined;
+        }
+
+        ShaderReflection reflect(const Module &module) {
+            ShaderReflection reflection{};
+            reflection.stages = module.stages;
+
+            for (const auto &variable : module.variables) {
+                if (!module.types.contains(variable.type))
+                    continue;
+
+                const Decorations d = module.decoration(variable.id);
+
+                if (variable.storage_class == STORAGE_PUSH_CONSTANT) {
+                    const uint32_t offset     = module.first_offset(variable.type);
+                    reflection.push_constants = vk::PushConstantRange(module.stages, offset, module.size_of(variable.type) - offset);
+                    continue;
+                }
+
+                if (variable.storage_class == STORAGE_INPUT) {
+                    if (!(module.stages & vk::ShaderStageFlagBits::eVertex) || d.built_in || !d.location)
+                        continue;
+
+                    // matrices and arrays are spread over consecutive locations.
+                    auto [type, count] = module.unwrap_arrays(variable.type);
+                    const auto &t      = module.types.at(type);
+                    if (t.op == OP_TYPE_MATRIX) {
+                        count *= t.operands[1];
+                        type = t.operands[0];
+                    }
+
+                    const vk::Format format = vertex_format(module, type);
+                    if (format == vk::Format::eUndefined) {
+                        std::cerr << "Warning: Unsupported vertex input type at location " << *d.location << "." << std::endl;
+                        continue;
+                    }
+
+                    for (uint32_t i = 0; i < count; i++) {
+                        reflection.vertex_inputs.push_back(ReflectedVertexInput{*d.location + i, format});
+                    }
+                    continue;
+                }
+
+                if (!d.binding)
+                    continue;
+
+                const auto [type, count] = module.unwrap_arrays(variable.type);
+                const auto descriptor    = descriptor_type(module, type, variable.storage_class);
+                if (!descriptor)
+                    continue;
+
+                reflection.bindings.push_back(ReflectedBinding{d.set.value_or(0), *d.binding, *descriptor, count});
+            }
+
+            std::ranges::sort(reflection.bindings, {}, [](const ReflectedBinding &b) { return std::pair(b.set, b.binding); });
+            std::ranges::sort(reflection.vertex_inputs, {}, &ReflectedVertexInput::location);
+
+            return reflection;
+        }
+    } // namespace
+
+    std::optional<ShaderReflection> reflect_spirv(std::span<const uint32_t> code) {
+        Module module;
+        if (!module.parse(code))
+            return std::nullopt;
+
+        try {
+            return reflect(module);
+        } catch (const std::out_of_range &) {
+            std::cerr << "Warning: Spirv module references undeclared types." << std::endl;
+            return std::nullopt;
+        }
+    }
+} // namespace kat
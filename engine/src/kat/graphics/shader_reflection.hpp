@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace kat {
+
+    struct ReflectedBinding {
+        uint32_t           set;
+        uint32_t           binding;
+        vk::DescriptorType type;
+        uint32_t           count;
+    };
+
+    struct ReflectedVertexInput {
+        uint32_t   location;
+        vk::Format format;
+    };
+
+    // What a shader module expects to be bound, read from its spirv. Buffers are always reported as eUniformBuffer/eStorageBuffer, spirv can't tell dynamic
+    // ones apart (see LayoutOverrides).
+    struct ShaderReflection {
+        vk::ShaderStageFlags stages; // of every entry point in the module
+
+        std::vector<ReflectedBinding> bindings;
+
+        // covering every push constant member the module declares, with the module's stages.
+        std::optional<vk::PushConstantRange> push_constants;
+
+        // only filled for vertex shaders, sorted by location. Matrices and arrays take up one location per column/element.
+        std::vector<ReflectedVertexInput> vertex_inputs;
+    };
+
+    // Only looks at the declarations, not at which of them are actually used. Reports what's wrong on cerr and returns nullopt if the code isn't valid spirv.
+    [[nodiscard]] std::optional<ShaderReflection> reflect_spirv(std::span<const uint32_t> code);
+
+} // namespace kat
@@ -0,0 +1,309 @@
+#include "kat/graphics/shader_watcher.hpp"
+
+#include "kat/graphics/graphics_pipeline.hpp"
+#include "kat/graphics/shader_cache.hpp"
+#include "kat/util/asset_store.hpp"
+#include "kat/util/profiler.hpp"
+
+#include <array>
+#include <cerrno>
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <spawn.h>
+#include <sys/wait.h>
+#endif
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#ifndef _WIN32
+extern char **environ;
+#endif
+
+namespace kat {
+    namespace {
+        // the same set shader_compile.py compiles.
+        bool is_shader_source(const std::filesystem::path &path) {
+            const auto ext = path.extension();
+            return ext == ".vert" || ext == ".frag" || ext == ".tesc" || ext == ".tese" || ext == ".geom" || ext == ".comp";
+        }
+
+#ifndef __linux__
+        constexpr auto POLL_INTERVAL = std::chrono::milliseconds(250);
+#endif
+
+#ifdef _WIN32
+        // quotes an argument the way CommandLineToArgvW splits it again: backslashes only need doubling in front of a quote.
+        std::wstring quote_argument(const std::wstring &arg) {
+            std::wstring quoted      = L"\"";
+            size_t       backslashes = 0;
+            for (const wchar_t c : arg) {
+                if (c == L'\\') {
+                    backslashes++;
+                    continue;
+                }
+
+                quoted.append(c == L'"' ? backslashes * 2 + 1 : backslashes, L'\\');
+                quoted.push_back(c);
+                backslashes = 0;
+            }
+
+            quoted.append(backslashes * 2, L'\\');
+            quoted.push_back(L'"');
+            return quoted;
+        }
+#endif
+
+        // runs the program without a shell in between, so paths don't need escaping. Returns false if it can't be started or doesn't exit with 0.
+        bool run_process(const std::vector<std::filesystem::path> &args) {
+#ifdef _WIN32
+            std::wstring command_line;
+            for (const auto &arg : args) {
+                if (!command_line.empty())
+                    command_line.push_back(L' ');
+                command_line += quote_argument(arg.wstring());
+            }
+
+            STARTUPINFOW        si{};
+            PROCESS_INFORMATION pi{};
+            si.cb = sizeof(si);
+            // no application name, so glslc is looked up on the PATH like it would be on posix.
+            if (!CreateProcessW(nullptr, command_line.data(), nullptr, nullptr, FALSE, CREATE_NO_WINDOW, nullptr, nullptr, &si, &pi))
+                return false;
+
+            WaitForSingleObject(pi.hProcess, INFINITE);
+            DWORD exit_code = 1;
+            GetExitCodeProcess(pi.hProcess, &exit_code);
+            CloseHandle(pi.hThread);
+            CloseHandle(pi.hProcess);
+            return exit_code == 0;
+#else
+            std::vector<std::string> strings;
+            std::vector<char *>      argv;
+            strings.reserve(args.size());
+            for (const auto &arg : args) {
+                argv.push_back(strings.emplace_back(arg.string()).data());
+            }
+            argv.push_back(nullptr);
+
+            pid_t pid;
+            if (posix_spawnp(&pid, argv[0], nullptr, nullptr, argv.data(), environ) != 0)
+                return false;
+
+            int status = 0;
+            while (waitpid(pid, &status, 0) < 0) {
+                if (errno != EINTR)
+                    return false;
+            }
+            return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+#endif
+        }
+    } // namespace
+
+    ShaderWatcher::ShaderWatcher(const std::shared_ptr<Context> &context) : m_context(context) {
+#ifdef __linux__
+        m_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (m_inotify < 0)
+            std::cerr << "Warning: Failed to initialize inotify, shaders won't be reloaded." << std::endl;
+#endif
+    }
+
+    ShaderWatcher::~ShaderWatcher() {
+        if (m_compiler)
+            m_compiler->shutdown();
+
+#ifdef __linux__
+        if (m_inotify >= 0)
+            close(m_inotify);
+#endif
+    }
+
+    void ShaderWatcher::watch_sources(const std::filesystem::path &source_dir, const std::filesystem::path &output_dir, const std::filesystem::path &glslc) {
+        std::lock_guard lock(m_mutex);
+
+        m_sources = Sources{key_of(source_dir), key_of(output_dir), glslc};
+        if (!m_compiler)
+            m_compiler = std::make_unique<ThreadPool>(1);
+
+        std::error_code ec;
+        for (const auto &entry : std::filesystem::recursive_directory_iterator(source_dir, ec)) {
+            if (entry.is_regular_file() && is_shader_source(entry.path()))
+                watch_file(entry.path(), true);
+        }
+
+        if (ec)
+            std::cerr << "Warning: Failed to list shader sources in " << source_dir << ": " << ec.message() << std::endl;
+    }
+
+    void ShaderWatcher::track(GraphicsPipeline *pipeline) {
+        std::lock_guard lock(m_mutex);
+
+        m_pipelines.insert(pipeline);
+        for (const auto &stage : pipeline->description().shader_stages) {
+            // a pack shadows the loose file, reloading would just read the packed copy again.
+            if (!m_context->asset_store()->is_packed(stage.shader_id.path))
+                watch_file(stage.shader_id.path, false);
+        }
+    }
+
+    void ShaderWatcher::untrack(GraphicsPipeline *pipeline) {
+        std::lock_guard lock(m_mutex);
+        m_pipelines.erase(pipeline);
+    }
+
+    void ShaderWatcher::watch_file(const std::filesystem::path &path, bool is_source) {
+        const std::string key = key_of(path);
+        if (m_files.contains(key))
+            return;
+
+        std::error_code ec;
+        const auto      write_time = std::filesystem::last_write_time(key, ec);
+        m_files[key]               = WatchedFile{write_time, write_time, is_source};
+
+#ifdef __linux__
+        // inotify watches directories rather than files, compilers and editors often replace files instead of writing to them.
+        const std::string dir = std::filesystem::path(key).parent_path().string();
+        if (m_inotify < 0 || m_watched_dirs.contains(dir))
+            return;
+
+        const int wd = inotify_add_watch(m_inotify, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (wd < 0) {
+            std::cerr << "Warning: Failed to watch " << dir << " for shader changes." << std::endl;
+            return;
+        }
+
+        m_watched_dirs.insert(dir);
+        m_watch_dirs[wd] = dir;
+#endif
+    }
+
+    std::vector<std::string> ShaderWatcher::changed_files() {
+        std::unordered_set<std::string> changed;
+
+#ifdef __linux__
+        if (m_inotify < 0)
+            return {};
+
+        alignas(inotify_event) std::array<char, 4096> buffer;
+        while (true) {
+            const ssize_t size = read(m_inotify, buffer.data(), buffer.size());
+            if (size <= 0)
+                break;
+
+            for (ssize_t offset = 0; offset < size;) {
+                const auto *event = reinterpret_cast<const inotify_event *>(buffer.data() + offset);
+                offset += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+
+                const auto dir = m_watch_dirs.find(event->wd);
+                if (event->len == 0 || dir == m_watch_dirs.end())
+                    continue;
+
+                const std::string key = (std::filesystem::path(dir->second) / event->name).generic_string();
+                if (m_files.contains(key))
+                    changed.insert(key);
+            }
+        }
+#else
+        const auto now = std::chrono::steady_clock::now();
+        if (now < m_next_poll)
+            return {};
+        m_next_poll = now + POLL_INTERVAL;
+
+        for (auto &[key, file] : m_files) {
+            std::error_code ec;
+            const auto      write_time = std::filesystem::last_write_time(key, ec);
+            if (ec || write_time == file.write_time) {
+                file.pending_write_time = file.write_time;
+                continue;
+            }
+
+            // the file may still be being written, wait until it has stopped changing.
+            if (write_time == file.pending_write_time) {
+                file.write_time = write_time;
+                changed.insert(key);
+            } else {
+                file.pending_write_time = write_time;
+            }
+        }
+#endif
+
+        return {changed.begin(), changed.end()};
+    }
+
+    void ShaderWatcher::update() {
+        KAT_PROFILE_FUNCTION();
+
+        // held throughout, so pipelines can't be destroyed while they're being rebuilt.
+        std::lock_guard lock(m_mutex);
+
+        std::unordered_set<std::string> spirv;
+        for (const auto &key : changed_files()) {
+            if (m_files.at(key).is_source)
+                compile(key);
+            else
+                spirv.insert(key);
+        }
+
+        if (spirv.empty())
+            return;
+
+        // every changed shader is dropped from the cache before anything is rebuilt, so pipelines sharing a shader don't load it once each.
+        std::vector<GraphicsPipeline *> affected;
+        for (auto *pipeline : m_pipelines) {
+            bool uses_changed = false;
+            for (const auto &stage : pipeline->description().shader_stages) {
+                if (spirv.contains(key_of(stage.shader_id.path))) {
+                    m_context->shader_cache()->forget(stage.shader_id);
+                    uses_changed = true;
+                }
+            }
+
+            if (uses_changed)
+                affected.push_back(pipeline);
+        }
+
+        uint32_t rebuilt = 0;
+        for (auto *pipeline : affected) {
+            if (pipeline->rebuild())
+                rebuilt++;
+        }
+
+        for (const auto &key : spirv) {
+            std::cout << "Reloaded " << key << std::endl;
+        }
+        std::cout << "Rebuilt " << rebuilt << "/" << affected.size() << " pipelines" << std::endl;
+
+        m_reload_count.fetch_add(spirv.size(), std::memory_order_relaxed);
+    }
+
+    void ShaderWatcher::compile(const std::filesystem::path &source) const {
+        if (!m_sources)
+            return;
+
+        // same layout as shader_compile.py: <output dir>/<path relative to the source dir>.spv
+        const auto output = m_sources->output_dir / (source.lexically_relative(m_sources->source_dir).string() + ".spv");
+
+        std::vector<std::filesystem::path> args = {m_sources->glslc, "-o", output, source};
+
+        m_compiler->submit([args = std::move(args), source](uint32_t) {
+            // glslc reports the actual errors itself.
+            if (!run_process(args))
+                std::cerr << "Warning: Failed to compile " << source << "." << std::endl;
+            else
+                std::cout << "Compiled " << source << std::endl;
+        });
+    }
+
+    std::string ShaderWatcher::key_of(const std::filesystem::path &path) {
+        std::error_code ec;
+        const auto      absolute = std::filesystem::absolute(path, ec);
+        return (ec ? path : absolute).lexically_normal().generic_string();
+    }
+} // namespace kat
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "kat/graphics/context.hpp"
+#include "kat/util/thread_pool.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace kat {
+
+    class GraphicsPipeline;
+
+    // Watches the spirv files of every live GraphicsPipeline, and rebuilds the pipelines using a file once it changes. With watch_sources() it also recompiles
+    // glsl sources as they're saved (the same way shader_compile.py does), which then shows up as a spirv change, so saving a shader in an editor is enough.
+    // Uses inotify on linux and polls modification times everywhere else. Only loose files are watched, a shader read out of an asset pack never reloads.
+    // Only created when ContextSettings::shader_hot_reload is set.
+    class ShaderWatcher {
+      public:
+        explicit ShaderWatcher(const std::shared_ptr<Context> &context);
+
+        ~ShaderWatcher();
+
+        ShaderWatcher(const ShaderWatcher &)            = delete;
+        ShaderWatcher &operator=(const ShaderWatcher &) = delete;
+
+        // Compiles sources under source_dir to output_dir/<relative path>.spv with glslc when they change.
+        void watch_sources(const std::filesystem::path &source_dir, const std::filesystem::path &output_dir, const std::filesystem::path &glslc);
+
+        // Reloads changed shaders and rebuilds the pipelines using them. Called by the context at the start of every frame, so the new handles are picked up
+        // by the next frame's commands.
+        void update();
+
+        [[nodiscard]] inline uint64_t reload_count() const { return m_reload_count.load(std::memory_order_relaxed); };
+
+      private:
+        friend class GraphicsPipeline;
+
+        // called from GraphicsPipeline's constructor and destructor, on whichever thread builds the pipeline.
+        void track(GraphicsPipeline *pipeline);
+
+        void untrack(GraphicsPipeline *pipeline);
+
+        struct WatchedFile {
+            std::filesystem::file_time_type write_time;
+            std::filesystem::file_time_type pending_write_time; // polling only reports a change once the time has been stable for a poll
+            bool                            is_source = false;
+        };
+
+        // m_mutex has to be held for these.
+        void watch_file(const std::filesystem::path &path, bool is_source);
+
+        [[nodiscard]] std::vector<std::string> changed_files();
+
+        void compile(const std::filesystem::path &source) const;
+
+        [[nodiscard]] static std::string key_of(const std::filesystem::path &path);
+
+        std::shared_ptr<Context> m_context;
+
+        std::mutex                                   m_mutex;
+        std::unordered_set<GraphicsPipeline *>       m_pipelines;
+        std::unordered_map<std::string, WatchedFile> m_files; // by absolute, normalized path
+
+#ifdef __linux__
+        int                                  m_inotify = -1;
+        std::unordered_map<int, std::string> m_watch_dirs;
+        std::unordered_set<std::string>      m_watched_dirs;
+#else
+        std::chrono::steady_clock::time_point m_next_poll;
+#endif
+
+        struct Sources {
+            std::filesystem::path source_dir;
+            std::filesystem::path output_dir;
+            std::filesystem::path glslc;
+        };
+
+        std::optional<Sources>      m_sources;
+        std::unique_ptr<ThreadPool> m_compiler; // a single thread, glslc runs off the render thread
+
+        std::atomic<uint64_t> m_reload_count = 0;
+    };
+
+} // namespace kat
@@ -0,0 +1,82 @@
+#include "kat/graphics/staging_ring.hpp"
+
+#include <algorithm>
+
+namespace kat {
+    StagingRing::StagingRing(const std::shared_ptr<Context> &context, vk::DeviceSize capacity) : m_context(context), m_capacity(capacity) {
+        m_buffer = m_context->gpu_allocator()->create_buffer(m_capacity, vk::BufferUsageFlagBits::eTransferSrc, HOST_WRITE_MAPPED.with_category(MemoryCategory::STAGING));
+        m_mapped = static_cast<char *>(m_buffer->mapped_ptr());
+    }
+
+    uint64_t StagingRing::open() {
+        std::lock_guard lock(m_marks_mutex);
+
+        // anything allocated from here on is at or after the current head.
+        const uint64_t position = m_head.load(std::memory_order_acquire);
+        m_open.insert(position);
+        return position;
+    }
+
+    void StagingRing::close(uint64_t position, uint64_t value) {
+        std::lock_guard lock(m_marks_mutex);
+
+        m_open.erase(m_open.find(position));
+
+        // marks made while this user was open may cover its allocations, so they can't retire before it does.
+        for (auto &mark : m_marks) {
+            if (mark.position > position)
+                mark.value = std::max(mark.value, value);
+        }
+
+        const uint64_t head = m_head.load(std::memory_order_acquire);
+        if (!m_marks.empty() && m_marks.back().position == head) {
+            m_marks.back().value = std::max(m_marks.back().value, value);
+        } else {
+            m_marks.push_back(Mark{head, value});
+        }
+    }
+
+    std::optional<StagingRing::Region> StagingRing::allocate(vk::DeviceSize size, vk::DeviceSize alignment) {
+        if (size > m_capacity)
+            return std::nullopt;
+
+        uint64_t head = m_head.load(std::memory_order_relaxed);
+        while (true) {
+            // alignment is applied to the offset in the buffer, the capacity doesn't have to be a multiple of it.
+            const uint64_t wrap_start = head - head % m_capacity;
+            uint64_t       offset     = (head % m_capacity + alignment - 1) / alignment * alignment;
+
+            // a region can't wrap around the end of the buffer, skip to the start instead.
+            uint64_t position = wrap_start + offset;
+            if (offset + size > m_capacity) {
+                position = wrap_start + m_capacity;
+                offset   = 0;
+            }
+
+            const uint64_t new_head = position + size;
+            if (new_head - m_tail.load(std::memory_order_acquire) > m_capacity)
+                return std::nullopt;
+
+            if (m_head.compare_exchange_weak(head, new_head, std::memory_order_acq_rel, std::memory_order_relaxed))
+                return Region{m_buffer->handle(), offset, m_mapped + offset, size};
+        }
+    }
+
+    void StagingRing::flush(const Region &region) const {
+        m_buffer->flush(region.offset, region.size);
+    }
+
+    void StagingRing::reclaim(uint64_t completed_value) {
+        std::lock_guard lock(m_marks_mutex);
+
+        const uint64_t limit = m_open.empty() ? UINT64_MAX : *m_open.begin();
+
+        uint64_t tail = m_tail.load(std::memory_order_relaxed);
+        while (!m_marks.empty() && m_marks.front().value <= completed_value && m_marks.front().position <= limit) {
+            tail = m_marks.front().position;
+            m_marks.pop_front();
+        }
+
+        m_tail.store(tail, std::memory_order_release);
+    }
+} // namespace kat
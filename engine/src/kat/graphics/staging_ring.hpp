@@ -0,0 +1,73 @@
+#pragma once
+
+#include "kat/graphics/context.hpp"
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+
+namespace kat {
+
+    // A persistently mapped staging buffer used as a ring. Allocation is a lock-free pointer bump, and memory is given back in bulk once the timeline value it
+    // was retired with has been reached. Positions are absolute byte counts which only ever grow, the offset into the buffer is position % capacity.
+    //
+    // Anything allocating from the ring has to open() it first and close() it with the timeline value of the work reading the memory. While a user is open,
+    // nothing allocated after it opened can be reclaimed, even if later users with lower values have already finished.
+    class StagingRing {
+      public:
+        struct Region {
+            vk::Buffer     buffer;
+            vk::DeviceSize offset;
+            void          *mapped;
+            vk::DeviceSize size;
+        };
+
+        StagingRing(const std::shared_ptr<Context> &context, vk::DeviceSize capacity);
+
+        StagingRing(const StagingRing &)            = delete;
+        StagingRing &operator=(const StagingRing &) = delete;
+
+        // Returns the position to pass to close().
+        [[nodiscard]] uint64_t open();
+
+        // Everything allocated since open() returned position is in use until value has been reached. A value of 0 means the memory was never used by the gpu.
+        void close(uint64_t position, uint64_t value);
+
+        // Returns nullopt when the ring doesn't have enough free space (or size is larger than the ring), callers are expected to fall back to a dedicated buffer.
+        [[nodiscard]] std::optional<Region> allocate(vk::DeviceSize size, vk::DeviceSize alignment);
+
+        // Has to be called after writing to a region, in case the ring isn't in host coherent memory.
+        void flush(const Region &region) const;
+
+        // Frees everything which was closed with a value <= completed_value.
+        void reclaim(uint64_t completed_value);
+
+        [[nodiscard]] inline vk::DeviceSize capacity() const { return m_capacity; };
+
+        // Bytes currently allocated or waiting to be reclaimed.
+        [[nodiscard]] inline vk::DeviceSize used() const { return m_head.load(std::memory_order_relaxed) - m_tail.load(std::memory_order_relaxed); };
+
+      private:
+        struct Mark {
+            uint64_t position;
+            uint64_t value;
+        };
+
+        std::shared_ptr<Context> m_context;
+        std::shared_ptr<Buffer>  m_buffer;
+        char                    *m_mapped;
+        vk::DeviceSize           m_capacity;
+
+        std::atomic<uint64_t> m_head = 0;
+        std::atomic<uint64_t> m_tail = 0;
+
+        // only touched once per user (not per allocation), so a mutex is fine here.
+        std::mutex              m_marks_mutex;
+        std::deque<Mark>        m_marks;
+        std::multiset<uint64_t> m_open;
+    };
+
+} // namespace kat
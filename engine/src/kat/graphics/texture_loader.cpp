@@ -0,0 +1,131 @@
+#include "kat/graphics/texture_loader.hpp"
+
+#include "kat/util/profiler.hpp"
+
+#include <iostream>
+
+namespace kat {
+    AsyncTexture::AsyncTexture(std::filesystem::path path) : m_path(std::move(path)) {}
+
+    std::shared_ptr<Image> AsyncTexture::image() const {
+        if (is_ready())
+            return m_image;
+        return nullptr;
+    }
+
+    void AsyncTexture::finish(bool success) {
+        m_state.store(success ? State::READY : State::FAILED, std::memory_order_release);
+        m_state.notify_all();
+    }
+
+    TextureLoader::TextureLoader(const std::shared_ptr<Context> &context, uint32_t thread_count) : m_context(context), m_thread_pool(thread_count) {}
+
+    TextureLoader::~TextureLoader() {
+        shutdown();
+    }
+
+    std::shared_ptr<AsyncTexture> TextureLoader::load(const std::filesystem::path &path, bool generate_mips, ReadyCallback on_ready) {
+        auto texture = std::make_shared<AsyncTexture>(path);
+        m_pending.fetch_add(1, std::memory_order_acq_rel);
+
+        m_thread_pool.submit([this, generate_mips, entry = Entry{texture, std::move(on_ready)}](uint32_t) {
+            KAT_PROFILE_ZONE("decode_texture");
+
+            // every texture gets a batch of its own so that workers never wait on each other, update() merges them before submitting.
+            auto batch   = m_context->upload_queue()->begin_batch();
+            bool success = false;
+            try {
+                const auto [image, format, extent] = m_context->gpu_allocator()->load_image(batch, entry.texture->m_path, generate_mips);
+                entry.texture->m_image             = image;
+                entry.texture->m_format            = format;
+                entry.texture->m_extent            = extent;
+                success                            = true;
+            } catch (const std::exception &e) {
+                std::cerr << "Error: Failed to load texture " << entry.texture->m_path << ": " << e.what() << std::endl;
+            }
+
+            {
+                std::lock_guard lock(m_decoded_mutex);
+                if (success)
+                    m_decoded.push_back(Decoded{std::move(batch), entry});
+                else
+                    m_failed.push_back(entry);
+            }
+
+            m_decode_generation.fetch_add(1, std::memory_order_release);
+            m_decode_generation.notify_all();
+        });
+
+        return texture;
+    }
+
+    void TextureLoader::update() {
+        KAT_PROFILE_FUNCTION();
+
+        std::vector<Decoded> decoded;
+        std::vector<Entry>   failed;
+        {
+            std::lock_guard lock(m_decoded_mutex);
+            decoded.swap(m_decoded);
+            failed.swap(m_failed);
+        }
+
+        for (const auto &entry : failed) {
+            finish(entry, false);
+        }
+
+        if (!decoded.empty()) {
+            auto     batch = m_context->upload_queue()->begin_batch();
+            InFlight in_flight;
+            for (auto &d : decoded) {
+                batch.append(std::move(d.batch));
+                in_flight.entries.push_back(std::move(d.entry));
+            }
+
+            in_flight.ticket = m_context->upload_queue()->submit(std::move(batch));
+            m_in_flight.push_back(std::move(in_flight));
+        }
+
+        // uploads retire in submission order.
+        while (!m_in_flight.empty() && m_context->upload_queue()->is_complete(m_in_flight.front().ticket)) {
+            for (const auto &entry : m_in_flight.front().entries) {
+                finish(entry, true);
+            }
+            m_in_flight.pop_front();
+        }
+    }
+
+    void TextureLoader::wait_idle() {
+        KAT_PROFILE_FUNCTION();
+
+        while (pending() > 0) {
+            // read before update(), so a texture decoded while it runs is picked up by the next iteration instead of being slept through.
+            const uint32_t generation = m_decode_generation.load(std::memory_order_acquire);
+
+            update();
+            if (pending() == 0)
+                break;
+
+            if (!m_in_flight.empty())
+                m_context->upload_queue()->wait(m_in_flight.back().ticket);
+            else
+                m_decode_generation.wait(generation, std::memory_order_acquire);
+        }
+    }
+
+    void TextureLoader::shutdown() {
+        if (m_shut_down)
+            return;
+        m_shut_down = true;
+
+        m_thread_pool.shutdown();
+    }
+
+    void TextureLoader::finish(const Entry &entry, bool success) {
+        entry.texture->finish(success);
+        if (success && entry.on_ready)
+            entry.on_ready(entry.texture);
+
+        m_pending.fetch_sub(1, std::memory_order_acq_rel);
+    }
+} // namespace kat
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "kat/graphics/context.hpp"
+#include "kat/graphics/upload_queue.hpp"
+#include "kat/util/thread_pool.hpp"
+
+#include <atomic>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace kat {
+
+    // A texture which is being loaded in the background. The image can only be used once the texture is ready, which is when its upload has retired.
+    class AsyncTexture {
+      public:
+        enum class State : uint32_t { PENDING, READY, FAILED };
+
+        explicit AsyncTexture(std::filesystem::path path);
+
+        [[nodiscard]] inline State state() const { return m_state.load(std::memory_order_acquire); };
+
+        [[nodiscard]] inline bool is_ready() const { return state() == State::READY; };
+
+        [[nodiscard]] inline bool is_done() const { return state() != State::PENDING; };
+
+        // null until the texture is ready.
+        [[nodiscard]] std::shared_ptr<Image> image() const;
+
+        // only valid once the texture is ready.
+        [[nodiscard]] inline vk::Format format() const { return m_format; };
+
+        [[nodiscard]] inline vk::Extent2D extent() const { return m_extent; };
+
+        [[nodiscard]] inline const std::filesystem::path &path() const { return m_path; };
+
+      private:
+        friend class TextureLoader;
+
+        void finish(bool success);
+
+        std::filesystem::path m_path;
+
+        // written by the worker which decoded the texture, before it's handed over to the render thread.
+        std::shared_ptr<Image> m_image;
+        vk::Format             m_format = vk::Format::eUndefined;
+        vk::Extent2D           m_extent;
+
+        std::atomic<State> m_state = State::PENDING;
+    };
+
+    // Decodes textures on a pool of worker threads. Each worker decodes a file (and generates mips on the cpu when the format needs it) and stages it into an
+    // upload batch of its own. update() then gathers every batch finished since the last call into a single submission, and marks the textures ready once it
+    // has retired. Loading n textures takes roughly n / thread count decode times instead of n.
+    class TextureLoader {
+      public:
+        explicit TextureLoader(const std::shared_ptr<Context> &context, uint32_t thread_count = 0);
+
+        ~TextureLoader();
+
+        using ReadyCallback = std::function<void(const std::shared_ptr<AsyncTexture> &)>;
+
+        // Queues a png/jpg/ktx2 file for loading, see GpuAllocator::load_image(). on_ready is called on the render thread (from update()) once the texture is ready.
+        [[nodiscard]] std::shared_ptr<AsyncTexture> load(const std::filesystem::path &path, bool generate_mips = true, ReadyCallback on_ready = {});
+
+        // Submits everything decoded since the last call and finishes textures whose uploads have retired. Called by the context every frame, on the render
+        // thread, which is the only thread allowed to call it.
+        void update();
+
+        // Blocks until every texture queued so far is done. Drives update() itself, so it has to be called on the render thread, or before App::launch() has
+        // started it.
+        void wait_idle();
+
+        // Finishes queued loads and stops the workers.
+        void shutdown();
+
+        [[nodiscard]] inline uint32_t pending() const { return m_pending.load(std::memory_order_acquire); };
+
+      private:
+        struct Entry {
+            std::shared_ptr<AsyncTexture> texture;
+            ReadyCallback                 on_ready;
+        };
+
+        struct Decoded {
+            UploadBatch batch;
+            Entry       entry;
+        };
+
+        struct InFlight {
+            UploadTicket       ticket;
+            std::vector<Entry> entries;
+        };
+
+        void finish(const Entry &entry, bool success);
+
+        std::shared_ptr<Context> m_context;
+        ThreadPool               m_thread_pool;
+        bool                     m_shut_down = false;
+
+        // textures which have been queued but aren't done yet.
+        std::atomic<uint32_t> m_pending = 0;
+
+        // bumped whenever a worker finishes decoding, wait_idle() sleeps on it.
+        std::atomic<uint32_t> m_decode_generation = 0;
+
+        std::mutex           m_decoded_mutex;
+        std::vector<Decoded> m_decoded;
+        std::vector<Entry>   m_failed;
+
+        // only touched by the render thread.
+        std::deque<InFlight> m_in_flight;
+    };
+
+} // namespace kat
@@ -0,0 +1,356 @@
+#include "kat/graphics/upload_queue.hpp"
+
+#include "kat/graphics/mipmaps.hpp"
+#include "kat/util/profiler.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <numeric>
+#include <utility>
+
+namespace kat {
+    // staging memory is allocated in chunks of (at least) this size, so a batch of many small uploads only needs a handful of staging buffers.
+    constexpr vk::DeviceSize STAGING_CHUNK_SIZE = 4 * 1024 * 1024;
+
+    constexpr vk::DeviceSize align_up(vk::DeviceSize value, vk::DeviceSize alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    UploadBatch::UploadBatch(const std::shared_ptr<Context> &context, StagingRing *ring) : m_context(context), m_ring(ring) {}
+
+    UploadBatch::UploadBatch(UploadBatch &&other) noexcept
+        : m_context(std::move(other.m_context)), m_ring(other.m_ring), m_ring_positions(std::exchange(other.m_ring_positions, {})),
+          m_staging_chunks(std::move(other.m_staging_chunks)), m_buffer_copies(std::move(other.m_buffer_copies)), m_image_copies(std::move(other.m_image_copies)) {}
+
+    UploadBatch &UploadBatch::operator=(UploadBatch &&other) noexcept {
+        if (this != &other) {
+            release_staging();
+
+            m_context        = std::move(other.m_context);
+            m_ring           = other.m_ring;
+            m_ring_positions = std::exchange(other.m_ring_positions, {});
+            m_staging_chunks = std::move(other.m_staging_chunks);
+            m_buffer_copies  = std::move(other.m_buffer_copies);
+            m_image_copies   = std::move(other.m_image_copies);
+        }
+
+        return *this;
+    }
+
+    UploadBatch::~UploadBatch() {
+        release_staging();
+    }
+
+    void UploadBatch::upload_buffer(const std::shared_ptr<Buffer> &dst, const void *data, vk::DeviceSize size, vk::DeviceSize dst_offset) {
+        const auto [staging, staging_offset] = stage(data, size, 16);
+        m_buffer_copies.push_back(BufferCopy{dst, staging, vk::BufferCopy(staging_offset, dst_offset, size)});
+    }
+
+    void UploadBatch::upload_image(const std::shared_ptr<Image> &dst, const void *data, vk::DeviceSize size, const std::vector<vk::BufferImageCopy> &regions,
+                                   uint32_t texel_block_size, vk::ImageLayout final_layout) {
+        // buffer offsets for image copies have to be a multiple of both the texel block size and 4.
+        const auto [staging, staging_offset] = stage(data, size, std::lcm<vk::DeviceSize>(16, texel_block_size));
+
+        ImageCopy copy{dst, staging, regions, final_layout};
+        for (auto &region : copy.regions) {
+            region.bufferOffset += staging_offset;
+        }
+
+        m_image_copies.push_back(std::move(copy));
+    }
+
+    void UploadBatch::upload_image(const std::shared_ptr<Image> &dst, const void *data, vk::DeviceSize size, vk::Extent2D extent, uint32_t texel_block_size,
+                                   vk::ImageLayout final_layout) {
+        vk::BufferImageCopy copy{};
+        copy.bufferOffset                    = 0;
+        copy.bufferRowLength                 = 0;
+        copy.bufferImageHeight               = 0;
+        copy.imageSubresource.aspectMask     = vk::ImageAspectFlagBits::eColor;
+        copy.imageSubresource.mipLevel       = 0;
+        copy.imageSubresource.baseArrayLayer = 0;
+        copy.imageSubresource.layerCount     = 1;
+        copy.imageOffset                     = vk::Offset3D{0, 0, 0};
+        copy.imageExtent                     = vk::Extent3D{extent.width, extent.height, 1};
+
+        upload_image(dst, data, size, std::vector{copy}, texel_block_size, final_layout);
+    }
+
+    void UploadBatch::upload_image_and_blit_mips(const std::shared_ptr<Image> &dst, const void *data, vk::DeviceSize size, vk::Extent2D extent, uint32_t texel_block_size,
+                                                 uint32_t mip_levels, vk::ImageLayout final_layout) {
+        upload_image(dst, data, size, extent, texel_block_size, final_layout);
+
+        auto &copy           = m_image_copies.back();
+        copy.blit_mip_levels = mip_levels;
+        copy.blit_extent     = extent;
+    }
+
+    void UploadBatch::append(UploadBatch &&other) {
+        // anything staged after one of the positions was opened stays in use until they're all closed together, so nothing has to be copied.
+        m_ring_positions.insert(m_ring_positions.end(), other.m_ring_positions.begin(), other.m_ring_positions.end());
+        other.m_ring_positions.clear();
+
+        std::ranges::move(other.m_staging_chunks, std::back_inserter(m_staging_chunks));
+        std::ranges::move(other.m_buffer_copies, std::back_inserter(m_buffer_copies));
+        std::ranges::move(other.m_image_copies, std::back_inserter(m_image_copies));
+
+        other.m_staging_chunks.clear();
+        other.m_buffer_copies.clear();
+        other.m_image_copies.clear();
+    }
+
+    std::pair<vk::Buffer, vk::DeviceSize> UploadBatch::stage(const void *data, vk::DeviceSize size, vk::DeviceSize alignment) {
+        // uploads bigger than a frame's share of the ring would starve everything else, so those always get their own staging buffer.
+        if (m_ring && size <= m_ring->capacity() / m_context->frames_in_flight()) {
+            if (m_ring_positions.empty())
+                m_ring_positions.push_back(m_ring->open());
+
+            if (const auto region = m_ring->allocate(size, alignment)) {
+                std::memcpy(region->mapped, data, size);
+                m_ring->flush(*region);
+                return {region->buffer, region->offset};
+            }
+        }
+
+        StagingChunk *chunk = m_staging_chunks.empty() ? nullptr : &m_staging_chunks.back();
+
+        if (!chunk || align_up(chunk->used, alignment) + size > chunk->capacity) {
+            const vk::DeviceSize capacity = std::max(STAGING_CHUNK_SIZE, size);
+
+            // oversized uploads get a chunk of their own outside of the staging pool, which would otherwise have to grow a block just for them.
+            const auto allocation = capacity <= STAGING_CHUNK_SIZE ? m_context->gpu_allocator()->pool(STAGING_POOL) : HOST_WRITE_MAPPED.with_category(MemoryCategory::STAGING);
+
+            auto buffer = m_context->gpu_allocator()->create_buffer(capacity, vk::BufferUsageFlagBits::eTransferSrc, allocation);
+            void *mapped = buffer->mapped_ptr();
+
+            chunk = &m_staging_chunks.emplace_back(StagingChunk{std::move(buffer), mapped, capacity, 0});
+        }
+
+        const vk::DeviceSize offset = align_up(chunk->used, alignment);
+        std::memcpy(static_cast<char *>(chunk->mapped) + offset, data, size);
+        chunk->buffer->flush(offset, size);
+        chunk->used = offset + size;
+
+        return {chunk->buffer->handle(), offset};
+    }
+
+    void UploadBatch::release_staging() {
+        // a batch that is destroyed without being submitted never used its ring memory.
+        for (const uint64_t position : m_ring_positions) {
+            m_ring->close(position, 0);
+        }
+        m_ring_positions.clear();
+
+        m_staging_chunks.clear();
+    }
+
+    UploadQueue::UploadQueue(const std::shared_ptr<Context> &context)
+        : m_context(context), m_transfer_family(context->transfer_family()), m_graphics_family(context->graphics_family()) {
+        m_transfer_pool = m_context->create_command_pool_raw(m_transfer_family, true);
+        m_graphics_pool = m_context->create_command_pool_raw(m_graphics_family, true);
+        m_timeline      = m_context->create_timeline_semaphore(0);
+
+        m_staging_ring = std::make_unique<StagingRing>(m_context, m_context->staging_ring_size() * m_context->frames_in_flight());
+    }
+
+    UploadQueue::~UploadQueue() {
+        m_context->wait_for_semaphore(m_timeline, m_next_value - 1);
+        collect();
+
+        m_context->device().destroy(m_transfer_pool);
+        m_context->device().destroy(m_graphics_pool);
+        m_context->device().destroy(m_timeline);
+    }
+
+    UploadBatch UploadQueue::begin_batch() const {
+        return UploadBatch(m_context, m_staging_ring.get());
+    }
+
+    UploadTicket UploadQueue::submit(UploadBatch &&batch) {
+        KAT_PROFILE_FUNCTION();
+
+        if (batch.empty())
+            return {};
+
+        // frees up ring space and command buffers for the next batches.
+        collect();
+
+        std::lock_guard lock(m_mutex);
+
+        const auto transfer_cmd = m_context->allocate_command_buffers_raw<1>(m_transfer_pool)[0];
+        transfer_cmd.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+        record_transfer(transfer_cmd, batch);
+        transfer_cmd.end();
+
+        const uint64_t transfer_value = m_next_value++;
+        {
+            vk::TimelineSemaphoreSubmitInfo tsi{};
+            tsi.setSignalSemaphoreValues(transfer_value);
+
+            vk::SubmitInfo si{};
+            si.setCommandBuffers(transfer_cmd);
+            si.setSignalSemaphores(m_timeline);
+            si.pNext = &tsi;
+
+            m_context->submit(QueueType::TRANSFER, si);
+        }
+
+        uint64_t          value = transfer_value;
+        vk::CommandBuffer graphics_cmd;
+
+        if (has_ownership_transfer()) {
+            // the graphics queue has to acquire ownership of everything the transfer queue released.
+            graphics_cmd = m_context->allocate_command_buffers_raw<1>(m_graphics_pool)[0];
+            graphics_cmd.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+            record_acquire(graphics_cmd, batch);
+            graphics_cmd.end();
+
+            const uint64_t                  acquire_value = m_next_value++;
+            const vk::PipelineStageFlags    wait_stage    = vk::PipelineStageFlagBits::eAllCommands;
+            vk::TimelineSemaphoreSubmitInfo tsi{};
+            tsi.setWaitSemaphoreValues(transfer_value);
+            tsi.setSignalSemaphoreValues(acquire_value);
+
+            vk::SubmitInfo si{};
+            si.setCommandBuffers(graphics_cmd);
+            si.setWaitSemaphores(m_timeline);
+            si.setWaitDstStageMask(wait_stage);
+            si.setSignalSemaphores(m_timeline);
+            si.pNext = &tsi;
+
+            m_context->submit(QueueType::GRAPHICS, si);
+
+            value = acquire_value;
+        }
+
+        for (const uint64_t position : batch.m_ring_positions) {
+            m_staging_ring->close(position, value);
+        }
+        batch.m_ring_positions.clear();
+
+        m_in_flight.push_back(InFlightBatch{value, transfer_cmd, graphics_cmd, std::move(batch)});
+
+        return UploadTicket{value};
+    }
+
+    bool UploadQueue::is_complete(const UploadTicket &ticket) const {
+        return ticket.value == 0 || m_context->device().getSemaphoreCounterValue(m_timeline) >= ticket.value;
+    }
+
+    void UploadQueue::wait(const UploadTicket &ticket) {
+        KAT_PROFILE_FUNCTION();
+
+        m_context->wait_for_semaphore(m_timeline, ticket.value);
+        collect();
+    }
+
+    void UploadQueue::wait_idle() {
+        uint64_t last;
+        {
+            std::lock_guard lock(m_mutex);
+            last = m_next_value - 1;
+        }
+
+        wait(UploadTicket{last});
+    }
+
+    void UploadQueue::collect() {
+        std::lock_guard lock(m_mutex);
+
+        const uint64_t completed = m_context->device().getSemaphoreCounterValue(m_timeline);
+        while (!m_in_flight.empty() && m_in_flight.front().value <= completed) {
+            auto &batch = m_in_flight.front();
+
+            // only now are the images actually in their final layout, defragmentation may move them from here on.
+            for (const auto &copy : batch.batch.m_image_copies) {
+                copy.dst->set_resting_layout(copy.final_layout);
+            }
+
+            m_context->device().freeCommandBuffers(m_transfer_pool, batch.transfer_cmd);
+            if (batch.graphics_cmd)
+                m_context->device().freeCommandBuffers(m_graphics_pool, batch.graphics_cmd);
+
+            m_in_flight.pop_front();
+        }
+
+        m_staging_ring->reclaim(completed);
+    }
+
+    void UploadQueue::record_transfer(const vk::CommandBuffer &cmd, const UploadBatch &batch) const {
+        const bool     ownership_transfer = has_ownership_transfer();
+        const uint32_t src_family         = ownership_transfer ? m_transfer_family : VK_QUEUE_FAMILY_IGNORED;
+        const uint32_t dst_family         = ownership_transfer ? m_graphics_family : VK_QUEUE_FAMILY_IGNORED;
+
+        // without an ownership transfer, this is the only barrier between the copies and whatever uses the resources, so it has to cover everything.
+        const vk::AccessFlags        release_access = ownership_transfer ? vk::AccessFlags{} : vk::AccessFlagBits::eMemoryRead | vk::AccessFlagBits::eMemoryWrite;
+        const vk::PipelineStageFlags release_stage  = ownership_transfer ? vk::PipelineStageFlagBits::eBottomOfPipe : vk::PipelineStageFlagBits::eAllCommands;
+
+        if (!batch.m_image_copies.empty()) {
+            std::vector<vk::ImageMemoryBarrier> to_transfer_dst;
+            to_transfer_dst.reserve(batch.m_image_copies.size());
+
+            for (const auto &copy : batch.m_image_copies) {
+                to_transfer_dst.push_back(vk::ImageMemoryBarrier({}, vk::AccessFlagBits::eTransferWrite, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal,
+                                                                 VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, copy.dst->handle(), FULL_SUBRESOURCE_RANGE));
+            }
+
+            cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer, {}, {}, {}, to_transfer_dst);
+        }
+
+        std::vector<vk::BufferMemoryBarrier> buffer_releases;
+        buffer_releases.reserve(batch.m_buffer_copies.size());
+
+        for (const auto &copy : batch.m_buffer_copies) {
+            cmd.copyBuffer(copy.staging, copy.dst->handle(), copy.region);
+            buffer_releases.push_back(vk::BufferMemoryBarrier(vk::AccessFlagBits::eTransferWrite, release_access, src_family, dst_family, copy.dst->handle(),
+                                                              copy.region.dstOffset, copy.region.size));
+        }
+
+        std::vector<vk::ImageMemoryBarrier> image_releases;
+        image_releases.reserve(batch.m_image_copies.size());
+
+        for (const auto &copy : batch.m_image_copies) {
+            cmd.copyBufferToImage(copy.staging, copy.dst->handle(), vk::ImageLayout::eTransferDstOptimal, copy.regions);
+
+            // on the graphics family already, so the mips can be generated right here and leave the image in its final layout.
+            if (!ownership_transfer && copy.blit_mip_levels > 1) {
+                record_mip_generation(cmd, copy.dst->handle(), copy.blit_extent, copy.blit_mip_levels, copy.final_layout);
+                continue;
+            }
+
+            image_releases.push_back(vk::ImageMemoryBarrier(vk::AccessFlagBits::eTransferWrite, release_access, vk::ImageLayout::eTransferDstOptimal, copy.release_layout(),
+                                                            src_family, dst_family, copy.dst->handle(), FULL_SUBRESOURCE_RANGE));
+        }
+
+        cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, release_stage, {}, {}, buffer_releases, image_releases);
+    }
+
+    void UploadQueue::record_acquire(const vk::CommandBuffer &cmd, const UploadBatch &batch) const {
+        const vk::AccessFlags acquire_access = vk::AccessFlagBits::eMemoryRead | vk::AccessFlagBits::eMemoryWrite;
+
+        std::vector<vk::BufferMemoryBarrier> buffer_acquires;
+        buffer_acquires.reserve(batch.m_buffer_copies.size());
+
+        for (const auto &copy : batch.m_buffer_copies) {
+            buffer_acquires.push_back(vk::BufferMemoryBarrier({}, acquire_access, m_transfer_family, m_graphics_family, copy.dst->handle(), copy.region.dstOffset,
+                                                              copy.region.size));
+        }
+
+        // the layouts have to match the release barrier exactly, the transition only happens once.
+        std::vector<vk::ImageMemoryBarrier> image_acquires;
+        image_acquires.reserve(batch.m_image_copies.size());
+
+        for (const auto &copy : batch.m_image_copies) {
+            image_acquires.push_back(vk::ImageMemoryBarrier({}, acquire_access, vk::ImageLayout::eTransferDstOptimal, copy.release_layout(), m_transfer_family,
+                                                            m_graphics_family, copy.dst->handle(), FULL_SUBRESOURCE_RANGE));
+        }
+
+        cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eAllCommands, {}, {}, buffer_acquires, image_acquires);
+
+        // blits need a graphics queue, so mips are generated here rather than on the transfer queue.
+        for (const auto &copy : batch.m_image_copies) {
+            if (copy.blit_mip_levels > 1)
+                record_mip_generation(cmd, copy.dst->handle(), copy.blit_extent, copy.blit_mip_levels, copy.final_layout);
+        }
+    }
+} // namespace kat
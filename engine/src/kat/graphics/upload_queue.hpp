@@ -0,0 +1,160 @@
+#pragma once
+
+#include "kat/graphics/context.hpp"
+#include "kat/graphics/staging_ring.hpp"
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+namespace kat {
+
+    // Identifies a submitted upload batch. A default constructed ticket refers to nothing, and is always complete.
+    struct UploadTicket {
+        uint64_t value = 0;
+    };
+
+    class UploadQueue;
+
+    // Collects uploads so they can be recorded into a single command buffer and submitted together. Data is copied into staging memory immediately, so the
+    // source pointers don't need to outlive the call. Nothing is recorded until the batch is submitted with UploadQueue::submit().
+    // Small uploads are staged in the upload queue's StagingRing, anything that doesn't fit gets a dedicated staging buffer.
+    class UploadBatch {
+      public:
+        UploadBatch(UploadBatch &&other) noexcept;
+        UploadBatch &operator=(UploadBatch &&other) noexcept;
+
+        UploadBatch(const UploadBatch &)            = delete;
+        UploadBatch &operator=(const UploadBatch &) = delete;
+
+        ~UploadBatch();
+
+        void upload_buffer(const std::shared_ptr<Buffer> &dst, const void *data, vk::DeviceSize size, vk::DeviceSize dst_offset = 0);
+
+        // Uploads tightly packed texels into the given regions of the image, the bufferOffset of each region is relative to data. Every subresource of the image
+        // ends up in final_layout. texel_block_size is the size in bytes of one texel (or compressed block) of the image's format.
+        void upload_image(const std::shared_ptr<Image> &dst, const void *data, vk::DeviceSize size, const std::vector<vk::BufferImageCopy> &regions, uint32_t texel_block_size,
+                          vk::ImageLayout final_layout);
+
+        // Uploads the first mip level of the first layer of a 2d image.
+        void upload_image(const std::shared_ptr<Image> &dst, const void *data, vk::DeviceSize size, vk::Extent2D extent, uint32_t texel_block_size, vk::ImageLayout final_layout);
+
+        // Uploads the first mip level of the first layer of a 2d image, and fills in the levels below it with linear blits once the image has reached the graphics
+        // queue. The image needs transfer src usage and a format supporting linear blits (see supports_linear_blit()).
+        void upload_image_and_blit_mips(const std::shared_ptr<Image> &dst, const void *data, vk::DeviceSize size, vk::Extent2D extent, uint32_t texel_block_size,
+                                        uint32_t mip_levels, vk::ImageLayout final_layout);
+
+        // Moves everything in other into this batch, so batches filled on different threads can be submitted together. Both have to come from the same upload queue.
+        void append(UploadBatch &&other);
+
+        [[nodiscard]] inline bool empty() const { return m_buffer_copies.empty() && m_image_copies.empty(); };
+
+      private:
+        friend class UploadQueue;
+
+        UploadBatch(const std::shared_ptr<Context> &context, StagingRing *ring);
+
+        struct StagingChunk {
+            std::shared_ptr<Buffer> buffer;
+            void                   *mapped;
+            vk::DeviceSize          capacity;
+            vk::DeviceSize          used;
+        };
+
+        struct BufferCopy {
+            std::shared_ptr<Buffer> dst;
+            vk::Buffer              staging;
+            vk::BufferCopy          region;
+        };
+
+        struct ImageCopy {
+            std::shared_ptr<Image>           dst;
+            vk::Buffer                       staging;
+            std::vector<vk::BufferImageCopy> regions;
+            vk::ImageLayout                  final_layout;
+
+            // levels past the first are blitted from it when this is more than 1.
+            uint32_t     blit_mip_levels = 1;
+            vk::Extent2D blit_extent     = {};
+
+            // the layout the transfer queue leaves the image in, mip generation needs it to stay a transfer destination until the blits.
+            [[nodiscard]] inline vk::ImageLayout release_layout() const { return blit_mip_levels > 1 ? vk::ImageLayout::eTransferDstOptimal : final_layout; };
+        };
+
+        // copies data into staging memory, returning the staging buffer and the offset the data was placed at.
+        std::pair<vk::Buffer, vk::DeviceSize> stage(const void *data, vk::DeviceSize size, vk::DeviceSize alignment);
+
+        void release_staging();
+
+        std::shared_ptr<Context> m_context;
+
+        // the ring is opened on the first allocation from it, and closed when the batch is submitted (or destroyed without being submitted). Appended batches
+        // bring their own positions along.
+        StagingRing          *m_ring;
+        std::vector<uint64_t> m_ring_positions;
+
+        std::vector<StagingChunk> m_staging_chunks;
+        std::vector<BufferCopy>   m_buffer_copies;
+        std::vector<ImageCopy>    m_image_copies;
+    };
+
+    // Uploads data to device local resources through the dedicated transfer queue. Batches are recorded into one command buffer, submitted once, and then
+    // handed over to the graphics queue with a queue family ownership transfer. Completion is tracked with a timeline semaphore, so waiting on an upload is a
+    // semaphore wait rather than a fence per upload.
+    class UploadQueue {
+      public:
+        explicit UploadQueue(const std::shared_ptr<Context> &context);
+
+        ~UploadQueue();
+
+        [[nodiscard]] UploadBatch begin_batch() const;
+
+        // Records and submits the batch. Resources in the batch are usable by the graphics queue once the ticket is complete, and any graphics queue submission
+        // made after this call is already ordered after the upload.
+        UploadTicket submit(UploadBatch &&batch);
+
+        [[nodiscard]] bool is_complete(const UploadTicket &ticket) const;
+
+        void wait(const UploadTicket &ticket);
+
+        // Waits for every batch submitted so far.
+        void wait_idle();
+
+        // Releases staging memory and command buffers of batches which have finished.
+        void collect();
+
+        // Signaled with the ticket value once a batch has finished (including the ownership transfer), for gpu side waits.
+        [[nodiscard]] inline vk::Semaphore timeline_semaphore() const { return m_timeline; };
+
+        [[nodiscard]] inline bool has_ownership_transfer() const { return m_transfer_family != m_graphics_family; };
+
+        [[nodiscard]] inline const std::unique_ptr<StagingRing> &staging_ring() const { return m_staging_ring; };
+
+      private:
+        struct InFlightBatch {
+            uint64_t          value;
+            vk::CommandBuffer transfer_cmd;
+            vk::CommandBuffer graphics_cmd;
+            UploadBatch       batch;
+        };
+
+        void record_transfer(const vk::CommandBuffer &cmd, const UploadBatch &batch) const;
+        void record_acquire(const vk::CommandBuffer &cmd, const UploadBatch &batch) const;
+
+        std::shared_ptr<Context> m_context;
+
+        uint32_t m_transfer_family;
+        uint32_t m_graphics_family;
+
+        std::mutex                   m_mutex;
+        vk::CommandPool              m_transfer_pool;
+        vk::CommandPool              m_graphics_pool;
+        vk::Semaphore                m_timeline;
+        uint64_t                     m_next_value = 1;
+        std::unique_ptr<StagingRing> m_staging_ring;
+        std::deque<InFlightBatch>    m_in_flight;
+    };
+
+} // namespace kat
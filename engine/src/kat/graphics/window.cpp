@@ -25,10 +25,12 @@ namespace kat {
             glfwWindowHint(GLFW_POSITION_Y, settings.pos.y);
         }
 
-        glfwWindowHint(GLFW_RESIZABLE, false);
+        glfwWindowHint(GLFW_RESIZABLE, settings.resizable);
 
         m_window = glfwCreateWindow(size.x, size.y, settings.title.c_str(), nullptr, nullptr);
-        
+        glfwSetWindowUserPointer(m_window, this);
+        glfwSetFramebufferSizeCallback(m_window, framebuffer_size_callback);
+
         glfwGetFramebufferSize(m_window, &m_size.x, &m_size.y);
     } // namespace kat
 
@@ -53,4 +55,12 @@ namespace kat {
     bool Window::get_key(int key) const {
         return glfwGetKey(m_window, key) == GLFW_PRESS;
     }
+
+    void Window::framebuffer_size_callback(GLFWwindow *window_, int width, int height) {
+        // the swapchain notices the change by itself (through out of date/suboptimal results), this just keeps size() and aspect() accurate.
+        Window *window = reinterpret_cast<Window *>(glfwGetWindowUserPointer(window_));
+        if (window) {
+            window->m_size = {width, height};
+        }
+    }
 } // namespace kat
@@ -18,6 +18,7 @@ namespace kat {
         glm::ivec2  pos{GLFW_ANY_POSITION, GLFW_ANY_POSITION};
         std::string title      = "Window";
         bool        fullscreen = false;
+        bool        resizable  = false;
     };
 
     class Window {
@@ -43,6 +44,8 @@ namespace kat {
         [[nodiscard]] inline const std::unique_ptr<InputSystem>& input_system() const { return m_input_system; };
 
       private:
+        static void framebuffer_size_callback(GLFWwindow *window, int width, int height);
+
         GLFWwindow *m_window;
         glm::ivec2  m_size;
         std::unique_ptr<InputSystem> m_input_system;
@@ -0,0 +1,195 @@
+#include "kat/util/asset_pack.hpp"
+
+#include <lz4.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <tuple>
+
+namespace kat {
+    namespace {
+        bool entry_less(const PakEntry &entry, std::string_view entry_name, uint64_t hash, std::string_view name) {
+            return std::tie(entry.path_hash, entry_name) < std::tie(hash, name);
+        }
+    } // namespace
+
+    std::optional<AssetPack> AssetPack::open(const std::filesystem::path &path) {
+        auto file = MappedFile::open(path);
+        if (!file) {
+            std::cerr << "Warning: Failed to open " << path << "." << std::endl;
+            return std::nullopt;
+        }
+
+        const auto bytes = file->bytes();
+
+        PakHeader header{};
+        if (bytes.size() < sizeof(PakHeader)) {
+            std::cerr << "Warning: " << path << " is not an asset pack." << std::endl;
+            return std::nullopt;
+        }
+        std::memcpy(&header, bytes.data(), sizeof(PakHeader));
+
+        if (!std::equal(std::begin(PAK_MAGIC), std::end(PAK_MAGIC), header.magic)) {
+            std::cerr << "Warning: " << path << " is not an asset pack." << std::endl;
+            return std::nullopt;
+        }
+        if (header.version != PAK_VERSION) {
+            std::cerr << "Warning: " << path << " is version " << header.version << ", only version " << PAK_VERSION << " packs can be read." << std::endl;
+            return std::nullopt;
+        }
+
+        const uint64_t index_size = static_cast<uint64_t>(header.entry_count) * sizeof(PakEntry);
+        if (header.index_offset > bytes.size() || index_size > bytes.size() - header.index_offset || header.names_offset > bytes.size()) {
+            std::cerr << "Warning: " << path << " is truncated." << std::endl;
+            return std::nullopt;
+        }
+
+        AssetPack pack;
+        pack.m_path = path;
+
+        // the index is small, copying it out avoids relying on its alignment in the file.
+        pack.m_entries.resize(header.entry_count);
+        std::memcpy(pack.m_entries.data(), bytes.data() + header.index_offset, index_size);
+        pack.m_names = std::string_view(reinterpret_cast<const char *>(bytes.data() + header.names_offset), bytes.size() - header.names_offset);
+
+        for (const auto &entry : pack.m_entries) {
+            if (entry.offset > bytes.size() || entry.stored_size > bytes.size() - entry.offset || entry.name_offset > pack.m_names.size() ||
+                entry.name_size > pack.m_names.size() - entry.name_offset) {
+                std::cerr << "Warning: " << path << " has entries past the end of the file." << std::endl;
+                return std::nullopt;
+            }
+        }
+
+        pack.m_file = std::make_shared<const MappedFile>(std::move(*file));
+        return pack;
+    }
+
+    const PakEntry *AssetPack::find(std::string_view path) const {
+        const uint64_t hash = pak_path_hash(path);
+
+        const auto name_of = [this](const PakEntry &entry) { return m_names.substr(entry.name_offset, entry.name_size); };
+
+        const auto it = std::partition_point(m_entries.begin(), m_entries.end(), [&](const PakEntry &entry) { return entry_less(entry, name_of(entry), hash, path); });
+        if (it == m_entries.end() || it->path_hash != hash || name_of(*it) != path)
+            return nullptr;
+
+        return &*it;
+    }
+
+    bool AssetPack::contains(std::string_view path) const {
+        return find(path) != nullptr;
+    }
+
+    std::optional<Asset> AssetPack::read(std::string_view path) const {
+        const PakEntry *entry = find(path);
+        if (!entry)
+            return std::nullopt;
+
+        // whoever asked for the file is about to read all of it, start pulling it in while the asset is handed over.
+        m_file->prefetch(entry->offset, entry->stored_size);
+
+        const std::span<const unsigned char> stored = m_file->bytes().subspan(entry->offset, entry->stored_size);
+
+        Asset asset;
+        switch (entry->compression) {
+        case PakCompression::NONE:
+            asset.m_file  = m_file;
+            asset.m_bytes = stored;
+            return asset;
+        case PakCompression::LZ4: {
+            if (entry->size > static_cast<uint64_t>(std::numeric_limits<int>::max()))
+                break;
+
+            asset.m_decompressed.resize(entry->size);
+            const int size = LZ4_decompress_safe(reinterpret_cast<const char *>(stored.data()), reinterpret_cast<char *>(asset.m_decompressed.data()),
+                                                 static_cast<int>(stored.size()), static_cast<int>(entry->size));
+            if (size < 0 || static_cast<uint64_t>(size) != entry->size)
+                break;
+
+            asset.m_bytes = asset.m_decompressed;
+            return asset;
+        }
+        }
+
+        std::cerr << "Warning: Failed to read " << path << " from " << m_path << "." << std::endl;
+        return std::nullopt;
+    }
+
+    bool write_asset_pack(const std::filesystem::path &path, std::span<const AssetPackInput> files, bool compress) {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            std::cerr << "Warning: Failed to open " << path << " for writing." << std::endl;
+            return false;
+        }
+
+        const auto pad_to = [&out](uint64_t alignment) {
+            const auto position = static_cast<uint64_t>(out.tellp());
+            const auto padding  = (alignment - position % alignment) % alignment;
+            for (uint64_t i = 0; i < padding; i++) {
+                out.put('\0');
+            }
+            return position + padding;
+        };
+
+        // rewritten once the index has been placed.
+        PakHeader header{};
+        out.write(reinterpret_cast<const char *>(&header), sizeof(PakHeader));
+
+        std::vector<PakEntry> entries;
+        std::string           names;
+        entries.reserve(files.size());
+
+        std::vector<char> compressed;
+        for (const auto &file : files) {
+            PakEntry entry{};
+            entry.path_hash   = pak_path_hash(file.name);
+            entry.offset      = pad_to(PAK_ALIGNMENT);
+            entry.size        = file.bytes.size();
+            entry.name_offset = static_cast<uint32_t>(names.size());
+            entry.name_size   = static_cast<uint32_t>(file.name.size());
+            names += file.name;
+
+            const char *data = reinterpret_cast<const char *>(file.bytes.data());
+            uint64_t    size = file.bytes.size();
+
+            if (compress && size > 0 && size <= static_cast<uint64_t>(LZ4_MAX_INPUT_SIZE)) {
+                compressed.resize(LZ4_compressBound(static_cast<int>(size)));
+                const int compressed_size = LZ4_compress_default(data, compressed.data(), static_cast<int>(size), static_cast<int>(compressed.size()));
+                if (compressed_size > 0 && static_cast<uint64_t>(compressed_size) <= size - size / 8) {
+                    data              = compressed.data();
+                    size              = static_cast<uint64_t>(compressed_size);
+                    entry.compression = PakCompression::LZ4;
+                }
+            }
+
+            entry.stored_size = size;
+            out.write(data, static_cast<std::streamsize>(size));
+            entries.push_back(entry);
+        }
+
+        std::ranges::sort(entries, [&names](const PakEntry &a, const PakEntry &b) {
+            return entry_less(a, std::string_view(names).substr(a.name_offset, a.name_size), b.path_hash, std::string_view(names).substr(b.name_offset, b.name_size));
+        });
+
+        std::memcpy(header.magic, PAK_MAGIC, sizeof(PAK_MAGIC));
+        header.version      = PAK_VERSION;
+        header.entry_count  = static_cast<uint32_t>(entries.size());
+        header.index_offset = pad_to(alignof(PakEntry));
+        out.write(reinterpret_cast<const char *>(entries.data()), static_cast<std::streamsize>(entries.size() * sizeof(PakEntry)));
+        header.names_offset = static_cast<uint64_t>(out.tellp());
+        out.write(names.data(), static_cast<std::streamsize>(names.size()));
+
+        out.seekp(0);
+        out.write(reinterpret_cast<const char *>(&header), sizeof(PakHeader));
+
+        if (!out) {
+            std::cerr << "Warning: Failed to write " << path << "." << std::endl;
+            return false;
+        }
+
+        return true;
+    }
+} // namespace kat
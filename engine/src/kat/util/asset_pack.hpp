@@ -0,0 +1,112 @@
+#pragma once
+
+#include "kat/util/hash.hpp"
+#include "kat/util/mapped_file.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace kat {
+
+    // .kpak layout (little endian): a PakHeader, the entry blobs (each aligned to PAK_ALIGNMENT), then the index (entry_count PakEntry sorted by path hash,
+    // then name) and finally the names they point to. The index goes last so the packer can stream the blobs out without knowing their sizes up front.
+    constexpr char     PAK_MAGIC[4]  = {'K', 'P', 'A', 'K'};
+    constexpr uint32_t PAK_VERSION   = 1;
+    constexpr uint64_t PAK_ALIGNMENT = 16;
+
+    enum class PakCompression : uint32_t { NONE = 0, LZ4 = 1 };
+
+    struct PakHeader {
+        char     magic[4];
+        uint32_t version;
+        uint32_t entry_count;
+        uint32_t reserved;
+        uint64_t index_offset;
+        uint64_t names_offset;
+    };
+
+    struct PakEntry {
+        uint64_t       path_hash;
+        uint64_t       offset;
+        uint64_t       stored_size;
+        uint64_t       size; // once decompressed
+        uint32_t       name_offset;
+        uint32_t       name_size;
+        PakCompression compression;
+        uint32_t       reserved;
+    };
+
+    // Paths are stored relative to the directory that was packed, with forward slashes.
+    [[nodiscard]] inline uint64_t pak_path_hash(std::string_view path) {
+        return hash_bytes(path.data(), path.size());
+    }
+
+    // The contents of a file, either pointing into a mapping (which it keeps alive) or decompressed into a buffer of its own.
+    // Move only: moving the buffer keeps its storage (so m_bytes stays valid), a copy would still point into the original.
+    class Asset {
+      public:
+        Asset() = default;
+
+        Asset(Asset &&) noexcept            = default;
+        Asset &operator=(Asset &&) noexcept = default;
+
+        Asset(const Asset &)            = delete;
+        Asset &operator=(const Asset &) = delete;
+
+        [[nodiscard]] inline std::span<const unsigned char> bytes() const { return m_bytes; };
+
+        [[nodiscard]] inline const unsigned char *data() const { return m_bytes.data(); };
+
+        [[nodiscard]] inline size_t size() const { return m_bytes.size(); };
+
+      private:
+        friend class AssetPack;
+        friend class AssetStore;
+
+        std::shared_ptr<const MappedFile> m_file;
+        std::vector<unsigned char>        m_decompressed;
+        std::span<const unsigned char>    m_bytes;
+    };
+
+    // A mapped .kpak file. Reads are thread safe.
+    class AssetPack {
+      public:
+        // Reports what's wrong with the file on cerr and returns nullopt when it can't be used.
+        [[nodiscard]] static std::optional<AssetPack> open(const std::filesystem::path &path);
+
+        // nullopt if the pack doesn't have the file. Uncompressed entries are read straight from the mapping.
+        [[nodiscard]] std::optional<Asset> read(std::string_view path) const;
+
+        [[nodiscard]] bool contains(std::string_view path) const;
+
+        [[nodiscard]] inline size_t entry_count() const { return m_entries.size(); };
+
+        [[nodiscard]] inline const std::filesystem::path &path() const { return m_path; };
+
+      private:
+        AssetPack() = default;
+
+        [[nodiscard]] const PakEntry *find(std::string_view path) const;
+
+        std::filesystem::path             m_path;
+        std::shared_ptr<const MappedFile> m_file;
+        std::vector<PakEntry>             m_entries;
+        std::string_view                  m_names; // points into m_file
+    };
+
+    struct AssetPackInput {
+        std::string                name; // relative, forward slashes
+        std::vector<unsigned char> bytes;
+    };
+
+    // Writes the files in the given order, which is the order they'll be laid out on disk in, so files which get loaded together should be next to each other.
+    // With compress set, entries are lz4 compressed when that saves at least an eighth of their size.
+    bool write_asset_pack(const std::filesystem::path &path, std::span<const AssetPackInput> files, bool compress);
+
+} // namespace kat
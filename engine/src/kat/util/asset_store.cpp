@@ -0,0 +1,76 @@
+#include "kat/util/asset_store.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <ranges>
+
+namespace kat {
+    bool AssetStore::mount(const std::filesystem::path &pack_path, const std::filesystem::path &root) {
+        auto pack = AssetPack::open(pack_path);
+        if (!pack)
+            return false;
+
+        m_mounts.push_back(Mount{root.lexically_normal(), std::move(*pack)});
+        return true;
+    }
+
+    void AssetStore::mount_directory(const std::filesystem::path &dir) {
+        std::error_code                    ec;
+        std::vector<std::filesystem::path> packs;
+        for (const auto &entry : std::filesystem::directory_iterator(dir, ec)) {
+            if (entry.is_regular_file() && entry.path().extension() == ".kpak")
+                packs.push_back(entry.path());
+        }
+
+        std::ranges::sort(packs);
+        for (const auto &pack : packs) {
+            mount(pack, dir);
+        }
+    }
+
+    std::optional<std::string> AssetStore::relative_to(const std::filesystem::path &path, const std::filesystem::path &root) {
+        const auto relative = path.lexically_normal().lexically_relative(root);
+        if (relative.empty() || *relative.begin() == "..")
+            return std::nullopt;
+
+        return relative.generic_string();
+    }
+
+    std::optional<Asset> AssetStore::open(const std::filesystem::path &path) const {
+        for (const auto &mount : m_mounts | std::views::reverse) {
+            const auto name = relative_to(path, mount.root);
+            if (!name)
+                continue;
+
+            if (auto asset = mount.pack.read(*name))
+                return asset;
+        }
+
+        auto file = MappedFile::open(path);
+        if (!file)
+            return std::nullopt;
+
+        // loose files are read front to back by everything that loads them.
+        file->prefetch();
+
+        Asset asset;
+        asset.m_file  = std::make_shared<const MappedFile>(std::move(*file));
+        asset.m_bytes = asset.m_file->bytes();
+        return asset;
+    }
+
+    bool AssetStore::exists(const std::filesystem::path &path) const {
+        if (is_packed(path))
+            return true;
+
+        std::error_code ec;
+        return std::filesystem::is_regular_file(path, ec);
+    }
+
+    bool AssetStore::is_packed(const std::filesystem::path &path) const {
+        return std::ranges::any_of(m_mounts, [&](const Mount &mount) {
+            const auto name = relative_to(path, mount.root);
+            return name && mount.pack.contains(*name);
+        });
+    }
+} // namespace kat
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "kat/util/asset_pack.hpp"
+
+#include <filesystem>
+#include <optional>
+#include <vector>
+
+namespace kat {
+
+    // Resolves file paths against the mounted asset packs before falling back to the filesystem, so code which loads files by path (App::resource_path()
+    // and friends) reads out of packs without knowing about them. A pack mounted at a root answers for every path under that root, packs mounted later take
+    // precedence over earlier ones.
+    // Mounting isn't thread safe and has to happen before anything is loaded, opening files is.
+    class AssetStore {
+      public:
+        // Returns false (and reports why on cerr) if the pack can't be used.
+        bool mount(const std::filesystem::path &pack_path, const std::filesystem::path &root);
+
+        // Mounts every .kpak directly inside dir at dir, in name order.
+        void mount_directory(const std::filesystem::path &dir);
+
+        // nullopt if the file isn't in any pack and can't be opened either.
+        [[nodiscard]] std::optional<Asset> open(const std::filesystem::path &path) const;
+
+        [[nodiscard]] bool exists(const std::filesystem::path &path) const;
+
+        // Whether open() reads the file out of a pack, in which case changes to a loose copy of it have no effect.
+        [[nodiscard]] bool is_packed(const std::filesystem::path &path) const;
+
+        [[nodiscard]] inline size_t mounted_pack_count() const { return m_mounts.size(); };
+
+      private:
+        struct Mount {
+            std::filesystem::path root;
+            AssetPack             pack;
+        };
+
+        // the path of the file inside the mount's packs, or nullopt if it isn't under its root.
+        [[nodiscard]] static std::optional<std::string> relative_to(const std::filesystem::path &path, const std::filesystem::path &root);
+
+        std::vector<Mount> m_mounts;
+    };
+
+} // namespace kat
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+namespace kat {
+
+    // Incremental FNV-1a hasher. Unlike std::hash, the output is stable across runs, platforms and standard libraries, so it can be used for on-disk keys.
+    // Structs should be fed in field by field rather than as raw bytes, since padding bytes are not guaranteed to be zeroed.
+    class Hasher {
+      public:
+        static constexpr uint64_t OFFSET_BASIS = 0xcbf29ce484222325ull;
+        static constexpr uint64_t PRIME        = 0x100000001b3ull;
+
+        constexpr Hasher &bytes(const void *data, size_t size) {
+            const auto *b = static_cast<const uint8_t *>(data);
+            for (size_t i = 0; i < size; i++) {
+                m_hash ^= b[i];
+                m_hash *= PRIME;
+            }
+            return *this;
+        };
+
+        template <typename T>
+            requires std::is_arithmetic_v<T> || std::is_enum_v<T>
+        constexpr Hasher &value(const T &v) {
+            return bytes(&v, sizeof(T));
+        };
+
+        // vulkan-hpp flag types (vk::Flags<...>)
+        template <typename T>
+            requires requires(const T &t) {
+                { static_cast<typename T::MaskType>(t) };
+            }
+        constexpr Hasher &value(const T &v) {
+            return value(static_cast<typename T::MaskType>(v));
+        };
+
+        constexpr Hasher &string(std::string_view s) {
+            value(s.size());
+            return bytes(s.data(), s.size());
+        };
+
+        [[nodiscard]] constexpr uint64_t digest() const { return m_hash; };
+
+      private:
+        uint64_t m_hash = OFFSET_BASIS;
+    };
+
+    // Same interface as Hasher, but keeps everything fed to it. Two keys compare equal exactly when the same values went in, so caches which can't afford to hand
+    // out the wrong object on a hash collision key their maps by this instead.
+    class KeyWriter {
+      public:
+        KeyWriter &bytes(const void *data, size_t size) {
+            m_key.append(static_cast<const char *>(data), size);
+            return *this;
+        };
+
+        template <typename T>
+            requires std::is_arithmetic_v<T> || std::is_enum_v<T>
+        KeyWriter &value(const T &v) {
+            return bytes(&v, sizeof(T));
+        };
+
+        template <typename T>
+            requires requires(const T &t) {
+                { static_cast<typename T::MaskType>(t) };
+            }
+        KeyWriter &value(const T &v) {
+            return value(static_cast<typename T::MaskType>(v));
+        };
+
+        KeyWriter &string(std::string_view s) {
+            value(s.size());
+            return bytes(s.data(), s.size());
+        };
+
+        [[nodiscard]] std::string take() { return std::move(m_key); };
+
+      private:
+        std::string m_key;
+    };
+
+    inline uint64_t hash_bytes(const void *data, size_t size) {
+        return Hasher().bytes(data, size).digest();
+    }
+
+} // namespace kat
@@ -0,0 +1,132 @@
+#include "kat/util/mapped_file.hpp"
+
+#include <algorithm>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace kat {
+    std::optional<MappedFile> MappedFile::open(const std::filesystem::path &path) {
+        MappedFile file;
+
+#ifdef _WIN32
+        HANDLE handle = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (handle == INVALID_HANDLE_VALUE)
+            return std::nullopt;
+        file.m_file = handle;
+
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(handle, &size))
+            return std::nullopt;
+        file.m_size = static_cast<size_t>(size.QuadPart);
+
+        // mapping an empty file fails, there is nothing to map anyway.
+        if (file.m_size == 0)
+            return file;
+
+        file.m_mapping = CreateFileMappingW(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!file.m_mapping)
+            return std::nullopt;
+
+        file.m_data = static_cast<const unsigned char *>(MapViewOfFile(file.m_mapping, FILE_MAP_READ, 0, 0, 0));
+        if (!file.m_data)
+            return std::nullopt;
+#else
+        const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return std::nullopt;
+
+        struct stat st {};
+        if (fstat(fd, &st) != 0) {
+            ::close(fd);
+            return std::nullopt;
+        }
+        file.m_size = static_cast<size_t>(st.st_size);
+
+        // the mapping keeps the file alive on its own, so the descriptor can go right away.
+        if (file.m_size > 0) {
+            void *data = mmap(nullptr, file.m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data == MAP_FAILED) {
+                ::close(fd);
+                return std::nullopt;
+            }
+            file.m_data = static_cast<const unsigned char *>(data);
+        }
+
+        ::close(fd);
+#endif
+
+        return file;
+    }
+
+    MappedFile::MappedFile(MappedFile &&other) noexcept
+        : m_data(std::exchange(other.m_data, nullptr)), m_size(std::exchange(other.m_size, 0))
+#ifdef _WIN32
+          ,
+          m_file(std::exchange(other.m_file, nullptr)), m_mapping(std::exchange(other.m_mapping, nullptr))
+#endif
+    {
+    }
+
+    MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+        if (this != &other) {
+            close();
+
+            m_data = std::exchange(other.m_data, nullptr);
+            m_size = std::exchange(other.m_size, 0);
+#ifdef _WIN32
+            m_file    = std::exchange(other.m_file, nullptr);
+            m_mapping = std::exchange(other.m_mapping, nullptr);
+#endif
+        }
+
+        return *this;
+    }
+
+    MappedFile::~MappedFile() {
+        close();
+    }
+
+    void MappedFile::prefetch(size_t offset, size_t size) const {
+        if (!m_data || offset >= m_size)
+            return;
+        size = std::min(size, m_size - offset);
+
+#ifdef _WIN32
+        WIN32_MEMORY_RANGE_ENTRY range{const_cast<unsigned char *>(m_data + offset), size};
+        PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+        // madvise wants a page aligned start.
+        const auto page  = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        const auto start = offset / page * page;
+        madvise(const_cast<unsigned char *>(m_data + start), size + (offset - start), MADV_WILLNEED);
+#endif
+    }
+
+    void MappedFile::close() {
+#ifdef _WIN32
+        if (m_data)
+            UnmapViewOfFile(m_data);
+        if (m_mapping)
+            CloseHandle(m_mapping);
+        if (m_file)
+            CloseHandle(m_file);
+        m_file    = nullptr;
+        m_mapping = nullptr;
+#else
+        if (m_data)
+            munmap(const_cast<unsigned char *>(m_data), m_size);
+#endif
+        m_data = nullptr;
+        m_size = 0;
+    }
+} // namespace kat
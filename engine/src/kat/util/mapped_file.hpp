@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+
+namespace kat {
+
+    // A read only memory mapping of a whole file. Pages are only read from disk when touched, and they're backed by the page cache rather than the heap, so
+    // copying from the mapping straight into staging memory is the only copy made while loading.
+    class MappedFile {
+      public:
+        // Returns nullopt when the file can't be opened or mapped. Empty files give an empty mapping.
+        [[nodiscard]] static std::optional<MappedFile> open(const std::filesystem::path &path);
+
+        MappedFile(MappedFile &&other) noexcept;
+        MappedFile &operator=(MappedFile &&other) noexcept;
+
+        MappedFile(const MappedFile &)            = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+
+        ~MappedFile();
+
+        [[nodiscard]] inline std::span<const unsigned char> bytes() const { return {m_data, m_size}; };
+
+        [[nodiscard]] inline const unsigned char *data() const { return m_data; };
+
+        [[nodiscard]] inline size_t size() const { return m_size; };
+
+        // Asks the os to start reading the range in, for files which are about to be read front to back.
+        void prefetch(size_t offset = 0, size_t size = SIZE_MAX) const;
+
+      private:
+        MappedFile() = default;
+
+        void close();
+
+        const unsigned char *m_data = nullptr;
+        size_t               m_size = 0;
+
+#ifdef _WIN32
+        void *m_file    = nullptr;
+        void *m_mapping = nullptr;
+#endif
+    };
+
+} // namespace kat
@@ -0,0 +1,183 @@
+#include "kat/util/profiler.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string_view>
+
+namespace kat::profiler {
+    namespace {
+        static_assert((RING_CAPACITY & (RING_CAPACITY - 1)) == 0, "RING_CAPACITY must be a power of two");
+
+        // fields are atomics so that capture() can read a ring while its thread writes to it. Every access is relaxed, which is a plain load/store on the
+        // platforms we care about, the ordering comes from the ring's head.
+        struct Slot {
+            std::atomic<const char *> name;
+            std::atomic<uint64_t>     start_ns;
+            std::atomic<uint64_t>     end_ns;
+            std::atomic<uint32_t>     depth;
+        };
+
+        struct ThreadRing {
+            uint32_t    thread_id;
+            std::string thread_name; // guarded by the registry mutex
+
+            // only ever written by the owning thread.
+            std::atomic<uint64_t> head = 0;
+            uint32_t              depth = 0;
+
+            std::array<Slot, RING_CAPACITY> slots;
+        };
+
+        struct Registry {
+            std::mutex                               mutex;
+            std::vector<std::unique_ptr<ThreadRing>> rings; // rings are kept after their thread exits so that its events can still be exported
+        };
+
+        Registry &registry() {
+            static Registry r;
+            return r;
+        }
+
+        std::chrono::steady_clock::time_point epoch() {
+            static const auto e = std::chrono::steady_clock::now();
+            return e;
+        }
+
+        ThreadRing &local_ring() {
+            thread_local ThreadRing *ring = []() {
+                auto &r = registry();
+
+                std::lock_guard lock(r.mutex);
+                auto           &ring = r.rings.emplace_back(std::make_unique<ThreadRing>());
+                ring->thread_id      = static_cast<uint32_t>(r.rings.size());
+                ring->thread_name    = "thread " + std::to_string(ring->thread_id);
+                return ring.get();
+            }();
+
+            return *ring;
+        }
+
+        void write_escaped(std::ostream &out, std::string_view s) {
+            for (const char c : s) {
+                if (c == '"' || c == '\\')
+                    out << '\\';
+                out << c;
+            }
+        }
+    } // namespace
+
+    uint64_t now_ns() {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch()).count());
+    }
+
+    Zone::Zone(const char *name) : m_name(name) {
+        local_ring().depth++;
+        m_start = now_ns();
+    }
+
+    Zone::~Zone() {
+        const uint64_t end = now_ns();
+
+        auto          &ring  = local_ring();
+        const uint64_t index = ring.head.load(std::memory_order_relaxed);
+        auto          &slot  = ring.slots[index & (RING_CAPACITY - 1)];
+
+        ring.depth--;
+
+        slot.name.store(m_name, std::memory_order_relaxed);
+        slot.start_ns.store(m_start, std::memory_order_relaxed);
+        slot.end_ns.store(end, std::memory_order_relaxed);
+        slot.depth.store(ring.depth, std::memory_order_relaxed);
+
+        ring.head.store(index + 1, std::memory_order_release);
+    }
+
+    void set_thread_name(std::string name) {
+        auto &ring = local_ring();
+
+        std::lock_guard lock(registry().mutex);
+        ring.thread_name = std::move(name);
+    }
+
+    std::vector<ThreadCapture> capture() {
+        auto &r = registry();
+
+        std::lock_guard            lock(r.mutex);
+        std::vector<ThreadCapture> result;
+        result.reserve(r.rings.size());
+
+        for (const auto &ring : r.rings) {
+            ThreadCapture thread{ring->thread_id, ring->thread_name, {}};
+
+            const uint64_t head  = ring->head.load(std::memory_order_acquire);
+            const uint64_t first = head > RING_CAPACITY ? head - RING_CAPACITY : 0;
+
+            thread.events.reserve(head - first);
+            for (uint64_t i = first; i < head; i++) {
+                const auto &slot = ring->slots[i & (RING_CAPACITY - 1)];
+                thread.events.push_back(Event{
+                    slot.name.load(std::memory_order_relaxed),
+                    slot.start_ns.load(std::memory_order_relaxed),
+                    slot.end_ns.load(std::memory_order_relaxed),
+                    slot.depth.load(std::memory_order_relaxed),
+                });
+            }
+
+            // the thread kept recording while we copied, anything it may have overwritten in the meantime is dropped (including the slot it may be writing now).
+            std::atomic_thread_fence(std::memory_order_acquire);
+            const uint64_t new_head = ring->head.load(std::memory_order_relaxed) + 1;
+            if (new_head - first > RING_CAPACITY) {
+                const uint64_t overwritten = std::min<uint64_t>(new_head - first - RING_CAPACITY, thread.events.size());
+                thread.events.erase(thread.events.begin(), thread.events.begin() + static_cast<std::ptrdiff_t>(overwritten));
+            }
+
+            result.push_back(std::move(thread));
+        }
+
+        return result;
+    }
+
+    bool write_chrome_trace(const std::filesystem::path &path) {
+        std::ofstream out(path);
+        if (!out) {
+            std::cerr << "Warning: Failed to open " << path << " for writing, the trace wasn't exported." << std::endl;
+            return false;
+        }
+
+        const auto threads = capture();
+
+        // timestamps are in microseconds, the default precision would round them once a run is a few seconds long.
+        out << std::fixed << std::setprecision(3);
+        out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+        bool first = true;
+        for (const auto &thread : threads) {
+            out << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread.thread_id << ",\"args\":{\"name\":\"";
+            write_escaped(out, thread.thread_name);
+            out << "\"}}";
+            first = false;
+
+            for (const auto &event : thread.events) {
+                out << ",\n{\"name\":\"";
+                write_escaped(out, event.name);
+                out << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << thread.thread_id << ",\"ts\":" << static_cast<double>(event.start_ns) / 1000.0
+                    << ",\"dur\":" << static_cast<double>(event.end_ns - event.start_ns) / 1000.0 << "}";
+            }
+        }
+
+        out << "\n]}\n";
+
+        if (!out) {
+            std::cerr << "Warning: Failed to write the trace to " << path << "." << std::endl;
+            return false;
+        }
+
+        return true;
+    }
+} // namespace kat::profiler
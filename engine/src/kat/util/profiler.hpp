@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Scoped cpu zones. Every thread records into its own fixed size ring, so marking a zone is two clock reads and a few relaxed stores, with no locks or
+// allocation after the thread's first zone. When KAT_ENABLE_PROFILER isn't defined (see the KAT_ENABLE_PROFILER cmake option) the macros expand to nothing.
+//
+//     void Context::present() {
+//         KAT_PROFILE_FUNCTION();
+//         ...
+//     }
+//
+// Zone names have to outlive the profiler, in practice they should be string literals.
+
+#define KAT_PROFILE_CONCAT_INNER(a, b) a##b
+#define KAT_PROFILE_CONCAT(a, b)       KAT_PROFILE_CONCAT_INNER(a, b)
+
+#ifdef KAT_ENABLE_PROFILER
+#define KAT_PROFILE_ZONE(name)       const ::kat::profiler::Zone KAT_PROFILE_CONCAT(kat_profile_zone_, __LINE__)(name)
+#define KAT_PROFILE_FUNCTION()       KAT_PROFILE_ZONE(__func__)
+#define KAT_PROFILE_THREAD(name)     ::kat::profiler::set_thread_name(name)
+#else
+#define KAT_PROFILE_ZONE(name)       ((void)0)
+#define KAT_PROFILE_FUNCTION()       ((void)0)
+#define KAT_PROFILE_THREAD(name)     ((void)0)
+#endif
+
+namespace kat::profiler {
+
+    // events kept per thread, older ones are overwritten.
+    constexpr uint32_t RING_CAPACITY = 16384;
+
+    struct Event {
+        const char *name;
+        uint64_t    start_ns;
+        uint64_t    end_ns;
+        uint32_t    depth;
+    };
+
+    struct ThreadCapture {
+        uint32_t           thread_id;
+        std::string        thread_name;
+        std::vector<Event> events; // ordered by end time
+    };
+
+    // Nanoseconds since the profiler's epoch (the first call into it).
+    [[nodiscard]] uint64_t now_ns();
+
+    class Zone {
+      public:
+        explicit Zone(const char *name);
+        ~Zone();
+
+        Zone(const Zone &)            = delete;
+        Zone &operator=(const Zone &) = delete;
+
+      private:
+        const char *m_name;
+        uint64_t    m_start;
+    };
+
+    // Names the calling thread in captures and exported traces.
+    void set_thread_name(std::string name);
+
+    // Copies out what is currently in every thread's ring. Can be called from any thread while others keep recording, events which were overwritten during
+    // the copy are dropped.
+    [[nodiscard]] std::vector<ThreadCapture> capture();
+
+    // Writes capture() in the chrome trace event format (chrome://tracing, perfetto). Returns false (with a warning) if the file can't be written.
+    bool write_chrome_trace(const std::filesystem::path &path);
+
+} // namespace kat::profiler
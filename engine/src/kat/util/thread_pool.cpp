@@ -0,0 +1,81 @@
+#include "kat/util/thread_pool.hpp"
+
+#include "kat/util/profiler.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+namespace kat {
+    ThreadPool::ThreadPool(uint32_t thread_count) {
+        if (thread_count == 0)
+            thread_count = default_thread_count();
+
+        m_workers.reserve(thread_count);
+        for (uint32_t i = 0; i < thread_count; i++) {
+            m_workers.emplace_back([this, i]() { worker_main(i); });
+        }
+    }
+
+    ThreadPool::~ThreadPool() {
+        shutdown();
+    }
+
+    void ThreadPool::submit(Task task) {
+        {
+            std::lock_guard lock(m_mutex);
+            if (m_stopping) {
+                std::cerr << "Warning: Task submitted to a thread pool which has been shut down, ignoring it." << std::endl;
+                return;
+            }
+            m_tasks.push_back(std::move(task));
+        }
+        m_condition.notify_one();
+    }
+
+    void ThreadPool::shutdown() {
+        {
+            std::lock_guard lock(m_mutex);
+            if (m_stopping)
+                return;
+            m_stopping = true;
+        }
+        m_condition.notify_all();
+
+        for (auto &worker : m_workers) {
+            if (worker.joinable())
+                worker.join();
+        }
+    }
+
+    uint32_t ThreadPool::default_thread_count() {
+        // leave room for the update and render threads.
+        const uint32_t hw = std::thread::hardware_concurrency();
+        return std::max(1u, hw > 2 ? hw - 2 : 1u);
+    }
+
+    void ThreadPool::worker_main(uint32_t worker_index) {
+        KAT_PROFILE_THREAD("worker " + std::to_string(worker_index));
+
+        while (true) {
+            Task task;
+            {
+                std::unique_lock lock(m_mutex);
+                m_condition.wait(lock, [this]() { return m_stopping || !m_tasks.empty(); });
+
+                // when stopping we still drain the queue, so nothing that was submitted gets silently dropped.
+                if (m_tasks.empty())
+                    return;
+
+                task = std::move(m_tasks.front());
+                m_tasks.pop_front();
+            }
+
+            try {
+                KAT_PROFILE_ZONE("task");
+                task(worker_index);
+            } catch (const std::exception &e) {
+                std::cerr << "Error: Uncaught exception in worker thread " << worker_index << ": " << e.what() << std::endl;
+            }
+        }
+    }
+} // namespace kat
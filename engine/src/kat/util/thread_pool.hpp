@@ -0,0 +1,47 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace kat {
+
+    // Fixed size pool of worker threads pulling from a single fifo queue.
+    // Tasks are passed the index of the worker running them so that callers can keep per-worker state (command pools, pipeline caches, etc.) without locking.
+    class ThreadPool {
+      public:
+        using Task = std::function<void(uint32_t worker_index)>;
+
+        // a thread count of 0 picks a count based on the hardware concurrency.
+        explicit ThreadPool(uint32_t thread_count = 0);
+
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool &)            = delete;
+        ThreadPool &operator=(const ThreadPool &) = delete;
+
+        void submit(Task task);
+
+        // Blocks until every queued task has been run, then stops and joins the workers. Submitting after this is an error.
+        void shutdown();
+
+        [[nodiscard]] inline uint32_t thread_count() const { return static_cast<uint32_t>(m_workers.size()); };
+
+        [[nodiscard]] static uint32_t default_thread_count();
+
+      private:
+        void worker_main(uint32_t worker_index);
+
+        std::vector<std::jthread> m_workers;
+
+        std::mutex              m_mutex;
+        std::condition_variable m_condition;
+        std::deque<Task>        m_tasks;
+        bool                    m_stopping = false;
+    };
+
+} // namespace kat
@@ -80,4 +80,6 @@ namespace kat {
 
     constexpr vk::ComponentMapping STANDARD_COMPONENT_MAPPING = vk::ComponentMapping(vk::ComponentSwizzle::eR, vk::ComponentSwizzle::eG, vk::ComponentSwizzle::eB, vk::ComponentSwizzle::eA); 
     constexpr vk::ImageSubresourceRange SIMPLE_SUBRESOURCE_RANGE = vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1);
+    constexpr vk::ImageSubresourceRange FULL_SUBRESOURCE_RANGE =
+        vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS);
 } // namespace kat
@@ -14,13 +14,17 @@ layout(push_constant) uniform constants {
     mat4 model;
 } push_constants;
 
+// has to match main.frag (and game::UniformBuffer), the pipeline layout is reflected from both.
 layout(binding = 0) uniform uniform_buffer {
     mat4 viewProjection;
+
     vec4 ambientColor;
-    vec3 lightPos; 
+    vec4 lightColor;
+
+    vec4 lightPos;
+    vec4 viewPos;
+
     float ambientStrength;
-    vec4 diffuseColor;
-    vec3 viewPos;
     float specularStrength;
 } ubo;
 
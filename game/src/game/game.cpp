@@ -1,5 +1,14 @@
 #include "game.hpp"
 
+#include "kat/debug_ui.hpp"
+#include "kat/graphics/frame_allocator.hpp"
+#include "kat/graphics/gpu_profiler.hpp"
+#include "kat/graphics/layout_cache.hpp"
+#include "kat/graphics/pipeline_registry.hpp"
+#include "kat/graphics/shader_watcher.hpp"
+#include "kat/graphics/texture_loader.hpp"
+#include "kat/graphics/upload_queue.hpp"
+
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/string_cast.hpp>
 #include <iostream>
@@ -9,25 +18,62 @@
 #include <tuple>
 
 namespace game {
-    Game::Game(const std::filesystem::path &resources_dir) : kat::App({.title = "Window", .fullscreen = true}, {}, resources_dir) {
+    Game::Game(const std::filesystem::path &resources_dir, std::optional<uint64_t> headless_frames)
+        : kat::App({.title = "Window", .fullscreen = true}, {.headless = headless_frames.has_value(), .shader_hot_reload = !headless_frames.has_value()},
+                   resources_dir),
+          m_headless_frames(headless_frames) {
+#ifdef GAME_SHADER_SOURCE_DIR
+        // saving a shader recompiles it into the resources and rebuilds the pipelines using it.
+        if (const auto &watcher = m_context->shader_watcher())
+            watcher->watch_sources(GAME_SHADER_SOURCE_DIR, resource_path("shaders"), GAME_GLSLC);
+#endif
+
         m_command_pool    = m_context->create_command_pool_raw<kat::QueueType::GRAPHICS>();
-        m_command_buffers = m_context->allocate_command_buffers_raw<kat::MAX_FRAMES_IN_FLIGHT>(m_command_pool);
+        m_command_buffers = m_context->allocate_command_buffers_raw(m_command_pool, m_context->frames_in_flight());
+
+        // textures decode on the loader's workers while the rest of the startup work runs.
+        const auto test_texture = m_context->texture_loader()->load(resource_path("textures/test_texture.png"));
+
+        // all of the other startup uploads go in one batch, which is recorded and submitted once.
+        auto upload_batch = m_context->upload_queue()->begin_batch();
+
+        create_buffers(upload_batch);
+
+        const auto upload_ticket = m_context->upload_queue()->submit(std::move(upload_batch));
 
-        
-        auto image_ = m_context->gpu_allocator()->load_image(resource_path("textures/test_texture.png"));
-        m_test_image = std::get<0>(image_);
-        m_test_image_view = std::make_shared<kat::ImageView>(m_context, kat::ImageView::Description{m_test_image, vk::ImageViewType::e2D, std::get<1>(image_)});
+        create_render_pass();
+
+        // the descriptor set needs the texture.
+        m_context->texture_loader()->wait_idle();
+        if (!test_texture->is_ready())
+            throw kat::fatal_exc{};
+
+        m_test_image = test_texture->image();
+        {
+            // the view covers the whole mip chain.
+            kat::ImageView::Description desc{m_test_image, vk::ImageViewType::e2D, test_texture->format()};
+            desc.subresource_range = kat::FULL_SUBRESOURCE_RANGE;
+            m_test_image_view      = std::make_shared<kat::ImageView>(m_context, desc);
+        }
         {
             kat::Sampler::Description desc{};
             desc.mag_filter = vk::Filter::eNearest;
             m_test_sampler = std::make_shared<kat::Sampler>(m_context, desc);
         }
 
-        create_render_pass();
-        create_buffers();
         create_pipeline_layout();
         create_graphics_pipeline();
 
+        // the uploads run on the transfer queue while the pipeline is being built.
+        m_context->upload_queue()->wait(upload_ticket);
+
+        // content is never unloaded yet, but long sessions should still give fragmented memory back.
+        m_context->gpu_allocator()->set_auto_defragmentation(kat::DefragmentationSettings{});
+
+        // headless runs have no window to take input from or draw the ui into.
+        if (m_context->is_headless())
+            return;
+
         m_imgui_resources = std::make_unique<kat::ImGuiResources>(window(), context(), m_render_pass->handle());
 
         ImGuiIO &io = ImGui::GetIO();
@@ -43,7 +89,7 @@ namespace game {
 
         desc.attachments.push_back(kat::AttachmentLayout{
             .format       = m_context->swapchain_format(),
-            .final_layout = vk::ImageLayout::ePresentSrcKHR,
+            .final_layout = m_context->present_layout(),
         });
 
         desc.subpasses.push_back(kat::Subpass{
@@ -64,71 +110,82 @@ namespace game {
             .dst_access_mask = vk::AccessFlagBits::eColorAttachmentWrite,
         });
 
-        m_render_pass  = std::make_shared<kat::RenderPass>(m_context, desc);
-        m_framebuffers = m_render_pass->create_framebuffers(m_context->swapchain_image_views(), m_context->swapchain_extent());
-    }
+        m_render_pass = std::make_shared<kat::RenderPass>(m_context, desc);
+        create_framebuffers();
 
-    void Game::create_pipeline_layout() {
-
-        {
-            kat::DescriptorSetLayout::Description desc{};
-            desc.bindings = {vk::DescriptorSetLayoutBinding(0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eAllGraphics, {}),
-                             vk::DescriptorSetLayoutBinding(1, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment, {})};
+        m_swapchain_recreated_handle = m_context->on_swapchain_recreated([this]() {
+            // frames in flight may still be using the old framebuffers.
+            for (const auto &fb : m_framebuffers) {
+                m_context->defer_destroy(fb);
+            }
 
-            m_descriptor_set_layout = std::make_shared<kat::DescriptorSetLayout>(m_context, desc);
-        }
+            create_framebuffers();
+        });
+    }
 
-        {
-            kat::PipelineLayout::Description desc{};
+    void Game::create_framebuffers() {
+        m_framebuffers = m_render_pass->create_framebuffers(m_context->swapchain_image_views(), m_context->swapchain_extent());
+    }
 
-            desc.push_constant_ranges   = {vk::PushConstantRange(vk::ShaderStageFlagBits::eAllGraphics, 0, sizeof(PushConstants))};
-            desc.descriptor_set_layouts = {m_descriptor_set_layout};
+    std::vector<kat::ShaderStage> Game::shader_stages() const {
+        return {
+            kat::ShaderStage{resource_path("shaders/main.vert.spv"), vk::ShaderStageFlagBits::eVertex},
+            kat::ShaderStage{resource_path("shaders/main.frag.spv"), vk::ShaderStageFlagBits::eFragment},
+        };
+    }
 
-            m_pipeline_layout = std::make_shared<kat::PipelineLayout>(m_context, desc);
-        }
+    void Game::create_pipeline_layout() {
+        // reflected from the shaders, the uniform buffer lives in the frame allocator so it's bound with a dynamic offset.
+        m_pipeline_layout       = m_context->layout_cache()->get_reflected(shader_stages(), {.dynamic_buffers = {{0, 0}}});
+        m_descriptor_set_layout = m_pipeline_layout->description().descriptor_set_layouts.at(0);
 
         {
             kat::DescriptorPool::Description desc{};
-            desc.max_sets     = kat::MAX_FRAMES_IN_FLIGHT;
-            desc.pool_sizes   = {vk::DescriptorPoolSize(vk::DescriptorType::eUniformBuffer, kat::MAX_FRAMES_IN_FLIGHT),
-                                 vk::DescriptorPoolSize(vk::DescriptorType::eCombinedImageSampler, kat::MAX_FRAMES_IN_FLIGHT)};
+            desc.max_sets     = 1;
+            desc.pool_sizes   = {vk::DescriptorPoolSize(vk::DescriptorType::eUniformBufferDynamic, 1), vk::DescriptorPoolSize(vk::DescriptorType::eCombinedImageSampler, 1)};
             m_descriptor_pool = std::make_shared<kat::DescriptorPool>(m_context, desc);
         }
 
-        m_descriptor_sets = m_descriptor_pool->allocate_sets(m_descriptor_set_layout, kat::MAX_FRAMES_IN_FLIGHT);
+        // the uniform buffer lives in the frame allocator, so a single set works for every frame, each draw just binds it with a different dynamic offset.
+        m_descriptor_set = m_descriptor_pool->allocate_sets(m_descriptor_set_layout, 1)[0];
+        write_descriptor_set();
+
+        // defragmentation can move the texture, which recreates its view.
+        m_relocated_handle = m_context->gpu_allocator()->on_relocated([this]() { write_descriptor_set(); });
+    }
 
-        for (size_t i = 0; i < kat::MAX_FRAMES_IN_FLIGHT; i++) {
-            vk::DescriptorBufferInfo dbi{};
-            dbi.buffer = m_uniform_buffers[i]->handle();
-            dbi.offset = 0;
-            dbi.range  = sizeof(UniformBuffer);
+    void Game::write_descriptor_set() {
+        vk::DescriptorBufferInfo dbi{};
+        dbi.buffer = m_context->frame_allocator()->buffer()->handle();
+        dbi.offset = 0;
+        dbi.range  = sizeof(UniformBuffer);
 
-            vk::DescriptorImageInfo dii{};
-            dii.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
-            dii.imageView = m_test_image_view->handle();
-            dii.sampler = m_test_sampler->handle();
+        vk::DescriptorImageInfo dii{};
+        dii.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+        dii.imageView = m_test_image_view->handle();
+        dii.sampler = m_test_sampler->handle();
 
-            std::vector<vk::WriteDescriptorSet> writes = {
-                vk::WriteDescriptorSet(m_descriptor_sets[i], 0, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &dbi, nullptr),
-                vk::WriteDescriptorSet(m_descriptor_sets[i], 1, 0, 1, vk::DescriptorType::eCombinedImageSampler, &dii, nullptr, nullptr),
-            };
+        std::vector<vk::WriteDescriptorSet> writes = {
+            vk::WriteDescriptorSet(m_descriptor_set, 0, 0, 1, vk::DescriptorType::eUniformBufferDynamic, nullptr, &dbi, nullptr),
+            vk::WriteDescriptorSet(m_descriptor_set, 1, 0, 1, vk::DescriptorType::eCombinedImageSampler, &dii, nullptr, nullptr),
+        };
 
-            m_context->device().updateDescriptorSets(writes, {});
-        }
+        m_context->device().updateDescriptorSets(writes, {});
     }
 
     void Game::create_graphics_pipeline() {
         kat::GraphicsPipeline::Description desc{};
 
-        desc.add_shader(resource_path("shaders/main.vert.spv"), vk::ShaderStageFlagBits::eVertex);
-        desc.add_shader(resource_path("shaders/main.frag.spv"), vk::ShaderStageFlagBits::eFragment);
+        desc.shader_stages = shader_stages();
 
         desc.blend_state.blend_attachments = {
             kat::STANDARD_BLEND_STATE,
         };
 
+        // the swapchain can be resized, so the viewport and scissor are set every frame.
         desc.viewports.push_back(m_context->full_viewport());
         desc.scissors.push_back(m_context->full_render_area());
+        desc.dynamic_states = {vk::DynamicState::eViewport, vk::DynamicState::eScissor};
 
         desc.vertex_layout.bindings = {kat::VertexBinding{0,
                                                           sizeof(Vertex),
@@ -144,10 +201,10 @@ namespace game {
         desc.render_pass = m_render_pass;
         desc.subpass     = 0;
 
-        m_graphics_pipeline = std::make_shared<kat::GraphicsPipeline>(m_context, desc);
+        m_graphics_pipeline = m_context->pipeline_registry()->get_or_create(desc);
     }
 
-    void Game::create_buffers() {
+    void Game::create_buffers(kat::UploadBatch &batch) {
         const std::vector<Vertex> vertices = {
             // back
             Vertex{glm::vec3(-0.5f, 0.5f, -0.5f), kat::BLACK, glm::vec3(0.0f, -0.0f, -1.0f), glm::vec2(0.0f, 0.0f)},
@@ -198,21 +255,16 @@ namespace game {
             Vertex{glm::vec3(-0.5f, -0.5f, -0.5f), kat::BLUE, glm::vec3(0.0f, -1.0f, 0.0f), glm::vec2(0.0f, 0.0f)},
         };
 
-        m_vertex_buffer = m_context->gpu_allocator()->init_buffer(vertices, vk::BufferUsageFlagBits::eVertexBuffer, VMA_MEMORY_USAGE_GPU_ONLY);
-
         const std::vector<uint32_t> indices = {0,  1,  2,  3,  4,  5,  6,  7,  8,  9,  10, 11, 12, 13, 14, 15, 16, 17,
                                                18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35};
 
-        m_index_buffer = m_context->gpu_allocator()->init_buffer(indices, vk::BufferUsageFlagBits::eIndexBuffer, VMA_MEMORY_USAGE_GPU_ONLY);
-
-        m_uniform_buffers.reserve(kat::MAX_FRAMES_IN_FLIGHT);
-
-        for (size_t i = 0; i < kat::MAX_FRAMES_IN_FLIGHT; i++) {
-            m_uniform_buffers.push_back(m_context->gpu_allocator()->create_buffer(sizeof(UniformBuffer), vk::BufferUsageFlagBits::eUniformBuffer, VMA_MEMORY_USAGE_CPU_TO_GPU));
-        }
+        m_geometry = std::make_unique<kat::GeometryArena>(m_context, kat::GeometryArena::Description{sizeof(Vertex), MAX_VERTICES, MAX_INDICES});
+        m_cube     = m_geometry->upload(batch, vertices, indices);
     }
 
     void Game::update(float dt) {
+        if (!window())
+            return;
 
         constexpr float     SPEED      = 1.0f;
         constexpr float     TURN_SPEED = 1.0f;
@@ -276,33 +328,38 @@ namespace game {
 
         PushConstants pc = {glm::identity<glm::mat4>()};
 
-        update_ubo();
+        const uint32_t ubo_offset = update_ubo();
 
         cmd.reset();
         cmd.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
 
+        auto &profiler = *m_context->gpu_profiler();
+        const auto frame_scope = profiler.begin_scope(cmd, "frame");
+
         kat::RenderPass::BeginInfo begin_info{};
         begin_info.render_area  = m_context->full_render_area();
         begin_info.clear_values = {m_background_color};
         begin_info.framebuffer  = m_framebuffers[frame_info.image_index];
 
         m_render_pass->begin(cmd, begin_info);
+
+        const auto scene_scope = profiler.begin_scope(cmd, "scene");
         m_graphics_pipeline->bind(cmd);
 
-        cmd.bindIndexBuffer(m_index_buffer->handle(), 0, vk::IndexType::eUint32);
+        cmd.setViewport(0, m_context->full_viewport());
+        cmd.setScissor(0, m_context->full_render_area());
 
-        const vk::Buffer         buf = m_vertex_buffer->handle();
-        constexpr vk::DeviceSize off = 0;
-        cmd.bindVertexBuffers(0, buf, off);
+        m_geometry->bind(cmd);
 
-        std::vector<vk::DescriptorSet> sets = {m_descriptor_sets[m_context->current_frame()]};
-        m_pipeline_layout->bind_descriptor_sets(cmd, vk::PipelineBindPoint::eGraphics, 0, sets, {});
-        cmd.pushConstants<PushConstants>(m_pipeline_layout->handle(), vk::ShaderStageFlagBits::eAllGraphics, 0, pc);
+        m_pipeline_layout->bind_descriptor_sets(cmd, vk::PipelineBindPoint::eGraphics, 0, {m_descriptor_set}, {ubo_offset});
+        cmd.pushConstants<PushConstants>(m_pipeline_layout->handle(), m_pipeline_layout->description().push_constant_ranges.at(0).stageFlags, 0, pc);
 
-        cmd.drawIndexed(36, 1, 0, 0, 0);
+        m_geometry->draw(cmd, m_cube);
+        profiler.end_scope(cmd, scene_scope);
 
+        if (m_ui_toggled && m_imgui_resources) {
+            kat::GpuProfiler::Scope imgui_scope(profiler, cmd, "imgui");
 
-        if (m_ui_toggled) {
             // Imgui render
             ImGui_ImplVulkan_NewFrame();
             ImGui_ImplGlfw_NewFrame();
@@ -317,30 +374,27 @@ namespace game {
 
         m_render_pass->end(cmd);
 
+        profiler.end_scope(cmd, frame_scope);
         cmd.end();
 
-        std::vector<vk::PipelineStageFlags> wait_stages{vk::PipelineStageFlagBits::eColorAttachmentOutput};
+        m_context->submit_frame(frame_info, {cmd});
 
-        vk::SubmitInfo si{};
-        si.setCommandBuffers(cmd);
-        si.setWaitSemaphores(frame_info.image_available_semaphore);
-        si.setSignalSemaphores(frame_info.render_finished_semaphore);
-        si.setWaitDstStageMask(wait_stages);
-
-        m_context->graphics_queue().submit(si, frame_info.in_flight_fence);
+        if (m_headless_frames && frame_info.frame_number >= *m_headless_frames)
+            request_exit();
     }
 
-    void Game::update_ubo() {
-        float aspect = m_window->aspect();
+    uint32_t Game::update_ubo() {
+        const vk::Extent2D extent = m_context->swapchain_extent();
+        const float        aspect = static_cast<float>(extent.height) / static_cast<float>(extent.width);
 
         glm::mat4 view       = glm::mat4(m_rot) * glm::translate(glm::identity<glm::mat4>(), m_pos);
         glm::mat4 projection = glm::perspectiveFov(glm::radians(90.0f), 2.0f, 2.0f * aspect, 0.1f, 100.0f);
 
         glm::mat4 pv_matrix = projection * view;
 
-        UniformBuffer ub   = {pv_matrix, m_ambient_light_color, m_light_color, m_light_pos, glm::vec4(-m_pos, 1.0f), m_ambient_strength, m_specular_strength};
-        auto          ubuf = m_uniform_buffers[m_context->current_frame()];
-        ubuf->map_and_write_obj(ub, 0);
+        UniformBuffer ub = {pv_matrix, m_ambient_light_color, m_light_color, m_light_pos, glm::vec4(-m_pos, 1.0f), m_ambient_strength, m_specular_strength};
+
+        return m_context->frame_allocator()->push(ub).dynamic_offset();
     }
 
     void Game::render_ui() {
@@ -357,6 +411,14 @@ namespace game {
         ImGui::SliderFloat("Ambient Strength", &m_ambient_strength, 0.01f, 1.0f, "%.2f");
         ImGui::SliderFloat("Specular Strength", &m_specular_strength, 0.01f, 1.0f, "%.2f");
         ImGui::End();
+
+        if (m_profiler_window_open) {
+            kat::debug_ui::gpu_profiler_window(*m_context->gpu_profiler(), &m_profiler_window_open);
+            kat::debug_ui::cpu_profiler_window(&m_profiler_window_open);
+        }
+
+        if (m_memory_window_open)
+            kat::debug_ui::memory_window(*m_context->gpu_allocator(), &m_memory_window_open);
     }
 
 } // namespace game
@@ -7,6 +7,7 @@
 
 #include "kat/app.hpp"
 #include "kat/graphics/context.hpp"
+#include "kat/graphics/geometry_arena.hpp"
 #include "kat/graphics/graphics_pipeline.hpp"
 #include "kat/graphics/render_pass.hpp"
 #include "kat/graphics/shader_cache.hpp"
@@ -16,6 +17,7 @@
 #include <glm/gtc/quaternion.hpp>
 
 #include <atomic>
+#include <optional>
 #include <thread>
 
 namespace game {
@@ -44,22 +46,33 @@ namespace game {
         float specular_strength;
     };
 
+    // capacity of the game's geometry arena.
+    constexpr uint32_t MAX_VERTICES = 65536;
+    constexpr uint32_t MAX_INDICES  = 262144;
+
     class Game : public kat::App {
       public:
-        Game(const std::filesystem::path& resources_dir);
+        // headless_frames runs the game without a window for that many frames, then exits.
+        Game(const std::filesystem::path& resources_dir, std::optional<uint64_t> headless_frames = std::nullopt);
         ~Game() override = default;
 
         void create_render_pass();
+        void create_framebuffers();
+        // main.vert and main.frag, shared by the pipeline and the layout reflected from them.
+        [[nodiscard]] std::vector<kat::ShaderStage> shader_stages() const;
+
         void create_pipeline_layout();
+        void write_descriptor_set();
         void create_graphics_pipeline();
-        void create_buffers();
+        void create_buffers(kat::UploadBatch &batch);
 
         void render_ui();
 
         void update(float dt) override;
         void render(const kat::FrameInfo &frame_info, float dt) override;
 
-        void update_ubo();
+        // returns the dynamic offset of this frame's uniform buffer.
+        uint32_t update_ubo();
 
       private:
         glm::vec3  m_pos = {0.0f, 0.0f, -2.0f};
@@ -72,18 +85,22 @@ namespace game {
         std::shared_ptr<kat::DescriptorPool>      m_descriptor_pool;
         std::vector<vk::Framebuffer>              m_framebuffers;
 
-        vk::CommandPool                                          m_command_pool;
-        std::array<vk::CommandBuffer, kat::MAX_FRAMES_IN_FLIGHT> m_command_buffers;
+        kat::Context::swapchain_recreated_handle m_swapchain_recreated_handle;
+        kat::GpuAllocator::relocated_handle      m_relocated_handle;
 
-        std::shared_ptr<kat::Buffer> m_index_buffer;
-        std::shared_ptr<kat::Buffer> m_vertex_buffer;
+        vk::CommandPool                m_command_pool;
+        std::vector<vk::CommandBuffer> m_command_buffers;
 
-        std::vector<std::shared_ptr<kat::Buffer>> m_uniform_buffers;
-        std::vector<vk::DescriptorSet>            m_descriptor_sets;
+        std::unique_ptr<kat::GeometryArena> m_geometry;
+        kat::GeometryArena::Range           m_cube;
+
+        vk::DescriptorSet m_descriptor_set;
 
         std::unique_ptr<kat::ImGuiResources> m_imgui_resources;
 
         bool m_demowindow_open = true;
+        bool m_profiler_window_open = true;
+        bool m_memory_window_open = true;
 
         kat::color m_background_color = kat::BLACK;
         kat::color m_light_color = kat::WHITE;
@@ -97,6 +114,8 @@ namespace game {
         std::shared_ptr<kat::Sampler> m_test_sampler;
 
         bool m_ui_toggled = false;
+
+        std::optional<uint64_t> m_headless_frames;
     };
 
 } // namespace game
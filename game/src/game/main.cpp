@@ -1,21 +1,35 @@
 #include "game/game.hpp"
+#include "kat/util/profiler.hpp"
 #include <iostream>
+#include <optional>
+#include <string_view>
 
 int main(int argc, char** argv) {
     int ec = EXIT_SUCCESS;
     try {
-        std::filesystem::path resources_dir;
-        if (argc > 1) {
-            resources_dir = argv[1];
-        } else {
-            resources_dir = std::filesystem::current_path() / "resources";
+        // usage: game [resources_dir] [--headless <frames>] [--trace <file>]
+        std::filesystem::path                resources_dir = std::filesystem::current_path() / "resources";
+        std::optional<uint64_t>              headless_frames;
+        std::optional<std::filesystem::path> trace_path;
+
+        for (int i = 1; i < argc; i++) {
+            if (std::string_view(argv[i]) == "--headless" && i + 1 < argc) {
+                headless_frames = std::stoull(argv[++i]);
+            } else if (std::string_view(argv[i]) == "--trace" && i + 1 < argc) {
+                trace_path = argv[++i];
+            } else {
+                resources_dir = argv[i];
+            }
         }
 
-        std::unique_ptr<game::Game> g = std::make_unique<game::Game>(resources_dir);
+        std::unique_ptr<game::Game> g = std::make_unique<game::Game>(resources_dir, headless_frames);
 
         g->launch();
         g->context()->device().waitIdle();
 
+        if (trace_path)
+            kat::profiler::write_chrome_trace(*trace_path);
+
     } catch (const std::exception &e) {
         std::cerr << "Fatally crashed: " << e.what() << std::endl;
         std::cerr << "Fatal error encountered. Exiting." << std::endl;
@@ -0,0 +1,72 @@
+#include "kat/util/asset_pack.hpp"
+#include "kat/util/mapped_file.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <string_view>
+
+namespace {
+    void usage() {
+        std::cerr << "usage: kpak <input directory> <output.kpak> [--no-compress]" << std::endl
+                  << "  every file under the directory is packed, with paths relative to it. Mount the pack at the same directory to shadow the loose files."
+                  << std::endl;
+    }
+} // namespace
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    const std::filesystem::path input = argv[1], output = argv[2];
+
+    bool compress = true;
+    for (int i = 3; i < argc; i++) {
+        const std::string_view arg = argv[i];
+        if (arg == "--no-compress") {
+            compress = false;
+        } else {
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::error_code                    ec;
+    std::vector<std::filesystem::path> paths;
+    for (const auto &entry : std::filesystem::recursive_directory_iterator(input, ec)) {
+        // packs in the directory would end up packed into each other.
+        if (entry.is_regular_file() && entry.path().extension() != ".kpak")
+            paths.push_back(entry.path());
+    }
+    if (ec) {
+        std::cerr << "Failed to list " << input << ": " << ec.message() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::vector<kat::AssetPackInput> files;
+    for (const auto &path : paths) {
+        const auto file = kat::MappedFile::open(path);
+        if (!file) {
+            std::cerr << "Failed to open " << path << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        files.push_back(kat::AssetPackInput{path.lexically_relative(input).generic_string(), {file->bytes().begin(), file->bytes().end()}});
+    }
+
+    // sorted by path, files in the same directory tend to be loaded together and end up next to each other.
+    std::ranges::sort(files, {}, &kat::AssetPackInput::name);
+
+    if (!kat::write_asset_pack(output, files, compress))
+        return EXIT_FAILURE;
+
+    uint64_t total = 0;
+    for (const auto &file : files) {
+        total += file.bytes.size();
+    }
+
+    std::cout << "Wrote " << output << " (" << files.size() << " files, " << total << " bytes before compression, " << std::filesystem::file_size(output, ec)
+              << " bytes packed)" << std::endl;
+    return EXIT_SUCCESS;
+}
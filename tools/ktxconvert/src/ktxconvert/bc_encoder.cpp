@@ -0,0 +1,200 @@
+#include "ktxconvert/bc_encoder.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <functional>
+
+namespace ktxconvert {
+    namespace {
+        using Block = std::array<unsigned char, 16 * 4>; // 4x4 rgba texels
+
+        uint16_t to_565(const float c[3]) {
+            const auto r = static_cast<uint16_t>(std::lround(std::clamp(c[0], 0.0f, 255.0f) * 31.0f / 255.0f));
+            const auto g = static_cast<uint16_t>(std::lround(std::clamp(c[1], 0.0f, 255.0f) * 63.0f / 255.0f));
+            const auto b = static_cast<uint16_t>(std::lround(std::clamp(c[2], 0.0f, 255.0f) * 31.0f / 255.0f));
+            return static_cast<uint16_t>(r << 11 | g << 5 | b);
+        }
+
+        std::array<int, 3> from_565(uint16_t c) {
+            const int r = c >> 11 & 31, g = c >> 5 & 63, b = c & 31;
+            return {r << 3 | r >> 2, g << 2 | g >> 4, b << 3 | b >> 2};
+        }
+
+        void write_le(unsigned char *out, uint64_t value, size_t bytes) {
+            for (size_t i = 0; i < bytes; i++) {
+                out[i] = static_cast<unsigned char>(value >> (8 * i));
+            }
+        }
+
+        void encode_color(const Block &block, unsigned char *out) {
+            float mean[3] = {};
+            for (size_t i = 0; i < 16; i++) {
+                for (size_t c = 0; c < 3; c++) {
+                    mean[c] += block[i * 4 + c] / 16.0f;
+                }
+            }
+
+            float cov[6] = {}; // rr rg rb gg gb bb
+            for (size_t i = 0; i < 16; i++) {
+                const float r = block[i * 4] - mean[0], g = block[i * 4 + 1] - mean[1], b = block[i * 4 + 2] - mean[2];
+                cov[0] += r * r;
+                cov[1] += r * g;
+                cov[2] += r * b;
+                cov[3] += g * g;
+                cov[4] += g * b;
+                cov[5] += b * b;
+            }
+
+            // the principal axis, by power iteration.
+            float axis[3] = {1.0f, 1.0f, 1.0f};
+            for (int iteration = 0; iteration < 8; iteration++) {
+                const float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+                const float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+                const float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+
+                const float length = std::max({std::abs(x), std::abs(y), std::abs(z)});
+                if (length == 0.0f)
+                    break;
+
+                axis[0] = x / length;
+                axis[1] = y / length;
+                axis[2] = z / length;
+            }
+
+            float min_t = INFINITY, max_t = -INFINITY;
+            for (size_t i = 0; i < 16; i++) {
+                const float t = (block[i * 4] - mean[0]) * axis[0] + (block[i * 4 + 1] - mean[1]) * axis[1] + (block[i * 4 + 2] - mean[2]) * axis[2];
+                min_t         = std::min(min_t, t);
+                max_t         = std::max(max_t, t);
+            }
+
+            const float length2 = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+            float       hi[3], lo[3];
+            for (size_t c = 0; c < 3; c++) {
+                hi[c] = mean[c] + axis[c] * max_t / length2;
+                lo[c] = mean[c] + axis[c] * min_t / length2;
+            }
+
+            uint16_t c0 = to_565(hi), c1 = to_565(lo);
+
+            // c0 > c1 selects the 4 color mode, equal endpoints just use index 0 everywhere.
+            if (c0 < c1)
+                std::swap(c0, c1);
+
+            uint32_t indices = 0;
+            if (c0 != c1) {
+                const auto p0 = from_565(c0), p1 = from_565(c1);
+
+                std::array<std::array<int, 3>, 4> palette;
+                palette[0] = p0;
+                palette[1] = p1;
+                for (size_t c = 0; c < 3; c++) {
+                    palette[2][c] = (2 * p0[c] + p1[c]) / 3;
+                    palette[3][c] = (p0[c] + 2 * p1[c]) / 3;
+                }
+
+                for (size_t i = 0; i < 16; i++) {
+                    uint32_t best       = 0;
+                    int      best_error = INT32_MAX;
+                    for (uint32_t p = 0; p < 4; p++) {
+                        int error = 0;
+                        for (size_t c = 0; c < 3; c++) {
+                            const int d = block[i * 4 + c] - palette[p][c];
+                            error += d * d;
+                        }
+                        if (error < best_error) {
+                            best       = p;
+                            best_error = error;
+                        }
+                    }
+                    indices |= best << (2 * i);
+                }
+            }
+
+            write_le(out, c0, 2);
+            write_le(out + 2, c1, 2);
+            write_le(out + 4, indices, 4);
+        }
+
+        void encode_channel(const Block &block, size_t channel, unsigned char *out) {
+            int lo = 255, hi = 0;
+            for (size_t i = 0; i < 16; i++) {
+                lo = std::min<int>(lo, block[i * 4 + channel]);
+                hi = std::max<int>(hi, block[i * 4 + channel]);
+            }
+
+            // a0 > a1 selects the 8 value mode. With a0 == a1 every index is 0, which is a0 in either mode.
+            uint64_t indices = 0;
+            if (hi != lo) {
+                std::array<int, 8> palette{hi, lo};
+                for (int i = 2; i < 8; i++) {
+                    palette[i] = ((8 - i) * hi + (i - 1) * lo) / 7;
+                }
+
+                for (size_t i = 0; i < 16; i++) {
+                    uint64_t best       = 0;
+                    int      best_error = INT32_MAX;
+                    for (uint64_t p = 0; p < 8; p++) {
+                        const int error = std::abs(block[i * 4 + channel] - palette[p]);
+                        if (error < best_error) {
+                            best       = p;
+                            best_error = error;
+                        }
+                    }
+                    indices |= best << (3 * i);
+                }
+            }
+
+            out[0] = static_cast<unsigned char>(hi);
+            out[1] = static_cast<unsigned char>(lo);
+            write_le(out + 2, indices, 6);
+        }
+
+        std::vector<unsigned char> encode(const unsigned char *rgba, uint32_t width, uint32_t height, size_t block_bytes,
+                                          const std::function<void(const Block &, unsigned char *)> &encode_block) {
+            const uint32_t blocks_x = (width + 3) / 4, blocks_y = (height + 3) / 4;
+
+            std::vector<unsigned char> out(static_cast<size_t>(blocks_x) * blocks_y * block_bytes);
+
+            for (uint32_t by = 0; by < blocks_y; by++) {
+                for (uint32_t bx = 0; bx < blocks_x; bx++) {
+                    Block block;
+                    for (uint32_t y = 0; y < 4; y++) {
+                        for (uint32_t x = 0; x < 4; x++) {
+                            const uint32_t sx = std::min(bx * 4 + x, width - 1), sy = std::min(by * 4 + y, height - 1);
+                            std::memcpy(&block[(y * 4 + x) * 4], rgba + (static_cast<size_t>(sy) * width + sx) * 4, 4);
+                        }
+                    }
+
+                    encode_block(block, &out[(static_cast<size_t>(by) * blocks_x + bx) * block_bytes]);
+                }
+            }
+
+            return out;
+        }
+    } // namespace
+
+    std::vector<unsigned char> encode_bc1(const unsigned char *rgba, uint32_t width, uint32_t height) {
+        return encode(rgba, width, height, 8, [](const Block &block, unsigned char *out) { encode_color(block, out); });
+    }
+
+    std::vector<unsigned char> encode_bc3(const unsigned char *rgba, uint32_t width, uint32_t height) {
+        return encode(rgba, width, height, 16, [](const Block &block, unsigned char *out) {
+            encode_channel(block, 3, out);
+            encode_color(block, out + 8);
+        });
+    }
+
+    std::vector<unsigned char> encode_bc4(const unsigned char *rgba, uint32_t width, uint32_t height) {
+        return encode(rgba, width, height, 8, [](const Block &block, unsigned char *out) { encode_channel(block, 0, out); });
+    }
+
+    std::vector<unsigned char> encode_bc5(const unsigned char *rgba, uint32_t width, uint32_t height) {
+        return encode(rgba, width, height, 16, [](const Block &block, unsigned char *out) {
+            encode_channel(block, 0, out);
+            encode_channel(block, 1, out + 8);
+        });
+    }
+} // namespace ktxconvert
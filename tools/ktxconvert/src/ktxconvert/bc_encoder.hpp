@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace ktxconvert {
+
+    // Block compressors for tightly packed rgba8 texels. Images which aren't a multiple of 4 texels in size are padded by repeating their edge texels.
+    // These favour simplicity over quality (endpoints come from the extremes along the block's principal axis, no refinement), which is fine for the
+    // asset pipeline but not a replacement for a proper encoder.
+
+    // rgb only, alpha is ignored.
+    [[nodiscard]] std::vector<unsigned char> encode_bc1(const unsigned char *rgba, uint32_t width, uint32_t height);
+
+    [[nodiscard]] std::vector<unsigned char> encode_bc3(const unsigned char *rgba, uint32_t width, uint32_t height);
+
+    // the red channel.
+    [[nodiscard]] std::vector<unsigned char> encode_bc4(const unsigned char *rgba, uint32_t width, uint32_t height);
+
+    // the red and green channels, for normal maps.
+    [[nodiscard]] std::vector<unsigned char> encode_bc5(const unsigned char *rgba, uint32_t width, uint32_t height);
+
+} // namespace ktxconvert
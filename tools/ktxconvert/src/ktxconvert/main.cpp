@@ -0,0 +1,115 @@
+#include "ktxconvert/bc_encoder.hpp"
+#include "kat/graphics/ktx2.hpp"
+#include "kat/graphics/mipmaps.hpp"
+
+#include "stb_image.h"
+
+#include <iostream>
+#include <string_view>
+
+namespace {
+    void usage() {
+        std::cerr << "usage: ktxconvert <input image> <output.ktx2> [--format bc1|bc3|bc4|bc5|rgba8] [--srgb] [--no-mips] [--filter box|kaiser]" << std::endl
+                  << "  the format defaults to bc3 for images with transparency and bc1 otherwise." << std::endl;
+    }
+
+    vk::Format format_for(std::string_view name, bool srgb) {
+        if (name == "bc1")
+            return srgb ? vk::Format::eBc1RgbSrgbBlock : vk::Format::eBc1RgbUnormBlock;
+        if (name == "bc3")
+            return srgb ? vk::Format::eBc3SrgbBlock : vk::Format::eBc3UnormBlock;
+        if (name == "bc4")
+            return vk::Format::eBc4UnormBlock;
+        if (name == "bc5")
+            return vk::Format::eBc5UnormBlock;
+        if (name == "rgba8")
+            return srgb ? vk::Format::eR8G8B8A8Srgb : vk::Format::eR8G8B8A8Unorm;
+        return vk::Format::eUndefined;
+    }
+
+    std::vector<unsigned char> encode_level(vk::Format format, const unsigned char *rgba, uint32_t width, uint32_t height) {
+        switch (format) {
+        case vk::Format::eBc1RgbSrgbBlock:
+        case vk::Format::eBc1RgbUnormBlock:
+            return ktxconvert::encode_bc1(rgba, width, height);
+        case vk::Format::eBc3SrgbBlock:
+        case vk::Format::eBc3UnormBlock:
+            return ktxconvert::encode_bc3(rgba, width, height);
+        case vk::Format::eBc4UnormBlock:
+            return ktxconvert::encode_bc4(rgba, width, height);
+        case vk::Format::eBc5UnormBlock:
+            return ktxconvert::encode_bc5(rgba, width, height);
+        default:
+            return {rgba, rgba + static_cast<size_t>(width) * height * 4};
+        }
+    }
+} // namespace
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    const std::string_view input = argv[1], output = argv[2];
+
+    std::string_view format_name;
+    bool             srgb   = false;
+    bool             mips   = true;
+    auto             filter = kat::MipFilter::BOX;
+
+    for (int i = 3; i < argc; i++) {
+        const std::string_view arg = argv[i];
+        if (arg == "--format" && i + 1 < argc) {
+            format_name = argv[++i];
+        } else if (arg == "--srgb") {
+            srgb = true;
+        } else if (arg == "--no-mips") {
+            mips = false;
+        } else if (arg == "--filter" && i + 1 < argc) {
+            filter = std::string_view(argv[++i]) == "kaiser" ? kat::MipFilter::KAISER : kat::MipFilter::BOX;
+        } else {
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    int            width, height, components;
+    unsigned char *pixels = stbi_load(std::string(input).c_str(), &width, &height, &components, 4);
+    if (!pixels) {
+        std::cerr << "Failed to load " << input << ": " << stbi_failure_reason() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (format_name.empty()) {
+        bool transparent = false;
+        for (size_t i = 3; i < static_cast<size_t>(width) * height * 4; i += 4) {
+            transparent |= pixels[i] != 255;
+        }
+        format_name = transparent ? "bc3" : "bc1";
+    }
+
+    const vk::Format format = format_for(format_name, srgb);
+    if (format == vk::Format::eUndefined) {
+        std::cerr << "Unknown format " << format_name << std::endl;
+        stbi_image_free(pixels);
+        return EXIT_FAILURE;
+    }
+
+    // the mips are filtered from the uncompressed image, then each level is compressed on its own.
+    const vk::Extent2D extent(width, height);
+    const uint32_t     mip_levels = mips ? kat::mip_level_count(extent) : 1;
+    const auto         chain      = kat::generate_mip_chain(pixels, extent, 4, srgb ? vk::Format::eR8G8B8A8Srgb : vk::Format::eR8G8B8A8Unorm, mip_levels, filter);
+    stbi_image_free(pixels);
+
+    std::vector<std::vector<unsigned char>> levels;
+    for (const auto &region : chain->regions) {
+        levels.push_back(encode_level(format, chain->data.data() + region.bufferOffset, region.imageExtent.width, region.imageExtent.height));
+    }
+
+    if (!kat::write_ktx2(std::filesystem::path(output), format, extent, levels))
+        return EXIT_FAILURE;
+
+    std::cout << "Wrote " << output << " (" << vk::to_string(format) << ", " << width << "x" << height << ", " << mip_levels << " levels)" << std::endl;
+    return EXIT_SUCCESS;
+}